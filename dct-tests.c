@@ -3,118 +3,139 @@
 #include <math.h>
 #include <string.h>
 #include <pthread.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include "tcdct.h"
 
-#define PSUDO_WIDTH 2560
-#define PSUDO_HEIGHT 1440
+// Most sizes, thread counts, block sizes, precisions and kernels 
+// one invocation sweeps over
+#define CLI_MAX_LIST 32
 
-/*
-    // RESOLUTION: QVGA
-    #define PSUDO_WIDTH 320
-    #define PSUDO_HEIGHT 240
-
-    // RESOLUTION: VGA
-    #define PSUDO_WIDTH 640
-    #define PSUDO_HEIGHT 480
-
-    // RESOLUTION: HD
-    #define PSUDO_WIDTH 1280
-    #define PSUDO_HEIGHT 720
-
-    // RESOLUTION: WQHD
-    #define PSUDO_WIDTH 2560
-    #define PSUDO_HEIGHT 1440
-*/
-
-// Controller for the pixel value types (e.g. floats, doubles, etc.)
-typedef double valueType;
-
-// Pixel structure definition
-// --------------------------
-//
-// r : Value of intensity of 'red' of this pixel
-// g : Value of intensity of 'green' of this pixel
-// b : Value of intensity of 'blue' of this pixel
-// i : Value of grayscale intensity of this pixel
-//
-typedef struct {
-    valueType r, g, b;
-    valueType i;
-} pixel;
-
-
-// Image structure definition
+// Command line options structure definition
 // --------------------------
 //
-// width  : Amount of pixels in the x-direction
-// height : Amount of pixels in the y-direction
-// m      : The matrix itself containing all pixels
+// sizes       : Width and height of every synthetic image to test
+// threads     : Every amount of threads to test with
+// blocks      : Every block size to test with
+// precisions  : Every PLAN_* precision to test with
+// kernels     : Every kernel name (or "measure") to test with, none
+//               to let the plan pick (or 'TCDCT_KERNEL')
+// *Count      : Amount of entries in each of the lists above
+// iterations  : Runs averaged over for every combination
+// input       : PGM (P2) file used as the source instead of a
+//               synthetic image (or NULL)
+// output      : Prefix the images of the last run are written to,
+//               e.g. "out/" gives "out/srcIMG.pgm" (or NULL)
+// quiet       : Only print the averages of every combination
+// csv         : Print one CSV line per combination instead
+// counters    : Count the perfCoreEvents of every worker, adding the
+//               cycles per block and IPC to the results
 //
 typedef struct {
-    int width;
-    int height;
-    int channels;
-    pixel** m;
-} image;
-
-
-// Thread Info structure definition
+    int sizes[CLI_MAX_LIST][2];
+    int threads[CLI_MAX_LIST];
+    int blocks[CLI_MAX_LIST];
+    int precisions[CLI_MAX_LIST];
+    char* kernels[CLI_MAX_LIST];
+    int sizeCount, threadCount, blockCount, precisionCount, kernelCount;
+    int iterations;
+    char* input;
+    char* output;
+    int quiet;
+    int csv;
+    int counters;
+} cliOptions;
+
+
+// Test Results structure definition
 // --------------------------
 //
-// threadIndex: What 'i-th' index a thread is in all threads used
-// start      : Starting height index for thread to iterate over
-// end        : Starting height index for thread to iterate over
-// padIndex   : Starting index for padding in an image
-// srcIMG     : Pointer to the source image
-// dctIMG     : Pointer to the DCT image
-// idctIMG    : Pointer to the IDCT image
+// validation : Return value of imValidate() on the source & IDCT
+// time_spent : Seconds spent processing the image
+// err1       : Return value of imERR1()
+// err2       : Return value of imERR2()
+// err3       : Return value of imMSE()
+// counters   : Hardware counters summed over every thread
 //
-typedef struct {
-    int threadIndex;
-    int start;
-    int end;
-    int padIndex;
-    image* srcIMG;
-    image* dctIMG;
-    image* idctIMG;
-} threadInfo;
-
 typedef struct {
     int validation;
     double time_spent;
     long double err1;
     long double err2;
     long double err3;
+    uint64_t counters[PERF_MAX_EVENTS];
 } testResults;
 
 
-// ALLOCATION & INITIALIZATION
-image* allocateImage(int width, int height, int channels);
-image* generateImage(int width, int height, int channels, int padding);
-int imGetPadSize(int totalThreads, int startingSize);
-void imRemovePadding(image* srcIMG, image* dctIMG, image* idctIMG, int padAmnt);
-void imread(image* im, FILE *inFile);
-void imwrite(image* im, char* fileName);
-void imDelete(image* srcIMG, image* dctIMG, image* idctIMG);
-
-// VALIDATION
-int imValidate(image* imA, image* imB, double threshold);
-double imERR1(image* imA, image* imB);
-double imERR2(image* imA, image* imB);
-long double imMSE(image* imA, image* imB);
-
-
-// OPERATIONS
-void imPrint(image* im);
-void imDCT(image* inIMG, image* outIMG);
-void imIDCT(image* inIMG, image* outIMG);
-void imBlockIDCT(image* inIMG, image* outIMG, int i, int j);
-void imBlockDCT(image* inIMG, image* outIMG, int i, int j);
-
 // PRIMARY CALLS
-testResults* runTest(int totalThreads, int width, 
-                        int height, int channels);
-
-void* imProcess(void* arg);
+testResults* runTest(dctPlan* plan, int channels);
+dctPlan* createPlan(int totalThreads, int width, int height);
+int tunedThreads(int width, int height, int blockSize, int precision);
+int mostThreads(cliOptions* opt);
+void parseOptions(cliOptions* opt, int argc, char* argv[]);
+void printUsage(char* name);
+void printCounters(perfCounters* probe, long double* counters, long double blocks,
+                   const char* prefix);
+
+void runSharingTest(int width, int height, int channels, const int* threads, int threadCount);
+void runSequenceTest(int width, int height, int channels, const int* threads, int threadCount);
+void runUpdateTest(int width, int height, int channels, const int* threads, int threadCount);
+void runScaledTest(int width, int height, int channels, const int* threads, int threadCount);
+void runCoefTest(int width, int height, int channels, const int* threads, int threadCount);
+void runGenerateTest(int width, int height, const int* threads, int threadCount);
+void runTraversalTest(int width, int height, int channels, const int* threads, int threadCount);
+void runAsyncTest(int width, int height, const int* threads, int threadCount);
+void runDistributeTest(int width, int height);
+void runHugePageTest(int channels, const int* threads, int threadCount);
+void runDedupTest(int width, int height, const int* threads, int threadCount);
+void runBatchTest(int width, int height, const int* threads, int threadCount);
+void runEditTest(int width, int height, const int* threads, int threadCount);
+void runDenoiseTest(int width, int height, const int* threads, int threadCount);
+void runIntegerTest(int width, int height, const int* threads, int threadCount);
+void runTuneTest(int width, int height);
+void runTextTest(int width, int height, const int* threads, int threadCount);
+void runPriorityTest(int width, int height, const int* threads, int threadCount);
+void runBudgetTest(int width, int height, const int* threads, int threadCount);
+image* createSource(dctPlan* plan);
+void fillSource(dctPlan* plan, image* srcIMG);
+void writeOutput(image* im, char* name);
+image* readInput(const char* path);
+
+// Set through 'TCDCT_NUMA' to pin threads and first-touch their bands
+int numaMode = 0;
+
+// IM_ALLOC_* flags every test image is allocated with, such as the
+// plain unaligned malloc()'s of the legacy layout that let bands of
+// adjacent threads share cache lines
+int allocFlags = 0;
+
+// Set to have the workers fault in the pages of every image before
+// the timed run (always done in NUMA-aware runs)
+int firstTouch = 0;
+
+// Events counted by each band of a plan execution (none if NULL)
+const perfEvent* perfEvents = NULL;
+int perfEventCount = 0;
+
+// Content and seed of the generated images, set through 
+// 'TCDCT_CONTENT' (noise, gradient, natural or text) and 'TCDCT_SEED'
+int contentMode       = GEN_NOISE;
+uint64_t contentSeed  = GEN_DEFAULT_SEED;
+
+// Block size, precision and kernel of every plan createPlan() makes;
+// the kernel is a name, "measure", or NULL to let the plan pick one
+int planBlock         = 8;
+int planPrecision     = PLAN_DOUBLE;
+char* planKernel      = NULL;
+
+// Source image read from the input file, copied into the source of
+// every test instead of generating one (or NULL)
+image* inputImage     = NULL;
+
+// Prefix the images of a test are written to when set (or NULL)
+char* outputPrefix    = NULL;
 
 int main(int argc, char* argv[]) {
  
@@ -124,20 +145,192 @@ int main(int argc, char* argv[]) {
     ///////////////////////////////////////////
 
     long double time_AVG, err1_AVG, err2_AVG, err3_AVG;
-    int height, width, bits, channels, totalThreads;
-    char* format = (char*)malloc(sizeof(char)*5);
+    int channels = 1;
+
+    // Read the sizes, threads, etc. to sweep over from the command line
+    cliOptions opt;
+    parseOptions(&opt, argc, argv);
+    planKernel = getenv("TCDCT_KERNEL");
+
+    // Read in the source image once, its size replacing any sizes given
+    if (opt.input != NULL) {
+        if ((inputImage = readInput(opt.input)) == NULL) {
+            printf("Unable to read a P2 image from '%s'\n", opt.input);
+            exit(1);
+        }
+
+        opt.sizes[0][0] = inputImage->width, opt.sizes[0][1] = inputImage->height;
+        opt.sizeCount   = 1;
+    }
+
+    // The modes below test the first size, block size and precision
+    int width = opt.sizes[0][0], height = opt.sizes[0][1];
+    planBlock     = opt.blocks[0];
+    planPrecision = opt.precisions[0];
+
+    // and every amount of threads given, with 'auto' as many as are
+    // tuned for that size (or a thread per CPU without a tuning)
+    int threads[CLI_MAX_LIST], threadCount = opt.threadCount;
+    for (int t = 0; t < threadCount; t++)
+        threads[t] = (opt.threads[t] != 0? opt.threads[t]:
+                      tunedThreads(width, height, planBlock, planPrecision));
+    if (!opt.csv)
+        printf("Source: %s\nHeight: %i\nWidth: %i\nChannels: %i\n\n", 
+               (opt.input != NULL? opt.input:"synthetic"), height, width, channels);
+
+    // Enable per-thread tracing if a trace file was requested; the
+    // per-run summary is printed after each test's own results
+    char* traceFile = getenv("TCDCT_TRACE");
+    if (traceFile != NULL && traceInit(mostThreads(&opt)) != 0) {
+        printf("Unable to initialize tracing, continuing without it\n");
+        traceFile = NULL;
+    }
+
+    // Report local vs. remote bandwidth when running NUMA-aware
+    numaMode = (getenv("TCDCT_NUMA") != NULL);
+    if (numaMode)
+        affinityReport(stdout);
 
-    // Initialize file pointer and fopen() the image file
-    FILE *inFile = fopen((argc == 1? "imtest2.ppm":argv[1]), "r+");
+    // Pick the content and seed of every generated image
+    if (getenv("TCDCT_CONTENT") != NULL && 
+        (contentMode = imGenerateMode(getenv("TCDCT_CONTENT"))) < 0) {
+        printf("Unknown content '%s', generating noise\n", getenv("TCDCT_CONTENT"));
+        contentMode = GEN_NOISE;
+    }
+
+    if (getenv("TCDCT_SEED") != NULL)
+        contentSeed = strtoull(getenv("TCDCT_SEED"), NULL, 0);
+
+    // Time the image generator and stop there
+    if (getenv("TCDCT_GENERATE") != NULL) {
+        runGenerateTest(width, height, threads, threadCount);
+        return 0;
+    }
 
-    // Read in the image file characteristics (e.g. height & width) and
-    // generate an image based off the characteristics read in
-    fscanf(inFile, "%s\n %i %i\n%i", format, &width, &height, &bits);
-    channels = 1, width = PSUDO_WIDTH, height = PSUDO_HEIGHT;
+    // Compare the cache misses of each traversal order of the blocks,
+    // with and without prefetching, and stop there
+    if (getenv("TCDCT_TRAVERSE") != NULL) {
+        runTraversalTest(width, height, channels, threads, threadCount);
+        return 0;
+    }
+
+    // Measure the latency of transforms submitted asynchronously by
+    // several threads at once and stop there
+    if (getenv("TCDCT_ASYNC") != NULL) {
+        runAsyncTest(width, height, threads, threadCount);
+        return 0;
+    }
+
+    // Transform across 1 to 8 local worker processes and stop there
+    if (getenv("TCDCT_DISTRIBUTE") != NULL) {
+        runDistributeTest(width, height);
+        return 0;
+    }
+
+    // Compare transforms with and without shortcutting flat and
+    // repeated blocks on a photo and on pages of text and stop there
+    if (getenv("TCDCT_DEDUP") != NULL) {
+        runDedupTest(width, height, threads, threadCount);
+        return 0;
+    }
+
+    // Compare the batched kernel at every width against the per-block
+    // kernels, on one image and on a batch of thumbnails, and stop there
+    if (getenv("TCDCT_BATCH") != NULL) {
+        runBatchTest(width, height, threads, threadCount);
+        return 0;
+    }
+
+    // Compare flips, rotations, crops and downscales done on the
+    // coefficients against doing them on the pixels and stop there
+    if (getenv("TCDCT_EDIT") != NULL) {
+        runEditTest(width, height, threads, threadCount);
+        return 0;
+    }
+
+    // Time denoising a noisy image over overlapping windows against
+    // transforming every window on its own and stop there
+    if (getenv("TCDCT_DENOISE") != NULL) {
+        runDenoiseTest(width, height, threads, threadCount);
+        return 0;
+    }
+
+    // Time the reversible integer transform on 16 and 32-bit planes
+    // against the double precision one and stop there
+    if (getenv("TCDCT_INTEGER") != NULL) {
+        runIntegerTest(width, height, threads, threadCount);
+        return 0;
+    }
+
+    // Calibrate and store the fastest configuration for the size on
+    // this CPU, compare it against the defaults and stop there
+    if (getenv("TCDCT_TUNE") != NULL) {
+        runTuneTest(width, height);
+        return 0;
+    }
+
+    // Time writing and reading ASCII images in parallel against
+    // imwrite() and imread() and stop there
+    if (getenv("TCDCT_TEXT") != NULL) {
+        runTextTest(width, height, threads, threadCount);
+        return 0;
+    }
+
+    // Measure the latency of previews submitted while bulk transforms
+    // keep the workers busy, with and without priorities, and stop there
+    if (getenv("TCDCT_PRIORITY") != NULL) {
+        runPriorityTest(width, height, threads, threadCount);
+        return 0;
+    }
+
+    // Transform under time budgets shorter and longer than a full
+    // transform takes, and cancel transforms halfway, and stop there
+    if (getenv("TCDCT_BUDGET") != NULL) {
+        runBudgetTest(width, height, threads, threadCount);
+        return 0;
+    }
+
+    // Compare the dTLB misses of per-column allocations against a
+    // single plane with and without huge pages and stop there
+    if (getenv("TCDCT_HUGEPAGES") != NULL) {
+        runHugePageTest(channels, threads, threadCount);
+        return 0;
+    }
+
+    // Compare cross-core cache line traffic of the legacy column
+    // allocation against the cache line aligned one and stop there
+    if (getenv("TCDCT_SHARING") != NULL) {
+        runSharingTest(width, height, channels, threads, threadCount);
+        return 0;
+    }
+
+    // Compare full transforms of a synthetic frame sequence against
+    // the sequence mode that skips unchanged blocks and stop there
+    if (getenv("TCDCT_SEQUENCE") != NULL) {
+        runSequenceTest(width, height, channels, threads, threadCount);
+        return 0;
+    }
+
+    // Compare the latency of re-transforming edited rectangles of
+    // growing size against a full transform and stop there
+    if (getenv("TCDCT_UPDATE") != NULL) {
+        runUpdateTest(width, height, channels, threads, threadCount);
+        return 0;
+    }
 
-    // Print the object information for verification
-    printf("Format: %s\nHeight: %i\nWidth: %i\nBits: %.0f\nChannels: %i\n\n", 
-                              format, height, width, log2(bits+1), channels);
+    // Time the scaled and region-of-interest reconstructions against
+    // the full one and stop there
+    if (getenv("TCDCT_SCALED") != NULL) {
+        runScaledTest(width, height, channels, threads, threadCount);
+        return 0;
+    }
+
+    // Time writing and reading coefficient files (against imwrite())
+    // and stop there
+    if (getenv("TCDCT_COEF") != NULL) {
+        runCoefTest(width, height, channels, threads, threadCount);
+        return 0;
+    }
     
 
 
@@ -145,94 +338,318 @@ int main(int argc, char* argv[]) {
     //           TEST ITERATIONS             //
     ///////////////////////////////////////////
 
-    // Perform the tests and print out each set of results
-    for (int thread = 1; thread <= 10; thread++) {
+    // Count the core events of every worker around its bands, where
+    // the probe tells which of them this host can count at all
+    perfCounters probe;
+    if (opt.counters) {
+        perfEvents     = perfCoreEvents;
+        perfEventCount = perfCoreEventCount;
+        if (perfOpen(&probe, perfEvents, perfEventCount) == 0 && !opt.csv)
+            printf("Unable to open any hardware counters, reporting them as n/a\n\n");
+    }
+
+    if (opt.csv) {
+        printf("width,height,block,precision,kernel,threads,iterations,"
+               "time,mpixels_per_s,invalid,err1,err2,mse");
+        if (opt.counters)
+            printf(",cycles,instructions,l1d_misses,llc_misses,dtlb_misses,"
+                   "branch_misses,cycles_per_block,ipc");
+        printf("\n");
+    }
+
+    // Perform the tests for every combination of the options and
+    // print out each set of results
+    for (int sz = 0; sz < opt.sizeCount; sz++)
+    for (int b = 0; b < opt.blockCount; b++)
+    for (int p = 0; p < opt.precisionCount; p++)
+    for (int k = 0; k < (opt.kernelCount > 0? opt.kernelCount:1); k++)
+    for (int t = 0; t < opt.threadCount; t++) {
+        int thread    = opt.threads[t];
+        width         = opt.sizes[sz][0];
+        height        = opt.sizes[sz][1];
+        planBlock     = opt.blocks[b];
+        planPrecision = opt.precisions[p];
+        if (opt.kernelCount > 0)
+            planKernel = opt.kernels[k];
+
+        // Plan once for every iteration with this amount of threads
+        // (workers pinned to their CPUs if NUMA-aware)
+        dctPlan* plan      = createPlan(thread, width, height);
+        const char* kernel = planKernelName(plan->kernel);
+        thread             = plan->totalThreads;
+        if (!opt.csv)
+            printf("Size: %ix%i, Block: %i, Precision: %s, Kernel: %s\n\n", 
+                   width, height, planBlock, 
+                   (planPrecision == PLAN_FLOAT? "float":"double"), kernel);
 
         // Reset the running averages
         time_AVG = (long double)0;
         err1_AVG = (long double)0;
         err2_AVG = (long double)0;
         err3_AVG = (long double)0;
+        int invalid = 0;
+        long double counter_AVG[PERF_MAX_EVENTS] = {0};
+
+        // Blocks transformed (forward and back) by every run
+        long double blocks = (long double)(plan->width/planBlock)*
+                             (plan->paddedHeight/planBlock);
 
         // Perform a certain amount of iterations with the same
         // exact parameters to average over as the final result
-        for (int it = 0; it < 25; it++) {
+        for (int it = 0; it < opt.iterations; it++) {
 
-            // Run the test with current parameters   
-            testResults* result = runTest(thread, PSUDO_WIDTH, 
-                                          PSUDO_HEIGHT, channels);
+            // Run the test with current parameters, writing out the
+            // images of the very last run if asked to
+            int last     = (sz+1 == opt.sizeCount && b+1 == opt.blockCount &&
+                            p+1 == opt.precisionCount && t+1 == opt.threadCount &&
+                            k+1 >= opt.kernelCount && it+1 == opt.iterations);
+            outputPrefix = (last? opt.output:NULL);
+            testResults* result = runTest(plan, channels);
 
             // Print the test results
-            printf("         Time Elapsed: %.15f\n",  result->time_spent);
-            printf("  imValidate() return: %i\n",     result->validation);
-            printf("imERR1() return value: %.25Le\n", result->err1);
-            printf("imERR2() return value: %.25Le\n", result->err2);
-            printf(" imMSE() return value: %.25Le\n", result->err3);
-            printf("\n\n");
+            if (!opt.quiet) {
+                printf("         Time Elapsed: %.15f\n",  result->time_spent);
+                printf("  imValidate() return: %i\n",     result->validation);
+                printf("imERR1() return value: %.25Le\n", result->err1);
+                printf("imERR2() return value: %.25Le\n", result->err2);
+                printf(" imMSE() return value: %.25Le\n", result->err3);
+                if (opt.counters) {
+                    long double counters[PERF_MAX_EVENTS];
+                    for (int e = 0; e < perfEventCount; e++)
+                        counters[e] = (long double)result->counters[e];
+
+                    printCounters(&probe, counters, blocks, "");
+                }
+                printf("\n");
+                traceSummary(stdout);
+                printf("\n");
+            }
 
             // Increment the running averages
             time_AVG += (long double)result->time_spent;
             err1_AVG += (long double)result->err1;
             err2_AVG += (long double)result->err2;
             err3_AVG += (long double)result->err3;
+            invalid  += (result->validation != 0);
+            for (int e = 0; e < perfEventCount; e++)
+                counter_AVG[e] += (long double)result->counters[e];
+
             free(result);
         }
+        planDestroy(plan);
 
         // Print the overall averages for tests 
         // with current parameters
+        long double its = (long double)opt.iterations;
+        for (int e = 0; e < perfEventCount; e++)
+            counter_AVG[e] /= its;
+
+        if (opt.csv) {
+            printf("%i,%i,%i,%s,%s,%i,%i,%.9Lf,%.3Lf,%i,%.6Le,%.6Le,%.6Le",
+                   width, height, planBlock, 
+                   (planPrecision == PLAN_FLOAT? "float":"double"),
+                   kernel, thread, opt.iterations,
+                   time_AVG/its, (long double)width*height/1e6/(time_AVG/its),
+                   invalid, err1_AVG/its, err2_AVG/its, err3_AVG/its);
+            if (opt.counters) {
+                long double cycles = counter_AVG[PERF_CORE_CYCLES];
+                for (int e = 0; e < perfEventCount; e++)
+                    printf(",%.0Lf", counter_AVG[e]);
+                printf(",%.2Lf,%.3Lf", cycles/blocks, (cycles > 0? 
+                       counter_AVG[PERF_CORE_INSTRUCTIONS]/cycles:(long double)0));
+            }
+            printf("\n");
+            fflush(stdout);
+            continue;
+        }
+
         printf("\n------------------------------------------\n");
         printf("\n FINISHED ITERATIONS FOR '%i' THREADS \n\n", thread);
-        printf("Average Time Elapsed: %.15Lf\n", (time_AVG/(long double)25.0));
-        printf("    Average imERR1(): %.25Le\n", (err1_AVG/(long double)25.0));
-        printf("    Average imERR2(): %.25Le\n", (err2_AVG/(long double)25.0));
-        printf("     Average imMSE(): %.25Le\n", (err3_AVG/(long double)25.0));
+        printf("Average Time Elapsed: %.15Lf\n", (time_AVG/its));
+        printf("    Average imERR1(): %.25Le\n", (err1_AVG/its));
+        printf("    Average imERR2(): %.25Le\n", (err2_AVG/its));
+        printf("     Average imMSE(): %.25Le\n", (err3_AVG/its));
+        printf("    Invalid Results : %i\n",     invalid);
+        if (opt.counters)
+            printCounters(&probe, counter_AVG, blocks, "Average ");
         printf("\n------------------------------------------\n");
         printf("\n\n\n\n\n\n\n\n\n\n\n\n");
     }
+
+    if (opt.counters) {
+        perfClose(&probe);
+        perfEvents     = NULL;
+        perfEventCount = 0;
+    }
+
+    // Write the timeline of every run out for chrome://tracing
+    if (traceFile != NULL) {
+        if (traceWrite(traceFile) != 0)
+            printf("Unable to write trace file '%s'\n", traceFile);
+
+        traceFree();
+    }
+
+    imFree(inputImage);
     return 0;
 }
 
-testResults* runTest(int totalThreads, int width, 
-                        int height, int channels) {
+/*
+    Create the plan for a test with 'totalThreads' threads;
+
+    The kernel is picked from the host, or set (through '-k' or
+    'TCDCT_KERNEL') to either a kernel name (e.g. "separable") or 
+    "measure" to time every supported kernel and keep the fastest;
+    0 threads ('-t auto') takes the threads and configuration tuned
+    for the size on this CPU from the tuning file ('TCDCT_TUNE_FILE'
+    or TUNE_FILE_DEFAULT), tuning them first with "measure"
+*/
+dctPlan* createPlan(int totalThreads, int width, int height) {
+    char* kernelName = planKernel;
+    int flags        = (numaMode? PLAN_PINNED:0);
+    if (kernelName != NULL && strcmp(kernelName, "measure") == 0)
+        flags |= PLAN_MEASURE;
+
+    dctPlan* plan = (totalThreads == 0?
+                     planCreateTuned(width, height, planBlock, planPrecision, flags,
+                                     getenv("TCDCT_TUNE_FILE")):
+                     planCreate(width, height, planBlock, planPrecision, 
+                                totalThreads, flags));
+    if (plan == NULL) {
+        printf("Unable to plan a %ix%i image with %ix%i blocks over %i threads\n", 
+                           width, height, planBlock, planBlock, totalThreads);
+        exit(1);
+    }
 
+    if (kernelName != NULL && !(flags & PLAN_MEASURE) &&
+        planSetKernel(plan, planKernelFromName(kernelName)) != 0)
+        printf("Kernel '%s' isn't supported, using '%s'\n", kernelName,
+                                      planKernelName(plan->kernel));
 
+    return plan;
+}
 
-    ///////////////////////////////////////////
-    //            INTITIAL SETUP             //
-    ///////////////////////////////////////////
 
-    // Create structure to hold runtime results
-    testResults* results = (testResults*)malloc(1*sizeof(testResults));
+/*
+    Return the amount of threads tuned for a size on this CPU (from
+    'TCDCT_TUNE_FILE' or TUNE_FILE_DEFAULT), or a thread per CPU
+    without a tuning, as '-t auto' plans get
+*/
+int tunedThreads(int width, int height, int blockSize, int precision) {
+    dctTuning tuning;
+    if (planTuneLookup(getenv("TCDCT_TUNE_FILE"), width, height, blockSize, 
+                       precision, &tuning) == 0)
+        return tuning.totalThreads;
+
+    return affinityCPUCount();
+}
+
+
+/*
+    Return the most threads any plan of this invocation runs: a thread
+    per CPU (as far as the tuner goes), every amount given with '-t',
+    and for '-t auto' the amount tuned for each size
+*/
+int mostThreads(cliOptions* opt) {
+    int most = affinityCPUCount();
+    for (int t = 0; t < opt->threadCount; t++) {
+        if (opt->threads[t] > most)
+            most = opt->threads[t];
+
+        if (opt->threads[t] != 0)
+            continue;
+
+        for (int sz = 0; sz < opt->sizeCount; sz++)
+        for (int b = 0; b < opt->blockCount; b++)
+        for (int p = 0; p < opt->precisionCount; p++) {
+            int threads = tunedThreads(opt->sizes[sz][0], opt->sizes[sz][1], 
+                                       opt->blocks[b], opt->precisions[p]);
+            if (threads > most)
+                most = threads;
+        }
+    }
+
+    return (most < TRACE_MAX_THREADS? most:TRACE_MAX_THREADS);
+}
+
+
+/*
+    Fill the source image of a test, copying the input image when one
+    of the plan's size was read in and generating the content otherwise
+*/
+void fillSource(dctPlan* plan, image* srcIMG) {
+    if (inputImage != NULL && inputImage->width == plan->width &&
+        inputImage->height == plan->height) {
+        for (int x = 0; x < plan->width; x++)
+            memcpy(srcIMG->m[x], inputImage->m[x], plan->height*sizeof(pixel));
+    }
+
+    else
+        imGenerate(srcIMG, plan->height, contentSeed, contentMode, plan->pool);
+}
+
+
+/*
+    Allocate an image for a plan and fill in the test's content
+*/
+image* createSource(dctPlan* plan) {
+    image* srcIMG = planAllocateImage(plan, 0);
+    fillSource(plan, srcIMG);
+    return srcIMG;
+}
+
+
+/*
+    Read a P2 PGM file into a new (grayscale) image, returning NULL
+    if it can't be read
+*/
+image* readInput(const char* path) {
+    image* im = imreadParallel(path, NULL);
+    if (im != NULL && im->channels != 1) {
+        imFree(im);
+        return NULL;
+    }
+
+    return im;
+}
 
-    // Check for padding requirements
-    int padding = 0, paddedSize = imGetPadSize(totalThreads, height);
-    if (paddedSize != -1 && paddedSize != height && totalThreads != 1)
-        padding = paddedSize - height;
 
-    // Randomly generate the input image based on characteristics given
-    image* srcIMG = generateImage(width, height, channels, padding);
+/*
+    Write an image out to the output prefix followed by 'name'
+*/
+void writeOutput(image* im, char* name) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s%s", outputPrefix, name);
+    imwriteParallel(im, path, NULL);
+}
+
 
-    // Allocate for the DCT & IDCT images    
-    image* dctIMG = allocateImage(width, (height + padding), channels);
-    image* idctIMG = allocateImage(width, (height + padding), channels);
+testResults* runTest(dctPlan* plan, int channels) {
 
 
 
     ///////////////////////////////////////////
-    //           THREADING SETUP             //
+    //            INTITIAL SETUP             //
     ///////////////////////////////////////////
 
-    // Create threading information
-    pthread_t tid[totalThreads];
-    threadInfo* th = (threadInfo*)malloc(totalThreads*sizeof(threadInfo));
-    for (int i = 0; i < totalThreads; i++) {
-        th[i].threadIndex  = i;
-        th[i].start        = i*(height + padding)/totalThreads;
-        th[i].end          = (i + 1)*(height + padding)/totalThreads;
-        th[i].padIndex     = height;
-        th[i].srcIMG       = srcIMG;
-        th[i].dctIMG       = dctIMG;
-        th[i].idctIMG      = idctIMG;
+    // Create structure to hold runtime results
+    testResults* results = (testResults*)malloc(1*sizeof(testResults));
+
+    // Allocate the images at the plan's padded height
+    image* srcIMG  = planAllocateImage(plan, allocFlags);
+    image* dctIMG  = planAllocateImage(plan, allocFlags);
+    image* idctIMG = planAllocateImage(plan, allocFlags);
+
+    // Place each band on the node of the (pinned) worker processing it
+    // before the pixels are written, then generate the input
+    if (numaMode || firstTouch)
+        planFirstTouch(plan, srcIMG, dctIMG, idctIMG);
+
+    fillSource(plan, srcIMG);
+
+    for (int i = 0; i < plan->totalThreads; i++) {
+        plan->th[i].perfEvents     = perfEvents;
+        plan->th[i].perfEventCount = perfEventCount;
     }
 
 
@@ -243,19 +660,22 @@ testResults* runTest(int totalThreads, int width,
 
     struct timespec start, end; 
     clock_gettime(CLOCK_REALTIME, &start);
+    traceRunBegin();
 
-    // Launch all threads
-    for (int i = 0; i < totalThreads; i++)
-        pthread_create(&tid[i], NULL, (void*)imProcess, &th[i]);
-
-    // Collect all threads launched
-    for (int i = 0; i < totalThreads; i++)
-        pthread_join(tid[i], NULL);
+    // Run every band on the plan's workers and wait for all of them
+    planExecute(plan, srcIMG, dctIMG, idctIMG);
 
     // Save the amount of time spent on processing the image
+    traceRunEnd();
     clock_gettime(CLOCK_REALTIME, &end);
     results->time_spent = (end.tv_sec - start.tv_sec) + 
                           (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    // Aggregate the counters of every thread for the run
+    memset(results->counters, 0, sizeof(results->counters));
+    for (int i = 0; i < plan->totalThreads; i++)
+        for (int e = 0; e < perfEventCount; e++)
+            results->counters[e] += plan->th[i].perf.values[e];
     
 
 
@@ -263,9 +683,8 @@ testResults* runTest(int totalThreads, int width,
     //        COLLECTING RESULTS             //
     ///////////////////////////////////////////
 
-    // Unpad the image for cases of thread amount & height mismatch
-    if (paddedSize != -1 && paddedSize != height && totalThreads != 1) 
-        imRemovePadding(srcIMG, dctIMG, idctIMG, (paddedSize - height));
+    // Unpad the image to the height that was asked for
+    imRemovePadding(srcIMG, dctIMG, idctIMG, (plan->paddedHeight - plan->height));
 
     // """Manual verification"""
     // (Yes, this needs sarcastic triple-quotes, it's that big)
@@ -284,13 +703,22 @@ testResults* runTest(int totalThreads, int width,
     */
 
     // Collect information about the error generated in processing
-    int DOP             = 12;
+    // (floats only keep about 7 digits, so 3 decimal places of 255,
+    // and blocks over 8x8 sum enough terms to lose another digit)
+    int DOP             = (plan->precision == PLAN_FLOAT? 3:12) - (plan->blockSize > 8);
     double precision    = (double)(1.0/(pow(10.0, (double)DOP)));
     results->validation = imValidate(srcIMG, idctIMG, precision);
     results->err1       = imERR1(srcIMG, idctIMG);
     results->err2       = imERR2(srcIMG, idctIMG);
     results->err3       = imMSE(srcIMG, idctIMG);
 
+    // Write the images out for verification if asked to
+    if (outputPrefix != NULL) {
+        writeOutput(srcIMG,  "srcIMG.pgm");
+        writeOutput(dctIMG,  "dctIMG.pgm");
+        writeOutput(idctIMG, "idctIMG.pgm");
+    }
+
     // NOTE: If you don't delete the picture before returning 
     //       this whole thing leaks memory like a damn seive
     //
@@ -299,452 +727,2205 @@ testResults* runTest(int totalThreads, int width,
 }
 
 
-void* imProcess(void* arg) {
+/*
+    Run the same tests on both the legacy and the cache line aligned
+    column allocation, reporting the averaged counters of each;
+
+    In the legacy layout a column's band boundaries and the end of one
+    column next to the start of the next fall inside of shared cache
+    lines, so the threads on either side keep invalidating them
+*/
+void runSharingTest(int width, int height, int channels, const int* threads, int threadCount) {
+    int iterations = 5;
+    perfEvents     = perfSharingEvents;
+    perfEventCount = perfSharingEventCount;
+
+    // Check which events this host can count at all
+    perfCounters probe;
+    perfOpen(&probe, perfEvents, perfEventCount);
+
+    printf("%7s %8s %12s", "threads", "layout", "time (s)");
+    for (int e = 0; e < perfEventCount; e++)
+        printf(" %18s", perfEvents[e].name);
+    printf("\n");
+
+    for (int t = 0; t < threadCount; t++) {
+        int thread = threads[t];
+        if (thread < 2)
+            continue;
+
+        for (int legacy = 1; legacy >= 0; legacy--) {
+            long double time_AVG = (long double)0;
+            long double counter_AVG[PERF_MAX_EVENTS] = {0};
+
+            allocFlags    = (legacy? IM_ALLOC_LEGACY:0);
+            dctPlan* plan = createPlan(thread, width, height);
+            for (int it = 0; it < iterations; it++) {
+                testResults* result = runTest(plan, channels);
+                time_AVG += (long double)result->time_spent;
+                for (int e = 0; e < perfEventCount; e++)
+                    counter_AVG[e] += (long double)result->counters[e];
+
+                free(result);
+            }
+            planDestroy(plan);
+
+            printf("%7i %8s %12.6Lf", thread, (legacy? "legacy":"aligned"),
+                                      time_AVG/iterations);
+            for (int e = 0; e < perfEventCount; e++) {
+                if (probe.fd[e] < 0)
+                    printf(" %18s", "n/a");
+
+                else
+                    printf(" %18.0Lf", counter_AVG[e]/iterations);
+            }
+            printf("\n");
+        }
+    }
+
+    perfClose(&probe);
+    perfEvents     = NULL;
+    perfEventCount = 0;
+    allocFlags     = 0;
+}
 
-    // Parse the argument into a local (struct info*) structure
-    threadInfo* input = (threadInfo*)arg;
 
-    // Iterate through the rows corrosponding to this thread
-    for (int y = input->start; (y < input->end) && (y < input->padIndex); y += 8) {
+/*
+    Apply the small changes between two frames of the synthetic
+    sequence; a 16x16 square moving across the image and a handful
+    of single pixels nudged up or down (sensor noise)
+*/
+void perturbFrame(image* im, int height, int frame) {
+    int side = (im->width < 32 || height < 32? 4:16);
+    int x0   = (frame*8) % (im->width - side + 1);
+    int y0   = (frame*4) % (height - side + 1);
+    for (int x = x0; x < x0 + side; x++)
+        for (int y = y0; y < y0 + side; y++)
+            im->m[x][y].i = (double)((frame*37) % 255);
+
+    for (int n = 0; n < im->width*height/2000 + 1; n++) {
+        pixel* p = &im->m[rand() % im->width][rand() % height];
+        p->i     = (p->i >= 254.0? p->i - 1.0:p->i + 1.0);
+    }
+}
 
-        // Iterate through the columns corrosponding to this thread
-        for (int x = 0, width = input->srcIMG->width; x < width; x += 8) {
 
-            // Perform a DCT -> IDCT on a 8x8 macroblock
-            // centered at the point (x, y)
-            imBlockDCT(input->srcIMG, input->dctIMG, x, y);
-            imBlockIDCT(input->dctIMG, input->idctIMG, x, y);
+/*
+    Transform a synthetic sequence of frames both in full and with the
+    sequence mode, reporting the share of blocks the latter skipped and
+    the speedup of skipping them; the coefficients of both must match
+*/
+void runSequenceTest(int width, int height, int channels, const int* threads, int threadCount) {
+    int frames = 30;
+    printf("%7s %14s %14s %12s %10s %12s\n", "threads", "full (s)",
+           "sequence (s)", "skip ratio", "speedup", "validation");
+
+    for (int t = 0; t < threadCount; t++) {
+        int thread = threads[t];
+        dctPlan* plan    = createPlan(thread, width, height);
+        dctSequence* seq = seqCreate(plan, 0.0);
+
+        image* frameIMG  = createSource(plan);
+        image* dctIMG    = planAllocateImage(plan, 0);
+        image* idctIMG   = planAllocateImage(plan, 0);
+
+        double fullTime = 0.0, seqTime = 0.0;
+        int validation  = 0;
+        for (int f = 0; f < frames; f++) {
+            if (f > 0)
+                perturbFrame(frameIMG, height, f);
+
+            struct timespec start, mid, end;
+            clock_gettime(CLOCK_REALTIME, &start);
+            planExecute(plan, frameIMG, dctIMG, idctIMG);
+            clock_gettime(CLOCK_REALTIME, &mid);
+            seqProcess(seq, frameIMG);
+            clock_gettime(CLOCK_REALTIME, &end);
+
+            fullTime += (mid.tv_sec - start.tv_sec) + 
+                        (mid.tv_nsec - start.tv_nsec) / 1e9;
+            seqTime  += (end.tv_sec - mid.tv_sec) + 
+                        (end.tv_nsec - mid.tv_nsec) / 1e9;
+
+            if (validation == 0)
+                validation = imValidate(dctIMG, seq->dctIMG, 1e-12);
         }
+
+        uint64_t computed, skipped;
+        seqCounts(seq, &computed, &skipped);
+        printf("%7i %14.6f %14.6f %11.2f%% %9.2fx %12i\n", thread, fullTime,
+               seqTime, 100.0*skipped/(double)(computed + skipped),
+               (seqTime > 0.0? fullTime/seqTime:0.0), validation);
+
+        imDelete(frameIMG, dctIMG, idctIMG);
+        seqDestroy(seq);
+        planDestroy(plan);
     }
 }
 
 
 /*
-    Perform the DCT algorithm over an 8x8 block in the image starting 
-    at the point inIMG[i][j] and ending at inIMG[i+8][j+8]
+    Edit a square of a given side at a random spot of an image (within
+    its first 'height' rows) and return the rectangle that was edited
 */
-void imBlockDCT(image* inIMG, image* outIMG, int i, int j) {
-    double OOSQT = 1.0/sqrt(2.0);
-    double sum   = 0.0;
-    double HPW   = (double)16.0;
+dctRect editImage(image* im, int height, int side) {
+    dctRect rect = { 0, 0, (side < im->width? side:im->width), 
+                           (side < height? side:height) };
+    rect.x = rand() % (im->width - rect.width + 1);
+    rect.y = rand() % (height - rect.height + 1);
+
+    for (int x = rect.x; x < rect.x + rect.width; x++)
+        for (int y = rect.y; y < rect.y + rect.height; y++)
+            im->m[x][y].i = (double)(rand() % 255);
 
-    for (int u = 0; u < 8; u++) {
-        for (int v = 0; v < 8; v++) {
+    return rect;
+}
 
-            sum = 0.0;
-            for (int x = 0; x < 8; x++) {
-                for (int y = 0; y < 8; y++) {
-                    sum += (double)inIMG->m[i + x][j + y].i *
-                           cos(((2.0*(double)(x)+1.0) * (double)u * M_PI)/HPW) *
-                           cos(((2.0*(double)(y)+1.0) * (double)v * M_PI)/HPW);
-                }
+
+/*
+    Time re-transforming single edited squares of growing size with
+    planUpdate() against transforming the whole image again; the 
+    updated coefficients must match those of a full transform
+*/
+void runUpdateTest(int width, int height, int channels, const int* threads, int threadCount) {
+    int sides[]    = { 8, 64, 256, 1024 };
+    int sideCount  = sizeof(sides)/sizeof(sides[0]);
+    int iterations = 10;
+
+    printf("%7s %12s", "threads", "full (ms)");
+    for (int s = 0; s < sideCount; s++) {
+        char label[32];
+        snprintf(label, sizeof(label), "%ix%i (ms)", sides[s], sides[s]);
+        printf(" %16s", label);
+    }
+    printf(" %12s\n", "validation");
+
+    for (int t = 0; t < threadCount; t++) {
+        int thread = threads[t];
+        dctPlan* plan   = createPlan(thread, width, height);
+        image* srcIMG   = createSource(plan);
+        image* dctIMG   = planAllocateImage(plan, 0);
+        image* idctIMG  = planAllocateImage(plan, 0);
+        image* fullDCT  = planAllocateImage(plan, 0);
+        image* fullIDCT = planAllocateImage(plan, 0);
+        int validation  = 0;
+
+        // Transform once untimed, so that the pages are all mapped
+        planExecute(plan, srcIMG, dctIMG, idctIMG);
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_REALTIME, &start);
+        planExecute(plan, srcIMG, dctIMG, idctIMG);
+        clock_gettime(CLOCK_REALTIME, &end);
+        printf("%7i %12.4f", thread, ((end.tv_sec - start.tv_sec)*1e3 + 
+                                      (end.tv_nsec - start.tv_nsec)/1e6));
+
+        for (int s = 0; s < sideCount; s++) {
+            double total = 0.0;
+            for (int it = 0; it < iterations; it++) {
+                dctRect rect = editImage(srcIMG, height, sides[s]);
+
+                clock_gettime(CLOCK_REALTIME, &start);
+                planUpdate(plan, srcIMG, dctIMG, idctIMG, &rect, 1);
+                clock_gettime(CLOCK_REALTIME, &end);
+                total += (end.tv_sec - start.tv_sec)*1e3 + 
+                         (end.tv_nsec - start.tv_nsec)/1e6;
             }
-            outIMG->m[i + u][j + v].i = 0.25 
-                                        * (u == 0? OOSQT:1.0)
-                                        * (v == 0? OOSQT:1.0)
-                                        * sum;
+            printf(" %16.4f", total/iterations);
+
+            planExecute(plan, srcIMG, fullDCT, fullIDCT);
+            if (validation == 0)
+                validation = imValidate(dctIMG, fullDCT, 1e-12);
         }
+        printf(" %12i\n", validation);
+
+        imDelete(srcIMG, dctIMG, idctIMG);
+        imFree(fullDCT);
+        imFree(fullIDCT);
+        planDestroy(plan);
     }
 }
 
 
 /*
-    Perform the inverse DCT algorithm over an 8x8 block in the image
-    starting at the point inIMG[i][j] and ending at inIMG[i+8][j+8]
+    Get the average absolute difference between a scaled image and
+    the (scale x scale) box averages of the image it was scaled from
 */
-void imBlockIDCT(image* inIMG, image* outIMG, int i, int j) {
-    double OOSQT = 1.0/sqrt(2.0);
-    double sum   = 0.0;
-    double MPOL  = M_PI/(double)16.0;
+double scaledError(image* srcIMG, image* outIMG, int scale, int height) {
+    double error = 0.0;
+    int count    = 0;
+    for (int x = 0; x < outIMG->width; x++) {
+        for (int y = 0; y < height/scale; y++) {
+            double mean = 0.0;
+            for (int i = 0; i < scale; i++)
+                for (int j = 0; j < scale; j++)
+                    mean += srcIMG->m[x*scale + i][y*scale + j].i;
+
+            error += fabs(outIMG->m[x][y].i - mean/(scale*scale));
+            count++;
+        }
+    }
+    return (count? error/count:0.0);
+}
 
-    for (int x = 0; x < 8; x++) {
-        for (int y = 0; y < 8; y++) {
 
-            sum = 0.0;
-            for (int u = 0; u < 8; u++) {
-                for (int v = 0; v < 8; v++) {
-                    sum += inIMG->m[i + u][j + v].i * 
-                           (u == 0? OOSQT:1.0) * 
-                           (v == 0? OOSQT:1.0) *
-                           cos((2.0*(double)(x)+1.0) * (double)u * MPOL) *
-                           cos((2.0*(double)(y)+1.0) * (double)v * MPOL);
-                }
+/*
+    Time reconstructing the coefficients at full, 1/2, 1/4 and 1/8 of
+    each side, and of only the center quarter of the image, then print
+    how far each scale is from a box filtered source
+*/
+void runScaledTest(int width, int height, int channels, const int* threads, int threadCount) {
+    int scales[]   = { SCALE_FULL, SCALE_HALF, SCALE_QUARTER, SCALE_EIGHTH };
+    int scaleCount = sizeof(scales)/sizeof(scales[0]);
+    int iterations = 10;
+    double error[4];
+
+    printf("%7s", "threads");
+    for (int s = 0; s < scaleCount; s++) {
+        char label[32];
+        snprintf(label, sizeof(label), "1/%i (ms)", scales[s]);
+        printf(" %12s", label);
+    }
+    printf(" %14s\n", "ROI 1/1 (ms)");
+
+    for (int t = 0; t < threadCount; t++) {
+        int thread = threads[t];
+        dctPlan* plan  = createPlan(thread, width, height);
+        image* srcIMG  = createSource(plan);
+        image* dctIMG  = planAllocateImage(plan, 0);
+        image* idctIMG = planAllocateImage(plan, 0);
+        planForward(plan, srcIMG, dctIMG);
+
+        printf("%7i", thread);
+        for (int s = 0; s < scaleCount; s++) {
+            image* outIMG = allocateImage(width/scales[s], 
+                                          plan->paddedHeight/scales[s], channels);
+
+            struct timespec start, end;
+            double total = 0.0;
+            for (int it = 0; it <= iterations; it++) {
+                clock_gettime(CLOCK_REALTIME, &start);
+                planInverseScaled(plan, dctIMG, outIMG, scales[s], NULL);
+                clock_gettime(CLOCK_REALTIME, &end);
+
+                // The first (untimed) pass maps the output's pages
+                if (it > 0)
+                    total += (end.tv_sec - start.tv_sec)*1e3 + 
+                             (end.tv_nsec - start.tv_nsec)/1e6;
             }
-            outIMG->m[i + x][j + y].i = sum * 0.25;
+            printf(" %12.4f", total/iterations);
+
+            error[s] = scaledError(srcIMG, outIMG, scales[s], height);
+            imFree(outIMG);
         }
+
+        dctRect roi = { width/4, height/4, width/2, height/2 };
+        struct timespec start, end;
+        clock_gettime(CLOCK_REALTIME, &start);
+        planInverseScaled(plan, dctIMG, idctIMG, SCALE_FULL, &roi);
+        clock_gettime(CLOCK_REALTIME, &end);
+        printf(" %14.4f\n", (end.tv_sec - start.tv_sec)*1e3 + 
+                            (end.tv_nsec - start.tv_nsec)/1e6);
+
+        imDelete(srcIMG, dctIMG, idctIMG);
+        planDestroy(plan);
     }
+
+    printf("\nAverage difference from a box filtered source:\n");
+    for (int s = 0; s < scaleCount; s++)
+        printf("    1/%i: %.6e\n", scales[s], error[s]);
 }
 
 
 /*
-    Perform the DCT algorithm over an entire image; 
-    
-    This loses accuracy over larger and larger image sizes 
-    past an 8x8 
-*/
-void imDCT(image* inIMG, image* outIMG) {
-    double OOSQT = 1.0/sqrt(2.0);
-    double sum   = 0.0;
-    double HPW   = (double)(inIMG->height + inIMG->width);
-
-    for (int u = 0; u < inIMG->width; u++) {
-        for (int v = 0; v < inIMG->height; v++) {
-
-            sum = 0.0;
-            for (int x = 0; x < inIMG->width; x++) {
-                for (int y = 0; y < inIMG->height; y++) {
-                    sum += (double)inIMG->m[x][y].i *
-                           cos(((2.0*(double)x+1.0) * (double)u*M_PI)/HPW) *
-                           cos(((2.0*(double)y+1.0) * (double)v*M_PI)/HPW);
-                }
+    Return the seconds since 'start'
+*/
+double secondsSince(struct timespec* start) {
+    struct timespec end;
+    clock_gettime(CLOCK_REALTIME, &end);
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+
+/*
+    Create a fresh directory for the files of a test under $TMPDIR (or
+    /tmp) and write its path to 'dir'; returns -1 if it can't
+*/
+int tempDirectory(char* dir, size_t size) {
+    const char* base = getenv("TMPDIR");
+    if (base == NULL || base[0] == '\0')
+        base = "/tmp";
+
+    if (snprintf(dir, size, "%s/tcdct-XXXXXX", base) >= (int)size)
+        return -1;
+
+    return (mkdtemp(dir) == NULL? -1:0);
+}
+
+
+/*
+    Write the coefficients of a random image to a coefficient file (in
+    a temporary directory) and read them back, both raw and compressed,
+    reporting the throughput, size and single strip latency of each;
+    the coefficients read back must match those written exactly
+*/
+void runCoefTest(int width, int height, int channels, const int* threads, int threadCount) {
+    int compressions[]  = { COEF_RAW, COEF_DEFLATE };
+    const char* names[] = { "raw", "deflate" };
+    char dir[4096], fileName[4096 + 16];
+    struct timespec start;
+
+    if (tempDirectory(dir, sizeof(dir)) != 0) {
+        perror("Unable to create a temporary directory");
+        return;
+    }
+    snprintf(fileName, sizeof(fileName), "%s/dctIMG.tcc", dir);
+
+    printf("%7s %8s %12s %13s %13s %10s %15s %12s\n", "threads", "format",
+           "size (MB)", "write (MB/s)", "read (MB/s)", "ratio", "strip (us)",
+           "validation");
+
+    for (int t = 0; t < threadCount; t++) {
+        int thread = threads[t];
+        dctPlan* plan  = createPlan(thread, width, height);
+        image* srcIMG  = createSource(plan);
+        image* dctIMG  = planAllocateImage(plan, 0);
+        image* readIMG = planAllocateImage(plan, 0);
+        planForward(plan, srcIMG, dctIMG);
+
+        double rawMB = (double)width*plan->paddedHeight*sizeof(double)/1e6;
+        for (int c = 0; c < 2; c++) {
+            clock_gettime(CLOCK_REALTIME, &start);
+            if (coefWrite(dctIMG, plan->blockSize, compressions[c], 
+                          plan->pool, fileName) != 0) {
+                printf("%7i %8s %12s\n", thread, names[c], "unavailable");
+                continue;
             }
-            outIMG->m[u][v].i = 1.0/((double)inIMG->height/2.0) *
-                                (!u? OOSQT:1.0)*(!v? OOSQT:1.0) *
-                                sum;
+            double writeTime = secondsSince(&start);
+
+            clock_gettime(CLOCK_REALTIME, &start);
+            coefFile* cf   = coefOpen(fileName);
+            int validation = (cf == NULL? -1:coefRead(cf, readIMG, plan->pool));
+            double readTime = secondsSince(&start);
+
+            if (validation == 0)
+                validation = imValidate(dctIMG, readIMG, 0.0);
+
+            // Decode a single strip from the middle of the file
+            double stripTime = 0.0;
+            if (cf != NULL) {
+                double* strip = (double*)malloc(cf->index[0].rawSize);
+                clock_gettime(CLOCK_REALTIME, &start);
+                coefReadStrip(cf, cf->header->stripCount/2, strip);
+                stripTime = secondsSince(&start);
+                free(strip);
+            }
+
+            printf("%7i %8s %12.3f %13.1f %13.1f %10.2f %15.2f %12i\n", thread,
+                   names[c], (cf? cf->size/1e6:0.0), rawMB/writeTime, 
+                   rawMB/readTime, (cf? rawMB*1e6/cf->size:0.0), 
+                   stripTime*1e6, validation);
+
+            if (cf != NULL)
+                coefClose(cf);
         }
+
+        unlink(fileName);
+        imDelete(srcIMG, dctIMG, readIMG);
+        planDestroy(plan);
     }
+
+    rmdir(dir);
 }
 
 
 /*
-    Perform the inverse DCT algorithm over an entire image; 
-    
-    This loses accuracy over larger and larger image sizes 
-    past an 8x8 
-*/
-void imIDCT(image* inIMG, image* outIMG) {
-    double OOSQT = 1.0/sqrt(2.0);
-    double sum   = 0.0;
-    double HPW  = (double)(inIMG->height + inIMG->width);
-    double MPOL  = M_PI/(double)(HPW);
-
-    for (int x = 0; x < inIMG->width; x++) {
-        for (int y = 0; y < inIMG->height; y++) {
-
-            sum = 0.0;
-            for (int u = 0; u < inIMG->width; u++) {
-                for (int v = 0; v < inIMG->height; v++) {
-                    sum += inIMG->m[u][v].i * 
-                           (!u? OOSQT:1.0) * 
-                           (!v? OOSQT:1.0) *
-                           cos((2.0*(double)x+1.0) * (double)u*MPOL) *
-                           cos((2.0*(double)y+1.0) * (double)v*MPOL);
+    Time generating every kind of content over the workers of a plan,
+    checking that the image doesn't depend on the amount of threads
+*/
+void runGenerateTest(int width, int height, const int* threads, int threadCount) {
+    const char* names[] = { "noise", "gradient", "natural", "text" };
+    int modes           = (int)(sizeof(names)/sizeof(names[0]));
+    image* reference[modes];
+
+    printf("%7s", "threads");
+    for (int m = 0; m < modes; m++) {
+        char label[32];
+        snprintf(label, sizeof(label), "%s (MP/s)", names[m]);
+        printf(" %18s", label);
+    }
+    printf(" %12s\n", "validation");
+
+    for (int t = 0; t < threadCount; t++) {
+        int thread = threads[t];
+        dctPlan* plan  = createPlan(thread, width, height);
+        int validation = 0;
+
+        printf("%7i", thread);
+        for (int m = 0; m < modes; m++) {
+            image* im = planAllocateImage(plan, 0);
+            imGenerate(im, height, contentSeed, m, plan->pool);
+
+            struct timespec start;
+            clock_gettime(CLOCK_REALTIME, &start);
+            imGenerate(im, height, contentSeed, m, plan->pool);
+            printf(" %18.1f", width*(double)height/1e6/secondsSince(&start));
+
+            if (t == 0)
+                reference[m] = im;
+
+            else {
+                if (validation == 0)
+                    validation = imValidate(reference[m], im, 0.0);
+                imFree(im);
+            }
+        }
+        printf(" %12i\n", validation);
+        planDestroy(plan);
+    }
+
+    for (int m = 0; m < modes; m++)
+        imFree(reference[m]);
+}
+
+
+/*
+    Run the same tests with every traversal order, with and without
+    prefetching the next block, reporting the averaged time and cache
+    counters of each
+*/
+void runTraversalTest(int width, int height, int channels, const int* threads, int threadCount) {
+    int iterations = 5;
+    perfEvents     = perfCacheEvents;
+    perfEventCount = perfCacheEventCount;
+
+    // Check which events this host can count at all
+    perfCounters probe;
+    perfOpen(&probe, perfEvents, perfEventCount);
+
+    printf("%7s %10s %9s %12s", "threads", "traversal", "prefetch", "time (s)");
+    for (int e = 0; e < perfEventCount; e++)
+        printf(" %18s", perfEvents[e].name);
+    printf("\n");
+
+    for (int t = 0; t < threadCount; t++) {
+        int thread = threads[t];
+        dctPlan* plan = createPlan(thread, width, height);
+
+        for (int t = TRAVERSE_ROW; t <= TRAVERSE_MORTON; t++) {
+            for (int prefetch = 0; prefetch <= 1; prefetch++) {
+                long double time_AVG = (long double)0;
+                long double counter_AVG[PERF_MAX_EVENTS] = {0};
+
+                planSetTraversal(plan, t, prefetch);
+                for (int it = 0; it < iterations; it++) {
+                    testResults* result = runTest(plan, channels);
+                    time_AVG += (long double)result->time_spent;
+                    for (int e = 0; e < perfEventCount; e++)
+                        counter_AVG[e] += (long double)result->counters[e];
+
+                    free(result);
+                }
+
+                printf("%7i %10s %9s %12.6Lf", thread, planTraversalName(t), 
+                       (prefetch? "yes":"no"), time_AVG/iterations);
+                for (int e = 0; e < perfEventCount; e++) {
+                    if (probe.fd[e] < 0)
+                        printf(" %18s", "n/a");
+
+                    else
+                        printf(" %18.0Lf", counter_AVG[e]/iterations);
                 }
+                printf("\n");
             }
-            outIMG->m[x][y].i = sum/((double)inIMG->height/2.0);
         }
+        planDestroy(plan);
     }
+
+    perfClose(&probe);
+    perfEvents     = NULL;
+    perfEventCount = 0;
+}
+
+
+// Jobs each submitter of runAsyncTest() keeps in flight at most
+#define ASYNC_INFLIGHT 4
+
+// Async request structure definition
+// --------------------------
+//
+// submitted : When the job was submitted
+// latency   : Milliseconds from submission to the job's callback
+//
+typedef struct {
+    struct timespec submitted;
+    double latency;
+} asyncRequest;
+
+// Async submitter structure definition
+// --------------------------
+//
+// plan     : Plan every job is submitted to
+// jobs     : Amount of jobs to submit
+// requests : Timing of each job
+//
+typedef struct {
+    dctPlan* plan;
+    int jobs;
+    asyncRequest* requests;
+} asyncSubmitter;
+
+
+void asyncDone(dctJob* job, void* arg) {
+    asyncRequest* request = (asyncRequest*)arg;
+    request->latency      = secondsSince(&request->submitted)*1e3;
 }
 
 
 /*
-    Print an image to STDOUT
+    Submit a submitter's jobs without waiting on them, only holding
+    back when ASYNC_INFLIGHT of its own jobs are still running
 */
-void imPrint(image* im) {
+void* asyncSubmit(void* arg) {
+    asyncSubmitter* sub = (asyncSubmitter*)arg;
+    dctPlan* plan       = sub->plan;
+    image* srcIMG       = createSource(plan);
+    image* dctIMG[ASYNC_INFLIGHT];
+    image* idctIMG[ASYNC_INFLIGHT];
+    dctJob* handles[ASYNC_INFLIGHT] = {NULL};
+
+    for (int k = 0; k < ASYNC_INFLIGHT; k++) {
+        dctIMG[k]  = planAllocateImage(plan, 0);
+        idctIMG[k] = planAllocateImage(plan, 0);
+    }
 
-    // If input image is a grayscale image
-    if (im->channels == 1) {
-        for (int y = 0; y < im->height; y++) {
-            for (int x = 0; x < im->width; x++) {
+    for (int j = 0; j < sub->jobs; j++) {
+        int slot = j % ASYNC_INFLIGHT;
+        if (handles[slot] != NULL)
+            planJobRelease(handles[slot]);
+
+        clock_gettime(CLOCK_REALTIME, &sub->requests[j].submitted);
+        handles[slot] = planSubmit(plan, srcIMG, dctIMG[slot], idctIMG[slot], 
+                                   PLAN_FORWARD | PLAN_INVERSE, asyncDone, 
+                                   &sub->requests[j]);
+    }
+
+    for (int k = 0; k < ASYNC_INFLIGHT; k++) {
+        if (handles[k] != NULL)
+            planJobRelease(handles[k]);
+
+        imFree(dctIMG[k]);
+        imFree(idctIMG[k]);
+    }
+    imFree(srcIMG);
+    return NULL;
+}
+
+
+int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
 
-                // NOTE: This should be a %X.Yf, where
-                //       X = Y+5 for spacing values and 
-                //       the sign of the values neatly
-                //
-                printf("[%8.3f] ", im->m[x][y].i);
+
+/*
+    Have 1, 2, 4 and 8 threads submit transforms of quarter sized 
+    images to one plan at the same time, reporting the throughput and
+    the latency percentiles from submission to completion
+*/
+void runAsyncTest(int width, int height, const int* threads, int threadCount) {
+    int submitterCounts[] = { 1, 2, 4, 8 };
+    int jobs              = 32;
+
+    // Requests are quarter sized, rounded down to whole blocks
+    width  = (width/4 >= 8? width/4/8*8:8);
+    height = (height/4 >= 1? height/4:1);
+
+    printf("Request size: %ix%i\n\n", width, height);
+    printf("%7s %11s %12s %10s %10s %10s\n", "threads", "submitters",
+           "jobs/s", "p50 (ms)", "p95 (ms)", "max (ms)");
+
+    for (int t = 0; t < threadCount; t++) {
+        int thread = threads[t];
+        dctPlan* plan = createPlan(thread, width, height);
+
+        for (int c = 0; c < 4; c++) {
+            int submitters          = submitterCounts[c];
+            pthread_t tid[submitters];
+            asyncSubmitter sub[submitters];
+            asyncRequest* requests  = (asyncRequest*)calloc(submitters*jobs, 
+                                                            sizeof(asyncRequest));
+
+            struct timespec start;
+            clock_gettime(CLOCK_REALTIME, &start);
+            for (int i = 0; i < submitters; i++) {
+                sub[i].plan     = plan;
+                sub[i].jobs     = jobs;
+                sub[i].requests = &requests[i*jobs];
+                pthread_create(&tid[i], NULL, asyncSubmit, &sub[i]);
             }
-            printf("\n");
+
+            for (int i = 0; i < submitters; i++)
+                pthread_join(tid[i], NULL);
+            double elapsed = secondsSince(&start);
+
+            int total          = submitters*jobs;
+            double latency[total];
+            for (int i = 0; i < total; i++)
+                latency[i] = requests[i].latency;
+            qsort(latency, total, sizeof(double), compareDoubles);
+
+            printf("%7i %11i %12.1f %10.3f %10.3f %10.3f\n", thread, submitters,
+                   total/elapsed, latency[total/2], latency[total*95/100],
+                   latency[total - 1]);
+            free(requests);
         }
+        planDestroy(plan);
+    }
+}
+
+
+/*
+    Transform an image on 1 to 8 worker processes forked on this host,
+    connected over a Unix socket (or the "unix:" or "tcp:" address in
+    'TCDCT_DISTRIBUTE'), reporting the scaling against one worker and
+    against a single threaded plan in this process; the stitched 
+    coefficients must match the local ones
+*/
+void runDistributeTest(int width, int height) {
+    int tileSize   = 256, iterations = 5;
+    char address[128];
+    char* setting  = getenv("TCDCT_DISTRIBUTE");
+
+    if (strncmp(setting, "unix:", 5) == 0 || strncmp(setting, "tcp:", 4) == 0)
+        snprintf(address, sizeof(address), "%s", setting);
+
+    else
+        snprintf(address, sizeof(address), "unix:/tmp/tcdct-%i.sock", (int)getpid());
+
+    // The local reference, with its workers gone before forking
+    dctPlan* plan  = createPlan(1, width, height);
+    image* srcIMG  = createSource(plan);
+    image* dctIMG  = planAllocateImage(plan, 0);
+    image* idctIMG = planAllocateImage(plan, 0);
+    image* netDCT  = planAllocateImage(plan, 0);
+    image* netIDCT = planAllocateImage(plan, 0);
+
+    struct timespec start;
+    planExecute(plan, srcIMG, dctIMG, idctIMG);
+    clock_gettime(CLOCK_REALTIME, &start);
+    for (int it = 0; it < iterations; it++)
+        planExecute(plan, srcIMG, dctIMG, idctIMG);
+    double localTime = secondsSince(&start)/iterations;
+    planDestroy(plan);
+
+    printf("Address: %s\nTile size: %i\nLocal (1 thread): %.6f s\n\n", 
+           address, tileSize, localTime);
+    printf("%7s %12s %14s %12s %12s\n", "workers", "time (s)", 
+           "vs 1 worker", "vs local", "validation");
+
+    int listenFD = netListen(address);
+    if (listenFD < 0) {
+        printf("Unable to listen on '%s'\n", address);
+        return;
     }
 
-    // Else the input is a RGB image
-    else {
-        for (int y = 0; y < im->height; y++) {
-            for (int x = 0; x < im->width; x++) {
-                printf("[%3f,%3f,%3f]\t", 
-                             im->m[x][y].r,
-                             im->m[x][y].g,
-                             im->m[x][y].b);
+    double oneWorker = 0.0;
+    for (int workers = 1; workers <= 8; workers++) {
+        int fds[NET_MAX_WORKERS];
+        pid_t pids[NET_MAX_WORKERS];
+
+        for (int w = 0; w < workers; w++) {
+            pids[w] = fork();
+            if (pids[w] == 0) {
+                close(listenFD);
+                int fd = netConnect(address);
+                _exit(fd < 0 || netServe(fd, 1) < 0);
             }
-            printf("\n");
         }
+
+        int validation = netAccept(listenFD, fds, workers);
+        double elapsed = 0.0;
+        if (validation == 0) {
+            netDistribute(fds, workers, srcIMG, netDCT, netIDCT, 8, tileSize, 
+                          PLAN_FORWARD | PLAN_INVERSE);
+
+            clock_gettime(CLOCK_REALTIME, &start);
+            for (int it = 0; it < iterations && validation == 0; it++)
+                validation = netDistribute(fds, workers, srcIMG, netDCT, netIDCT, 
+                                           8, tileSize, PLAN_FORWARD | PLAN_INVERSE);
+            elapsed = secondsSince(&start)/iterations;
+
+            if (validation == 0)
+                validation = imValidate(dctIMG, netDCT, 1e-12);
+            if (validation == 0)
+                validation = imValidate(idctIMG, netIDCT, 1e-12);
+        }
+
+        netShutdown(fds, workers);
+        for (int w = 0; w < workers; w++)
+            waitpid(pids[w], NULL, 0);
+
+        if (workers == 1)
+            oneWorker = elapsed;
+
+        printf("%7i %12.6f %13.2fx %11.2fx %12i\n", workers, elapsed,
+               (elapsed > 0.0? oneWorker/elapsed:0.0),
+               (elapsed > 0.0? localTime/elapsed:0.0), validation);
     }
+
+    close(listenFD);
+    if (strncmp(address, "unix:", 5) == 0)
+        unlink(address + 5);
+
+    imDelete(srcIMG, dctIMG, idctIMG);
+    imFree(netDCT);
+    imFree(netIDCT);
 }
 
 
 /*
-    Get the amount of average error per ELEMENT of two images;
+    Run the same tests on images of 2560x1440 and larger allocated
+    per column, as a single plane, and as a plane with transparent or
+    reserved huge pages, reporting the averaged time and cache counters
+    of each along with the pages each allocation actually got;
 
-    This is helpful in illustrating the percision of doubles
-    as you +/- the percision in imValidate()
+    Every block row sweeps across all columns, so with 4k pages each
+    column of the row is another page (and another dTLB entry)
 */
-double imERR1(image* imA, image* imB) {
-    
-    double avg_err = 0.0;
-    for (int y = 0; y < imA->height; y++) {
-        for (int x = 0; x < imA->width; x++) {
+void runHugePageTest(int channels, const int* threads, int threadCount) {
+    int iterations   = 3;
+    int sizes[][2]   = { {2560, 1440}, {3840, 2160}, {5120, 2880} };
+    int layouts[]    = { IM_ALLOC_COLUMNS, 0, IM_ALLOC_THP, IM_ALLOC_HUGETLB };
+    char* names[]    = { "columns", "plane", "thp", "hugetlb" };
+    perfEvents       = perfCacheEvents;
+    perfEventCount   = perfCacheEventCount;
+
+    // Keep the page faults (and huge page zeroing) out of the timings
+    firstTouch       = 1;
+
+    // Check which events this host can count at all
+    perfCounters probe;
+    perfOpen(&probe, perfEvents, perfEventCount);
+
+    printf("%10s %7s %8s %8s %12s", "size", "threads", "layout", "pages", "time (s)");
+    for (int e = 0; e < perfEventCount; e++)
+        printf(" %18s", perfEvents[e].name);
+    printf("\n");
+
+    for (int s = 0; s < (int)(sizeof(sizes)/sizeof(sizes[0])); s++) {
+        char size[32];
+        snprintf(size, sizeof(size), "%ix%i", sizes[s][0], sizes[s][1]);
+
+        for (int t = 0; t < threadCount; t++) {
+            dctPlan* plan = createPlan(threads[t], sizes[s][0], sizes[s][1]);
+
+            for (int l = 0; l < (int)(sizeof(layouts)/sizeof(int)); l++) {
+                long double time_AVG = (long double)0;
+                long double counter_AVG[PERF_MAX_EVENTS] = {0};
+
+                // See which pages this layout ends up with on this host
+                allocFlags   = layouts[l];
+                image* pages = planAllocateImage(plan, allocFlags);
+                int kind     = (pages->plane == NULL? -1:pages->pages);
+                imFree(pages);
+
+                for (int it = 0; it < iterations; it++) {
+                    testResults* result = runTest(plan, channels);
+                    time_AVG += (long double)result->time_spent;
+                    for (int e = 0; e < perfEventCount; e++)
+                        counter_AVG[e] += (long double)result->counters[e];
+
+                    free(result);
+                }
 
-            // In the case of either being zero you get really bad
-            // values, and I'm not sure what else to do but skip it
-            if (imA->m[x][y].i == 0.0 || imB->m[x][y].i == 0.0)
-                continue;
+                printf("%10s %7i %8s %8s %12.6Lf", size, threads[t], names[l],
+                       (kind < 0? "4k":imPagesName(kind)), time_AVG/iterations);
+                for (int e = 0; e < perfEventCount; e++) {
+                    if (probe.fd[e] < 0)
+                        printf(" %18s", "n/a");
 
-            avg_err += fabs(imB->m[x][y].i - imA->m[x][y].i)/imA->m[x][y].i;
+                    else
+                        printf(" %18.0Lf", counter_AVG[e]/iterations);
+                }
+                printf("\n");
+            }
+            planDestroy(plan);
         }
     }
-    return avg_err;
+
+    perfClose(&probe);
+    perfEvents     = NULL;
+    perfEventCount = 0;
+    allocFlags     = 0;
+    firstTouch     = 0;
 }
 
 
 /*
-    Get the amount of average error over the entirety of two images
+    Print the core event counts of a run (or their averages), followed
+    by the cycles per block and instructions per cycle; events the
+    probe couldn't open are printed as n/a
 */
-double imERR2(image* imA, image* imB) {
-    double total_A = 0.0;
-    double total_B = 0.0;
-    for (int y = 0; y < imA->height; y++) {
-        for (int x = 0; x < imA->width; x++) {
-            total_A += (double)fabs(imA->m[x][y].i);
-            total_B += (double)fabs(imB->m[x][y].i);
+void printCounters(perfCounters* probe, long double* counters, long double blocks,
+                   const char* prefix) {
+    char label[64];
+    for (int e = 0; e < perfEventCount; e++) {
+        snprintf(label, sizeof(label), "%s%s", prefix, perfEvents[e].name);
+        if (probe->fd[e] < 0)
+            printf("%28s: n/a\n", label);
+
+        else
+            printf("%28s: %.0Lf\n", label, counters[e]);
+    }
+
+    long double cycles = counters[PERF_CORE_CYCLES];
+    if (probe->fd[PERF_CORE_CYCLES] < 0 || cycles <= 0) {
+        printf("%28s: n/a\n%28s: n/a\n", "Cycles per block", "IPC");
+        return;
+    }
+
+    printf("%28s: %.2Lf\n", "Cycles per block", cycles/blocks);
+    if (probe->fd[PERF_CORE_INSTRUCTIONS] < 0)
+        printf("%28s: n/a\n", "IPC");
+
+    else
+        printf("%28s: %.3Lf\n", "IPC", counters[PERF_CORE_INSTRUCTIONS]/cycles);
+}
+
+
+/*
+    Print how to run the harness
+*/
+void printUsage(char* name) {
+    printf("Usage: %s [options]\n\n"
+           "  -i, --input FILE      Read the source from a P2 PGM file\n"
+           "  -s, --size WxH,...    Synthetic image sizes, or qvga, vga, hd,\n"
+           "                        wqhd and uhd (default: wqhd)\n"
+           "  -t, --threads N,...   Amounts of threads, each a number, a\n"
+           "                        range like 1-10, or auto for the tuned\n"
+           "                        configuration (default: 1-10)\n"
+           "  -k, --kernel K,...    Kernels: naive, separable, avx2, batch\n"
+           "                        or measure (default: the plan's pick\n"
+           "                        or TCDCT_KERNEL)\n"
+           "  -p, --precision P,... double or float (default: double)\n"
+           "  -b, --block N,...     Block sizes, 2 to %i (default: 8)\n"
+           "  -n, --iterations N    Runs averaged per combination (default: 25)\n"
+           "  -o, --output PREFIX   Write the images of the last run to\n"
+           "                        PREFIXsrcIMG.pgm, PREFIXdctIMG.pgm, ...\n"
+           "  -q, --quiet           Only print the averages\n"
+           "  -c, --csv             Print one CSV line per combination\n"
+           "  -e, --counters        Count cycles, instructions, cache, dTLB\n"
+           "                        and branch misses of every worker\n"
+           "  -h, --help            Print this and exit\n\n"
+           "The TCDCT_* variables still select the other test modes, which\n"
+           "run on the first size given and every amount of threads.\n", 
+           name, PLAN_MAX_BLOCK);
+}
+
+
+/*
+    Parse a list of comma separated values of an option into 'list',
+    calling 'parse' on every value (which returns -1 when invalid);
+
+    Returns the amount of values, exiting on an invalid one
+*/
+static int parseList(char* arg, char* option, void* list, 
+                     int (*parse)(char* value, void* list, int count)) {
+    char* copy  = strdup(arg);
+    char* saved = NULL;
+    int count   = 0;
+    for (char* v = strtok_r(copy, ",", &saved); v != NULL; 
+         v = strtok_r(NULL, ",", &saved)) {
+        int added = parse(v, list, count);
+        if (added < 0) {
+            printf("Invalid value '%s' for %s\n", v, option);
+            exit(1);
         }
+        count += added;
+    }
+    free(copy);
+
+    if (count == 0) {
+        printf("No values given for %s\n", option);
+        exit(1);
     }
-    return (100.0 * fabs(total_B - total_A)/total_A);
+    return count;
+}
+
+
+// Parse a single value (see parseList()), returning how many were added
+static int parseSize(char* v, void* list, int count) {
+    static const struct { char* name; int width, height; } named[] = {
+        { "qvga", 320, 240 }, { "vga", 640, 480 }, { "hd", 1280, 720 },
+        { "wqhd", 2560, 1440 }, { "uhd", 3840, 2160 },
+    };
+    int (*sizes)[2] = (int(*)[2])list;
+    if (count == CLI_MAX_LIST)
+        return -1;
+
+    for (int n = 0; n < (int)(sizeof(named)/sizeof(named[0])); n++) {
+        if (strcmp(v, named[n].name) == 0) {
+            sizes[count][0] = named[n].width, sizes[count][1] = named[n].height;
+            return 1;
+        }
+    }
+
+    char end;
+    if (sscanf(v, "%ix%i%c", &sizes[count][0], &sizes[count][1], &end) != 2 ||
+        sizes[count][0] < 1 || sizes[count][1] < 1)
+        return -1;
+
+    return 1;
+}
+
+static int parseThreads(char* v, void* list, int count) {
+    int* threads = (int*)list;
+    int first, last;
+    char end;
+
+    // The tuned amount (and configuration), see createPlan()
+    if (strcmp(v, "auto") == 0) {
+        if (count + 1 > CLI_MAX_LIST)
+            return -1;
+
+        threads[count] = 0;
+        return 1;
+    }
+
+    if (sscanf(v, "%i-%i%c", &first, &last, &end) != 2) {
+        if (sscanf(v, "%i%c", &first, &end) != 1)
+            return -1;
+        last = first;
+    }
+
+    if (first < 1 || last < first || count + (last - first + 1) > CLI_MAX_LIST)
+        return -1;
+
+    for (int t = first; t <= last; t++)
+        threads[count++] = t;
+
+    return last - first + 1;
+}
+
+static int parseBlock(char* v, void* list, int count) {
+    int* blocks = (int*)list;
+    char end;
+    if (count == CLI_MAX_LIST || sscanf(v, "%i%c", &blocks[count], &end) != 1 ||
+        blocks[count] < 2 || blocks[count] > PLAN_MAX_BLOCK)
+        return -1;
+
+    return 1;
+}
+
+static int parsePrecision(char* v, void* list, int count) {
+    int* precisions = (int*)list;
+    if (count == CLI_MAX_LIST)
+        return -1;
+
+    if (strcmp(v, "double") == 0)
+        precisions[count] = PLAN_DOUBLE;
+
+    else if (strcmp(v, "float") == 0)
+        precisions[count] = PLAN_FLOAT;
+
+    else
+        return -1;
+
+    return 1;
+}
+
+static int parseKernel(char* v, void* list, int count) {
+    char** kernels = (char**)list;
+    if (count == CLI_MAX_LIST || 
+        (strcmp(v, "measure") != 0 && planKernelFromName(v) < 0))
+        return -1;
+
+    kernels[count] = strdup(v);
+    return 1;
 }
 
 
 /*
-    Get the mean-squared-error of two images
+    Parse the command line into the options of a run, filling in the
+    defaults for anything not given; exits on invalid options
 */
-long double imMSE(image* imA, image* imB) {
-    image* imC = allocateImage(imA->width, 
-                               imA->height, 
-                               imA->channels);
+void parseOptions(cliOptions* opt, int argc, char* argv[]) {
+    static const struct option longOptions[] = {
+        { "input",      required_argument, NULL, 'i' },
+        { "size",       required_argument, NULL, 's' },
+        { "threads",    required_argument, NULL, 't' },
+        { "kernel",     required_argument, NULL, 'k' },
+        { "precision",  required_argument, NULL, 'p' },
+        { "block",      required_argument, NULL, 'b' },
+        { "iterations", required_argument, NULL, 'n' },
+        { "output",     required_argument, NULL, 'o' },
+        { "quiet",      no_argument,       NULL, 'q' },
+        { "csv",        no_argument,       NULL, 'c' },
+        { "counters",   no_argument,       NULL, 'e' },
+        { "help",       no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    memset(opt, 0, sizeof(cliOptions));
+    opt->iterations = 25;
+
+    int c;
+    char end;
+    while ((c = getopt_long(argc, argv, "i:s:t:k:p:b:n:o:qceh", 
+                            longOptions, NULL)) != -1) {
+        switch (c) {
+            case 'i': opt->input = optarg; break;
+            case 'o': opt->output = optarg; break;
+            case 'q': opt->quiet = 1; break;
+            case 'c': opt->csv = opt->quiet = 1; break;
+            case 'e': opt->counters = 1; break;
+            case 's': opt->sizeCount = parseList(optarg, "--size", 
+                                                 opt->sizes, parseSize); break;
+            case 't': opt->threadCount = parseList(optarg, "--threads", 
+                                                   opt->threads, parseThreads); break;
+            case 'k': opt->kernelCount = parseList(optarg, "--kernel", 
+                                                   opt->kernels, parseKernel); break;
+            case 'p': opt->precisionCount = parseList(optarg, "--precision", 
+                                                      opt->precisions, parsePrecision); break;
+            case 'b': opt->blockCount = parseList(optarg, "--block", 
+                                                  opt->blocks, parseBlock); break;
+            case 'n':
+                if (sscanf(optarg, "%i%c", &opt->iterations, &end) != 1 || 
+                    opt->iterations < 1) {
+                    printf("Invalid value '%s' for --iterations\n", optarg);
+                    exit(1);
+                }
+                break;
+
+            case 'h':
+                printUsage(argv[0]);
+                exit(0);
 
-    long double MSE = (long double)0.0;
-    for (int y = 0; y < imA->height; y++) {
-        for (int x = 0; x < imA->width; x++) {
-            MSE += pow((long double)(imB->m[x][y].i - imA->m[x][y].i), 
-                                                    (long double)2.0);
+            default:
+                printUsage(argv[0]);
+                exit(1);
         }
     }
-    return (MSE / (long double)(imA->height * imA->width));
+
+    if (optind < argc) {
+        printf("Unexpected argument '%s'\n", argv[optind]);
+        printUsage(argv[0]);
+        exit(1);
+    }
+
+    // Defaults of the lists that weren't given
+    if (opt->sizeCount == 0)
+        opt->sizes[0][0] = 2560, opt->sizes[0][1] = 1440, opt->sizeCount = 1;
+
+    if (opt->threadCount == 0)
+        opt->threadCount = parseList("1-10", "--threads", opt->threads, parseThreads);
+
+    if (opt->blockCount == 0)
+        opt->blocks[0] = 8, opt->blockCount = 1;
+
+    if (opt->precisionCount == 0)
+        opt->precisions[0] = PLAN_DOUBLE, opt->precisionCount = 1;
 }
 
 
 /*
-    Check wether two images are the same given a 
-    particular amount of precision
+    Time transforms of a source with and without deduplication on a
+    plan, reporting the flat blocks and cache hits of one pass from
+    empty caches, and the time saved; the caches are emptied before
+    every timed run, so no run reuses the blocks of the one before
 */
-int imValidate(image* imA, image* imB, double threshold) {
-    if (imA->height != imB->height)
-        return -7;
+void runDedupContent(const char* name, image* source, int thread) {
+    int iterations  = 5;
+    dctPlan* plan   = createPlan(thread, source->width, source->height);
+    image* srcIMG   = planAllocateImage(plan, 0);
+    image* dctIMG   = planAllocateImage(plan, 0);
+    image* idctIMG  = planAllocateImage(plan, 0);
+    for (int x = 0; x < source->width; x++)
+        memcpy(srcIMG->m[x], source->m[x], source->height*sizeof(pixel));
+
+    double times[2] = { 0.0, 0.0 };
+    dctCacheStats stats;
+    int validation = 0;
+    for (int dedup = 0; dedup <= 1; dedup++) {
+        planSetDedup(plan, dedup);
+        planCacheClear(plan);
+        planCacheStats(plan, &stats, 1);
+        planExecute(plan, srcIMG, dctIMG, idctIMG);
+        planCacheStats(plan, &stats, 1);
+
+        // Keep the fastest run, as the differences can be small
+        for (int it = 0; it < iterations; it++) {
+            struct timespec start;
+            planCacheClear(plan);
+            clock_gettime(CLOCK_REALTIME, &start);
+            planExecute(plan, srcIMG, dctIMG, idctIMG);
+
+            double seconds = secondsSince(&start);
+            if (it == 0 || seconds < times[dedup])
+                times[dedup] = seconds;
+        }
 
-    if (imA->width != imB->width)
-        return -6;
+        if (validation == 0)
+            validation = imValidate(srcIMG, idctIMG, 1e-12);
+    }
 
-    if (imA->channels != imB->channels)
-        return -5;
-    
-    // If input image is a grayscale image
-    if (imA->channels == 1) {
-        for (int y = 0; y < imA->height; y++) {
-            for (int x = 0; x < imA->width; x++) {
-                if (fabs(imA->m[x][y].i - imB->m[x][y].i) >= threshold) {
-                        printf("INVALID POINT: (%i, %i)\n", x, y);
-                        printf("A(%i, %i): [%.20f]\n", x, y, imA->m[x][y].i);
-                        printf("B(%i, %i): [%.20f]\n", x, y, imB->m[x][y].i);
-                        printf("A(x,y) - B(x,y): %.38f\n\n", 
-                            imA->m[x][y].i - imB->m[x][y].i);
-                    
-                    return -4;
-                }
-            }
+    double blocks = (stats.blocks > 0? (double)stats.blocks:1.0);
+    printf("%10s %9ix%-5i %7i %12.6f %12.6f %9.1f%% %9.1f%% %9.1f%% %12i\n", 
+           name, source->width, source->height, thread, times[0], times[1],
+           100.0*stats.flat/blocks, 100.0*stats.hits/blocks,
+           100.0*(times[0] - times[1])/times[0], validation);
+
+    imDelete(srcIMG, dctIMG, idctIMG);
+    planDestroy(plan);
+}
+
+
+/*
+    Compare transforms with and without shortcutting flat blocks and
+    reusing the coefficients of repeated ones, on 'Results/campus.pgm'
+    (or the input image) and on generated pages of text and content
+*/
+void runDedupTest(int width, int height, const int* threads, int threadCount) {
+    const char* names[] = { "text", "natural", "noise" };
+    int modes[]         = { GEN_TEXT, GEN_NATURAL, GEN_NOISE };
+    image* photo        = (inputImage != NULL? inputImage:readInput("Results/campus.pgm"));
+    if (photo == NULL)
+        printf("Unable to read 'Results/campus.pgm', skipping it\n\n");
+
+    printf("%10s %15s %7s %12s %12s %10s %10s %10s %12s\n", "content", "size", 
+           "threads", "full (s)", "dedup (s)", "flat", "hits", "saved", "validation");
+
+    for (int t = 0; t < threadCount; t++) {
+        int thread = threads[t];
+        if (photo != NULL)
+            runDedupContent("campus", photo, thread);
+
+        for (int m = 0; m < (int)(sizeof(modes)/sizeof(int)); m++) {
+            image* im = allocateImage(width, height, 1);
+            imGenerate(im, height, contentSeed, modes[m], NULL);
+            runDedupContent(names[m], im, thread);
+            imFree(im);
         }
     }
 
-    // Else the input is a RGB image
-    else {
-        for (int y = 0; y < imA->height; y++) {
-            for (int x = 0; x < imA->width; x++) {
-                if (fabs(imA->m[x][y].r - imB->m[x][y].r) >= threshold)
-                    return -1;
+    if (photo != inputImage)
+        imFree(photo);
+}
+
+
+/*
+    Return the fastest of a few transforms of a source on a plan in
+    seconds, along with the validation of the last one
+*/
+double timeBatchKernel(dctPlan* plan, image* srcIMG, image* dctIMG, 
+                       image* idctIMG, int* validation) {
+    int iterations = 5;
+    double best    = 0.0;
+    planExecute(plan, srcIMG, dctIMG, idctIMG);
+    for (int it = 0; it < iterations; it++) {
+        struct timespec start;
+        clock_gettime(CLOCK_REALTIME, &start);
+        planExecute(plan, srcIMG, dctIMG, idctIMG);
+
+        double seconds = secondsSince(&start);
+        if (it == 0 || seconds < best)
+            best = seconds;
+    }
+
+    *validation = imValidate(srcIMG, idctIMG, (planPrecision == PLAN_FLOAT? 1e-3:1e-12));
+    return best;
+}
 
-                if (fabs(imA->m[x][y].g - imB->m[x][y].g) >= threshold)
-                    return -2;
 
-                if (fabs(imA->m[x][y].b - imB->m[x][y].b) >= threshold)
-                    return -3;
+/*
+    Compare the batched kernel with 4, 8 and 16 blocks per batch 
+    against the per-block kernels on a (width x height) image, then
+    transform a batch of 256 thumbnails one image at a time against
+    all of them at once with planExecuteImages()
+*/
+void runBatchTest(int width, int height, const int* threads, int threadCount) {
+    const char* names[] = { "separable", "avx2", "batch4", "batch8", "batch16" };
+    int kernels[]       = { KERNEL_SEPARABLE, KERNEL_AVX2, KERNEL_BATCH, 
+                            KERNEL_BATCH, KERNEL_BATCH };
+    int lanes[]         = { 0, 0, 4, 8, 16 };
+    int count           = (int)(sizeof(kernels)/sizeof(int));
+
+    printf("%ix%i image, %ix%i blocks, %s (MP/s)\n", width, height, planBlock, 
+           planBlock, (planPrecision == PLAN_FLOAT? "float":"double"));
+    printf("%7s", "threads");
+    for (int k = 0; k < count; k++)
+        printf(" %10s", names[k]);
+    printf(" %12s\n", "validation");
+
+    for (int t = 0; t < threadCount; t++) {
+        int thread = threads[t];
+        dctPlan* plan   = createPlan(thread, width, height);
+        image* srcIMG   = createSource(plan);
+        image* dctIMG   = planAllocateImage(plan, 0);
+        image* idctIMG  = planAllocateImage(plan, 0);
+        int validation  = 0;
+
+        printf("%7i", thread);
+        for (int k = 0; k < count; k++) {
+            if (planSetKernel(plan, kernels[k]) != 0 ||
+                (lanes[k] > 0 && planSetBatch(plan, lanes[k]) != 0)) {
+                printf(" %10s", "n/a");
+                continue;
             }
+
+            int valid;
+            double seconds = timeBatchKernel(plan, srcIMG, dctIMG, idctIMG, &valid);
+            printf(" %10.2f", (double)width*height/seconds/1e6);
+            if (validation == 0)
+                validation = valid;
         }
+        printf(" %12i\n", validation);
+
+        imDelete(srcIMG, dctIMG, idctIMG);
+        planDestroy(plan);
     }
 
-    return 0;
+    // A batch of thumbnails, too few blocks each to keep the lanes of
+    // every batch full without packing the images together
+    int images = 256, thumbWidth = 64, thumbHeight = 48;
+    image* srcIMG[256];
+    image* dctIMG[256];
+    image* idctIMG[256];
+
+    printf("\n%i thumbnails of %ix%i (MP/s)\n", images, thumbWidth, thumbHeight);
+    printf("%7s %10s %10s %10s %12s\n", "threads", "each", "packed", "speedup", "validation");
+
+    for (int t = 0; t < threadCount; t++) {
+        int thread = threads[t];
+        dctPlan* plan = createPlan(thread, thumbWidth, thumbHeight);
+        for (int i = 0; i < images; i++) {
+            srcIMG[i]  = planAllocateImage(plan, 0);
+            dctIMG[i]  = planAllocateImage(plan, 0);
+            idctIMG[i] = planAllocateImage(plan, 0);
+            imGenerate(srcIMG[i], thumbHeight, contentSeed + i, contentMode, NULL);
+        }
+
+        // Keep the fastest of a few runs of either way
+        double times[2] = { 0.0, 0.0 };
+        for (int packed = 0; packed <= 1; packed++) {
+            for (int it = 0; it < 5; it++) {
+                struct timespec start;
+                clock_gettime(CLOCK_REALTIME, &start);
+                if (packed)
+                    planExecuteImages(plan, images, srcIMG, dctIMG, idctIMG);
+
+                else
+                    for (int i = 0; i < images; i++)
+                        planExecute(plan, srcIMG[i], dctIMG[i], idctIMG[i]);
+
+                double seconds = secondsSince(&start);
+                if (it == 0 || seconds < times[packed])
+                    times[packed] = seconds;
+            }
+        }
+
+        int validation = 0;
+        for (int i = 0; i < images && validation == 0; i++)
+            validation = imValidate(srcIMG[i], idctIMG[i], 
+                                    (planPrecision == PLAN_FLOAT? 1e-3:1e-12));
+
+        double pixels = (double)images*thumbWidth*thumbHeight;
+        printf("%7i %10.2f %10.2f %9.2fx %12i\n", thread, pixels/times[0]/1e6,
+               pixels/times[1]/1e6, times[0]/times[1], validation);
+
+        for (int i = 0; i < images; i++)
+            imDelete(srcIMG[i], dctIMG[i], idctIMG[i]);
+        planDestroy(plan);
+    }
 }
 
 
+// Edits timed by runEditTest(), after the EDIT_* ones
+#define EDIT_TEST_CROP      EDIT_COUNT
+#define EDIT_TEST_DOWNSCALE (EDIT_COUNT + 1)
+
 /*
-    Allocate space for a (width x height) size image and 
-    return it's pointer
+    Apply an edit of runEditTest() to the (width x height) pixels of
+    'srcIMG', writing the edited pixels into 'outIMG'; this is the 
+    reference (and the pixel-domain path) the coefficient edits are
+    compared against, so it is kept as plain as it gets
 */
-image* allocateImage(int width, int height, int channels) {
+void editPixels(image* srcIMG, image* outIMG, int edit, int width, 
+                int height, const dctRect* crop) {
+    int W = width, H = height;
+    if (edit == EDIT_TEST_CROP) {
+        for (int x = 0; x < crop->width; x++)
+            for (int y = 0; y < crop->height; y++)
+                outIMG->m[x][y].i = srcIMG->m[crop->x + x][crop->y + y].i;
+        return;
+    }
 
-    
-    // Allocate an image structure
-    //
-    // NOTE:
-    // 
-    //    To be able to index with im[x][y], I need 
-    //    to initialize with WIDTH, and then iterate over
-    //    WIDTH allocating for each column of a certain HEIGHT
-    //
-    image* im = (image*)malloc(1*sizeof(image));
-    im->m     = (pixel**)malloc((width)*sizeof(pixel));
+    // Pixels past an odd last block are mirrored back onto it
+    if (edit == EDIT_TEST_DOWNSCALE) {
+        int B = planBlock;
+        int outW = (W/B + 1)/2*B, outH = (H/B + 1)/2*B;
+        for (int x = 0; x < outW; x++)
+            for (int y = 0; y < outH; y++) {
+                double sum = 0.0;
+                for (int dx = 0; dx < 2; dx++)
+                    for (int dy = 0; dy < 2; dy++) {
+                        int sx = 2*x + dx, sy = 2*y + dy;
+                        sx = (sx < W? sx:2*W - 1 - sx);
+                        sy = (sy < H? sy:2*H - 1 - sy);
+                        sum += srcIMG->m[sx][sy].i;
+                    }
+                outIMG->m[x][y].i = sum/4.0;
+            }
+        return;
+    }
 
-    // Allocate each column of the image matrix
-    for (int x = 0; x < width; x++)
-        im->m[x] = (pixel*)malloc((height)*sizeof(pixel));
+    for (int x = 0; x < W; x++)
+        for (int y = 0; y < H; y++) {
+            double value = srcIMG->m[x][y].i;
+            switch (edit) {
+                case EDIT_FLIP_H:     outIMG->m[W-1-x][y].i     = value; break;
+                case EDIT_FLIP_V:     outIMG->m[x][H-1-y].i     = value; break;
+                case EDIT_ROTATE_90:  outIMG->m[H-1-y][x].i     = value; break;
+                case EDIT_ROTATE_180: outIMG->m[W-1-x][H-1-y].i = value; break;
+                case EDIT_ROTATE_270: outIMG->m[y][W-1-x].i     = value; break;
+                case EDIT_TRANSPOSE:  outIMG->m[y][x].i         = value; break;
+                case EDIT_TRANSVERSE: outIMG->m[H-1-y][W-1-x].i = value; break;
+            }
+        }
+}
 
-    im->height    = height;
-    im->width     = width;
-    im->channels  = channels;
-    return im;
+
+/*
+    Apply an edit of runEditTest() to the coefficients of 'dctIMG'
+*/
+int editCoefficients(dctPlan* plan, image* dctIMG, image* outIMG, int edit,
+                     const dctRect* crop) {
+    if (edit == EDIT_TEST_CROP)
+        return planCoefCrop(plan, dctIMG, outIMG, crop);
+
+    if (edit == EDIT_TEST_DOWNSCALE)
+        return planCoefDownscale(plan, dctIMG, outIMG);
+
+    return planCoefTransform(plan, dctIMG, outIMG, edit);
 }
 
 
 /*
-    Randomly generate a (width x height) size image and 
-    return it's pointer
+    Time every flip and rotation, a crop of the center and a 2:1 
+    downscale done on the coefficients of a transformed image, against
+    reconstructing it, editing its pixels and transforming the result;
+
+    Each edit is validated by reconstructing the edited coefficients
+    and comparing them with the same edit of the source pixels
 */
-image* generateImage(int width, int height, int channels, int padAmnt) {
+void runEditTest(int width, int height, const int* threads, int threadCount) {
+    int iterations = 3;
+    int B          = planBlock;
+
+    printf("%12s %7s %12s %12s %10s %12s\n", "edit", "threads", "coef (s)", 
+           "pixels (s)", "speedup", "validation");
+
+    for (int t = 0; t < threadCount; t++) {
+        int thread = threads[t];
+        dctPlan* plan  = createPlan(thread, width, height);
+        image* srcIMG  = createSource(plan);
+        image* dctIMG  = planAllocateImage(plan, 0);
+        image* idctIMG = planAllocateImage(plan, 0);
+        planForward(plan, srcIMG, dctIMG);
+
+        // The edits work on whole blocks, padded rows included
+        int W = plan->width, H = plan->paddedHeight;
+        dctRect crop = { W/4/B*B, H/4/B*B, 0, 0 };
+        crop.width   = (W/4 + W/2 + B - 1)/B*B - crop.x;
+        crop.height  = (H/4 + H/2 + B - 1)/B*B - crop.y;
+
+        for (int edit = 0; edit <= EDIT_TEST_DOWNSCALE; edit++) {
+            int outW = W, outH = H;
+            if (edit < EDIT_COUNT && planEditSwapsSides(edit))
+                outW = H, outH = W;
+
+            else if (edit == EDIT_TEST_CROP)
+                outW = crop.width, outH = crop.height;
+
+            else if (edit == EDIT_TEST_DOWNSCALE)
+                outW = (W/B + 1)/2*B, outH = (H/B + 1)/2*B;
+
+            dctPlan* outPlan = createPlan(thread, outW, outH);
+            image* editIMG   = planAllocateImage(outPlan, 0);
+            image* coefIMG   = planAllocateImage(outPlan, 0);
+            image* refIMG    = planAllocateImage(outPlan, 0);
+
+            // Keep the fastest of a few runs of either way
+            double times[2] = { 0.0, 0.0 };
+            for (int it = 0; it < iterations; it++) {
+                struct timespec start;
+                clock_gettime(CLOCK_REALTIME, &start);
+                editCoefficients(plan, dctIMG, coefIMG, edit, &crop);
+
+                double seconds = secondsSince(&start);
+                if (it == 0 || seconds < times[0])
+                    times[0] = seconds;
+
+                clock_gettime(CLOCK_REALTIME, &start);
+                planInverse(plan, dctIMG, idctIMG);
+                editPixels(idctIMG, editIMG, edit, W, H, &crop);
+                planForward(outPlan, editIMG, refIMG);
+
+                seconds = secondsSince(&start);
+                if (it == 0 || seconds < times[1])
+                    times[1] = seconds;
+            }
 
-    // Allocate the image structure
-    image* im = allocateImage(width, (height + padAmnt), channels);
+            // Reconstruct the edited coefficients against editing the source
+            editPixels(srcIMG, refIMG, edit, W, H, &crop);
+            planInverse(outPlan, coefIMG, editIMG);
+            int validation = imValidate(refIMG, editIMG, 
+                                        (planPrecision == PLAN_FLOAT? 1e-3:1e-9));
 
-    // Randomly generate values at each pixel
-    srand((unsigned)time(NULL));
-    for (int y = 0; y < height; y++)
-        for (int x = 0; x < width; x++)
-            im->m[x][y].i = (double)(rand() % 255);
+            printf("%12s %7i %12.6f %12.6f %9.2fx %12i\n", 
+                   (edit == EDIT_TEST_CROP? "crop":
+                    edit == EDIT_TEST_DOWNSCALE? "downscale":planEditName(edit)),
+                   thread, times[0], times[1], times[1]/times[0], validation);
 
-    // Initialize all padded area to 0's
-    for (int y = height, sz = (height + padAmnt); y < sz; y++)
-        for (int x = 0; x < width; x++)
-            im->m[x][y].i = 0;
+            imDelete(editIMG, coefIMG, refIMG);
+            planDestroy(outPlan);
+        }
+        printf("\n");
 
-    return im;
+        imDelete(srcIMG, dctIMG, idctIMG);
+        planDestroy(plan);
+    }
 }
 
 
 /*
-    Return a height that an image should have with extra padding;
+    Denoise the way planDenoise() does, but transforming every window
+    on its own with the plan's kernels on a single thread; this is the
+    cost of overlapping windows without sharing anything between them
+*/
+void denoiseWindows(dctPlan* plan, image* srcIMG, image* outIMG, int stride,
+                    double threshold) {
+    int B = plan->blockSize, W = plan->width, H = plan->height;
+    double* sum    = (double*)calloc((size_t)W*H, sizeof(double));
+    double* weight = (double*)calloc((size_t)W*H, sizeof(double));
+    double in[PLAN_MAX_BLOCK*PLAN_MAX_BLOCK], out[PLAN_MAX_BLOCK*PLAN_MAX_BLOCK];
+
+    // Windows on the stride, plus the last ones that fit
+    for (int y = 0; y <= H - B; y = (y + stride > H - B && y < H - B? H - B:y + stride))
+        for (int x = 0; x <= W - B; x = (x + stride > W - B && x < W - B? W - B:x + stride)) {
+            planGather(srcIMG, in, x, y, B);
+            plan->forward(plan, in, out);
+
+            int kept = 1;
+            for (int k = 1; k < B*B; k++) {
+                if (fabs(out[k]) < threshold)
+                    out[k] = 0.0;
+
+                else
+                    kept++;
+            }
+
+            plan->inverse(plan, out, in);
+            for (int i = 0; i < B; i++)
+                for (int j = 0; j < B; j++) {
+                    sum[(size_t)(x + i)*H + y + j]    += in[i*B + j]/kept;
+                    weight[(size_t)(x + i)*H + y + j] += 1.0/kept;
+                }
+        }
 
-    This number is determined by the starting (minimum) size
-    and the amount of threads used in the process
+    for (int x = 0; x < W; x++)
+        for (int y = 0; y < H; y++)
+            outIMG->m[x][y].i = sum[(size_t)x*H + y]/weight[(size_t)x*H + y];
+
+    free(sum);
+    free(weight);
+}
 
-    Ts = idx     * s / totalThreads;
-    Te = (idx+1) * s / totalThreads;
-   
-    For it to work, either (Te-Ts)%8 == 0
-    or                     (h/totalThreads)%8 == 0
+
+/*
+    Return the PSNR of an image against a clean one, for 8-bit pixels
 */
-int imGetPadSize(int totalThreads, int startingSize) {
-    int found = 0, sizeFound = 0;
-    for (int s = startingSize; s < 15000; s++) {  
-        for (int idx = 0; idx < totalThreads; idx++) {
-            int start = idx     * s / totalThreads;
-            int end   = (idx+1) * s / totalThreads;
+double denoisePSNR(image* cleanIMG, image* im) {
+    return 10.0*log10(255.0*255.0/(double)imMSE(cleanIMG, im));
+}
 
-            if (((end-start) % 8) == 0)
-                found = 1;
 
-            else {
-                found = 0;
-                break;
+/*
+    Denoise a generated image with added gaussian noise over windows
+    at strides of 1, 2, 4 and the block size, reporting the speed and
+    PSNR on every thread count and the time of transforming every
+    window on its own (against the first thread count, which also
+    validates the result);
+    then validate odd block sizes of 3 and 5 the same way
+*/
+void runDenoiseTest(int width, int height, const int* threads, int threadCount) {
+    double sigma     = 20.0;
+    double threshold = 3.0*sigma;
+    int strides[]    = { 1, 2, 4, planBlock };
+
+    image* cleanIMG = allocateImage(width, height, 1);
+    image* noisyIMG = allocateImage(width, height, 1);
+    image* outIMG   = allocateImage(width, height, 1);
+    image* refIMG   = allocateImage(width, height, 1);
+    imGenerate(cleanIMG, height, contentSeed, 
+               (contentMode == GEN_NOISE? GEN_NATURAL:contentMode), NULL);
+
+    // Gaussian noise through Box-Muller on a xorshift generator
+    uint64_t state = contentSeed | 1;
+    for (int x = 0; x < width; x++)
+        for (int y = 0; y < height; y++) {
+            double r[2];
+            for (int k = 0; k < 2; k++) {
+                state ^= state << 13, state ^= state >> 7, state ^= state << 17;
+                r[k] = ((state >> 11) + 0.5)/9007199254740992.0;
+            }
+            noisyIMG->m[x][y].i = cleanIMG->m[x][y].i + 
+                                  sigma*sqrt(-2.0*log(r[0]))*cos(2.0*M_PI*r[1]);
+        }
+
+    printf("%ix%i image, %ix%i windows, noise deviation %.1f, threshold %.1f\n", 
+           width, height, planBlock, planBlock, sigma, threshold);
+    printf("noisy PSNR: %.2f dB\n\n", denoisePSNR(cleanIMG, noisyIMG));
+    printf("%7s %7s %12s %10s %12s %12s %10s %12s\n", "stride", "threads", "time (s)",
+           "MP/s", "PSNR (dB)", "windows (s)", "speedup", "validation");
+
+    for (int s = 0; s < (int)(sizeof(strides)/sizeof(int)); s++) {
+        double single = 0.0, windows = 0.0;
+        int validation = 0;
+        for (int t = 0; t < threadCount; t++) {
+            int thread = threads[t];
+            dctPlan* plan = createPlan(thread, width, height);
+
+            // Keep the fastest of a few runs
+            double best = 0.0;
+            for (int it = 0; it < 3; it++) {
+                struct timespec start;
+                clock_gettime(CLOCK_REALTIME, &start);
+                planDenoise(plan, noisyIMG, outIMG, strides[s], threshold);
+
+                double seconds = secondsSince(&start);
+                if (it == 0 || seconds < best)
+                    best = seconds;
             }
+
+            if (t == 0) {
+                struct timespec start;
+                clock_gettime(CLOCK_REALTIME, &start);
+                denoiseWindows(plan, noisyIMG, refIMG, strides[s], threshold);
+                windows    = secondsSince(&start);
+                single     = best;
+                validation = imValidate(refIMG, outIMG, 
+                                        (planPrecision == PLAN_FLOAT? 1e-2:1e-9));
+            }
+
+            printf("%7i %7i %12.6f %10.2f %12.2f %12.6f %9.2fx %12i\n", strides[s], 
+                   thread, best, (double)width*height/best/1e6, 
+                   denoisePSNR(cleanIMG, outIMG), windows, windows/single, validation);
+            planDestroy(plan);
+        }
+        printf("\n");
+    }
+
+    // Odd block sizes, whose middle row and column fall outside the
+    // symmetric sums and differences, on the widest multiple of each
+    int blockSize = planBlock;
+    int oddBlocks[] = { 3, 5 };
+    for (int b = 0; b < 2; b++) {
+        planBlock       = oddBlocks[b];
+        int oddWidth    = width/planBlock*planBlock;
+        image* srcIMG   = allocateImage(oddWidth, height, 1);
+        image* oddIMG   = allocateImage(oddWidth, height, 1);
+        image* checkIMG = allocateImage(oddWidth, height, 1);
+        for (int x = 0; x < oddWidth; x++)
+            for (int y = 0; y < height; y++)
+                srcIMG->m[x][y].i = noisyIMG->m[x][y].i;
+
+        for (int thread = 1; thread <= 2; thread++) {
+            dctPlan* plan = createPlan(thread, oddWidth, height);
+            denoiseWindows(plan, srcIMG, checkIMG, 1, threshold);
+
+            struct timespec start;
+            clock_gettime(CLOCK_REALTIME, &start);
+            int status     = planDenoise(plan, srcIMG, oddIMG, 1, threshold);
+            double seconds = secondsSince(&start);
+
+            printf("%ix%i windows, stride 1, %i threads: %.6f s, validation %i\n",
+                   planBlock, planBlock, thread, seconds, (status != 0? status:
+                   imValidate(checkIMG, oddIMG, (planPrecision == PLAN_FLOAT? 1e-2:1e-9))));
+            planDestroy(plan);
         }
-        if (found == 1)
-            return s;
+
+        imFree(srcIMG);
+        imFree(oddIMG);
+        imFree(checkIMG);
     }
-    return -1;
+    planBlock = blockSize;
+
+    imFree(cleanIMG);
+    imFree(noisyIMG);
+    imFree(outIMG);
+    imFree(refIMG);
 }
 
 
 /*
-    Remove padding from an image and reset it's variables 
-    for dimensions based on the padding amount removed
+    Time the reversible integer transform (forward and inverse) on
+    16 and 32-bit planes against the plan's double precision kernel,
+    validating that the integer round trip gives back every pixel 
+    exactly (with a threshold of 0)
 */
-void imRemovePadding(image* srcIMG, image* dctIMG, image* idctIMG, int padAmnt) {
-    for (int y = srcIMG->height, nSize = (srcIMG->height - padAmnt); y >= nSize; y--) {
-        free(srcIMG->m[y]);
-        free(dctIMG->m[y]);
-        free(idctIMG->m[y]);
+void runIntegerTest(int width, int height, const int* threads, int threadCount) {
+    int iterations = 5;
+    int bits[]     = { INT_PLANE_32, INT_PLANE_16 };
+
+    printf("%ix%i image (MP/s)\n", width, height);
+    printf("%7s %10s %10s %10s %12s %12s\n", "threads", "double", "int32", "int16",
+           "valid int32", "valid int16");
+
+    for (int t = 0; t < threadCount; t++) {
+        int thread = threads[t];
+        dctPlan* plan  = createPlan(thread, width, height);
+        image* srcIMG  = createSource(plan);
+        image* dctIMG  = planAllocateImage(plan, 0);
+        image* idctIMG = planAllocateImage(plan, 0);
+        if (plan->blockSize != 8) {
+            printf("The integer transform needs 8x8 blocks\n");
+            exit(1);
+        }
+
+        // The source rounded to the integers the planes hold
+        intPlane* srcPlane = intPlaneAllocate(width, plan->paddedHeight, INT_PLANE_32);
+        intPlaneFromImage(srcPlane, srcIMG);
+        intPlaneToImage(srcPlane, srcIMG);
+        intPlaneFree(srcPlane);
+
+        double times[3];
+        int validation[2];
+        for (int it = 0; it < iterations; it++) {
+            struct timespec start;
+            clock_gettime(CLOCK_REALTIME, &start);
+            planExecute(plan, srcIMG, dctIMG, idctIMG);
+
+            double seconds = secondsSince(&start);
+            if (it == 0 || seconds < times[0])
+                times[0] = seconds;
+        }
+
+        for (int b = 0; b < 2; b++) {
+            intPlane* inPlane  = intPlaneAllocate(width, plan->paddedHeight, bits[b]);
+            intPlane* dctPlane = intPlaneAllocate(width, plan->paddedHeight, bits[b]);
+            intPlane* outPlane = intPlaneAllocate(width, plan->paddedHeight, bits[b]);
+            intPlaneFromImage(inPlane, srcIMG);
+
+            for (int it = 0; it < iterations; it++) {
+                struct timespec start;
+                clock_gettime(CLOCK_REALTIME, &start);
+                planForwardInt(plan, inPlane, dctPlane);
+                planInverseInt(plan, dctPlane, outPlane);
+
+                double seconds = secondsSince(&start);
+                if (it == 0 || seconds < times[b + 1])
+                    times[b + 1] = seconds;
+            }
+
+            intPlaneToImage(outPlane, idctIMG);
+            validation[b] = imValidate(srcIMG, idctIMG, 0.0);
+
+            intPlaneFree(inPlane);
+            intPlaneFree(dctPlane);
+            intPlaneFree(outPlane);
+        }
+
+        double pixels = (double)width*height;
+        printf("%7i %10.2f %10.2f %10.2f %12i %12i\n", thread, pixels/times[0]/1e6,
+               pixels/times[1]/1e6, pixels/times[2]/1e6, validation[0], validation[1]);
+
+        imDelete(srcIMG, dctIMG, idctIMG);
+        planDestroy(plan);
     }
-    srcIMG->height  = (srcIMG->height  - padAmnt);
-    dctIMG->height  = (dctIMG->height  - padAmnt);
-    idctIMG->height = (idctIMG->height - padAmnt);
 }
 
 
 /*
-    Read a file into an image structure
+    Tune the configuration for (width x height) images on this CPU,
+    logging every candidate, and compare a plan created from the
+    stored tuning against one with a thread per CPU and the defaults
 */
-void imread(image* im, FILE *inFile) {
+void runTuneTest(int width, int height) {
+    char* fileName = getenv("TCDCT_TUNE_FILE");
+    dctTuning tuning;
+
+    printf("Tuning %ix%i (%s), %ix%i blocks, %s\n\n", width, height,
+           planSizeClass(width, height), planBlock, planBlock,
+           (planPrecision == PLAN_FLOAT? "float":"double"));
+
+    int status = planTune(width, height, planBlock, planPrecision, 0, fileName,
+                          &tuning, stdout);
+    if (status < 0) {
+        printf("Unable to plan a %ix%i image\n", width, height);
+        return;
+    }
 
-    // If input image is a grayscale image
-    if (im->channels == 1) {
-        int value;
-        for (int y = 0; y < im->height; y++) {
-            for (int x = 0; x < im->width; x++) {
-               fscanf(inFile, "\n%i", &value);
-               im->m[x][y].i = (valueType)value;
-            }
+    printf("\nFastest: %i threads, %s kernel, %s order (%i blocks), prefetch %s, "
+           "%.2f MP/s\n", tuning.totalThreads, planKernelName(tuning.kernel),
+           planTraversalName(tuning.traversal), tuning.stripBlocks,
+           (tuning.prefetch? "on":"off"), tuning.mpixels);
+    if (status != 0)
+        printf("Unable to store the tuning in '%s'\n", 
+               (fileName != NULL? fileName:TUNE_FILE_DEFAULT));
+    else
+        printf("Stored in '%s'\n", (fileName != NULL? fileName:TUNE_FILE_DEFAULT));
+
+    // A tuned plan, as later runs get it, against the defaults
+    printf("\n%10s %7s %10s %10s %12s\n", "plan", "threads", "kernel", "MP/s", "validation");
+    for (int tuned = 0; tuned <= 1; tuned++) {
+        dctPlan* plan  = (tuned? planCreateTuned(width, height, planBlock, planPrecision, 
+                                                 0, fileName):
+                                 planCreate(width, height, planBlock, planPrecision,
+                                            affinityCPUCount(), 0));
+        image* srcIMG  = createSource(plan);
+        image* dctIMG  = planAllocateImage(plan, 0);
+        image* idctIMG = planAllocateImage(plan, 0);
+
+        double best = 0.0;
+        planExecute(plan, srcIMG, dctIMG, idctIMG);
+        for (int it = 0; it < 5; it++) {
+            struct timespec start;
+            clock_gettime(CLOCK_REALTIME, &start);
+            planExecute(plan, srcIMG, dctIMG, idctIMG);
+
+            double seconds = secondsSince(&start);
+            if (it == 0 || seconds < best)
+                best = seconds;
         }
+
+        printf("%10s %7i %10s %10.2f %12i\n", (tuned? "tuned":"default"),
+               plan->totalThreads, planKernelName(plan->kernel), 
+               (double)width*height/best/1e6,
+               imValidate(srcIMG, idctIMG, (planPrecision == PLAN_FLOAT? 1e-3:1e-12)));
+
+        imDelete(srcIMG, dctIMG, idctIMG);
+        planDestroy(plan);
+    }
+}
+
+
+/*
+    Compare two files byte for byte, returning 0 if they're identical
+*/
+int compareFiles(const char* fileA, const char* fileB) {
+    FILE* inA = fopen(fileA, "r");
+    FILE* inB = fopen(fileB, "r");
+    int differ = (inA == NULL || inB == NULL);
+    char bufA[65536], bufB[65536];
+
+    while (!differ) {
+        size_t readA = fread(bufA, 1, sizeof(bufA), inA);
+        size_t readB = fread(bufB, 1, sizeof(bufB), inB);
+        differ       = (readA != readB || memcmp(bufA, bufB, readA) != 0);
+        if (readA == 0)
+            break;
+    }
+
+    if (inA != NULL)
+        fclose(inA);
+    if (inB != NULL)
+        fclose(inB);
+
+    return differ;
+}
+
+
+/*
+    Time writing and reading the source (and its coefficients) as ASCII
+    PGM files with imwriteParallel() and imreadParallel() on every
+    amount of workers, against imwrite() and imread() (in a temporary directory);
+    the files written have to match imwrite()'s byte for byte, and the
+    images read back imread()'s, also for values up to 1e308
+*/
+void runTextTest(int width, int height, const int* threads, int threadCount) {
+    const char* names[] = { "source", "dct" };
+    int iterations      = 3;
+    char dir[4096], fileName[4096 + 64], legacyFiles[2][4096 + 64];
+    struct timespec start;
+
+    if (tempDirectory(dir, sizeof(dir)) != 0) {
+        perror("Unable to create a temporary directory");
+        return;
+    }
+    snprintf(fileName, sizeof(fileName), "%s/textIMG.pgm", dir);
+    for (int c = 0; c < 2; c++)
+        snprintf(legacyFiles[c], sizeof(legacyFiles[c]), "%s/%s-textIMG-legacy.pgm",
+                 dir, names[c]);
+
+    dctPlan* plan     = createPlan(1, width, height);
+    image* images[2]  = { createSource(plan), planAllocateImage(plan, 0) };
+    image* legacy[2];
+    double writeTimes[2], readTimes[2], sizes[2];
+    planForward(plan, images[0], images[1]);
+    planDestroy(plan);
+
+    // What imwrite() and imread() take to begin with
+    for (int c = 0; c < 2; c++) {
+        const char* legacyFile = legacyFiles[c];
+
+        clock_gettime(CLOCK_REALTIME, &start);
+        imwrite(images[c], (char*)legacyFile);
+        writeTimes[c] = secondsSince(&start);
+
+        clock_gettime(CLOCK_REALTIME, &start);
+        FILE* inFile = fopen(legacyFile, "r");
+        legacy[c]    = allocateImage(images[c]->width, images[c]->height, 1);
+        imread(legacy[c], inFile);
+        fclose(inFile);
+        readTimes[c] = secondsSince(&start);
+
+        struct stat st;
+        sizes[c] = (stat(legacyFile, &st) == 0? st.st_size/1e6:0.0);
+        printf("%s: %.2f MB, imwrite() %.4f s (%.1f MB/s), imread() %.4f s (%.1f MB/s)\n",
+               names[c], sizes[c], writeTimes[c], sizes[c]/writeTimes[c],
+               readTimes[c], sizes[c]/readTimes[c]);
     }
 
-    // Else the input is a RGB image
-    else {
-        int rv, gv, bv;
-        for (int y = 0; y < im->height; y++) {
-            for (int x = 0; x < im->width; x++) {
-               fscanf(inFile, "\n%i %i %i", 
-                             &rv, &gv, &bv);
+    printf("\n%7s %8s %13s %9s %13s %9s %12s\n", "threads", "image", "write (MB/s)",
+           "speedup", "read (MB/s)", "speedup", "validation");
+
+    for (int t = 0; t < threadCount; t++) {
+        int thread = threads[t];
+        threadPool* pool = poolCreate(thread, numaMode);
+
+        for (int c = 0; c < 2; c++) {
+            const char* legacyFile = legacyFiles[c];
 
-                im->m[x][y].r = (valueType)rv;
-                im->m[x][y].g = (valueType)gv;
-                im->m[x][y].b = (valueType)bv;
+            // Keep the fastest of a few runs of each
+            double writeTime = 0.0, readTime = 0.0;
+            int validation   = 0;
+            for (int it = 0; it < iterations; it++) {
+                clock_gettime(CLOCK_REALTIME, &start);
+                validation |= (imwriteParallel(images[c], fileName, pool) != 0);
+                double seconds = secondsSince(&start);
+                writeTime = (it == 0 || seconds < writeTime? seconds:writeTime);
+
+                clock_gettime(CLOCK_REALTIME, &start);
+                image* readIMG = imreadParallel(fileName, pool);
+                seconds  = secondsSince(&start);
+                readTime = (it == 0 || seconds < readTime? seconds:readTime);
+
+                if (readIMG == NULL)
+                    validation = 1;
+
+                else {
+                    validation |= (imValidate(legacy[c], readIMG, 0.0) != 0);
+                    imFree(readIMG);
+                }
             }
+            validation |= compareFiles(fileName, legacyFile);
+
+            printf("%7i %8s %13.1f %8.1fx %13.1f %8.1fx %12i\n", thread, names[c],
+                   sizes[c]/writeTime, writeTimes[c]/writeTime,
+                   sizes[c]/readTime, readTimes[c]/readTime, validation);
+        }
+
+        poolDestroy(pool);
+    }
+
+    // Values too large to round to an integer, which take up to 309
+    // digits each rather than at most 20
+    {
+        double values[]  = { 1e308, 1e300, 1e18, 123456.5, -1.0, -0.0 };
+        image* hugeIMG   = allocateImage(64, 16, 1);
+        threadPool* pool = poolCreate(2, numaMode);
+        for (int x = 0; x < hugeIMG->width; x++)
+            for (int y = 0; y < hugeIMG->height; y++)
+                hugeIMG->m[x][y].i = values[(x + y) % 6];
+
+        imwrite(hugeIMG, (char*)legacyFiles[0]);
+        int validation = (imwriteParallel(hugeIMG, fileName, pool) != 0) || 
+                         compareFiles(fileName, legacyFiles[0]);
+        validation    |= (imwriteParallel(hugeIMG, fileName, NULL) != 0) || 
+                         compareFiles(fileName, legacyFiles[0]);
+        printf("\nhuge values: validation %i\n", validation);
+
+        poolDestroy(pool);
+        imFree(hugeIMG);
+    }
+
+    for (int c = 0; c < 2; c++) {
+        unlink(legacyFiles[c]);
+        imFree(images[c]);
+        imFree(legacy[c]);
+    }
+    unlink(fileName);
+    rmdir(dir);
+}
+
+
+// Bulk jobs runPriorityTest() keeps in flight, seconds it submits
+// previews (one at a time) for, most previews it submits and the
+// deadline (s) of each preview
+#define PRIORITY_BULK_INFLIGHT 2
+#define PRIORITY_SECONDS       2.0
+#define PRIORITY_PREVIEWS      1000
+#define PRIORITY_DEADLINE      0.02
+
+// Bulk submitter structure definition
+// --------------------------
+//
+// plan     : Plan the bulk jobs are submitted to
+// priority : POOL_* class of the bulk jobs
+// stop     : Set once the submitter should stop
+// jobs     : Amount of bulk jobs that finished (before stopping)
+//
+typedef struct {
+    dctPlan* plan;
+    int priority;
+    int stop;
+    int jobs;
+} prioritySubmitter;
+
+
+/*
+    Keep PRIORITY_BULK_INFLIGHT bulk transforms in flight until told
+    to stop
+*/
+void* priorityBulk(void* arg) {
+    prioritySubmitter* sub = (prioritySubmitter*)arg;
+    dctPlan* plan          = sub->plan;
+    image* srcIMG          = createSource(plan);
+    image* dctIMG[PRIORITY_BULK_INFLIGHT];
+    image* idctIMG[PRIORITY_BULK_INFLIGHT];
+    dctJob* handles[PRIORITY_BULK_INFLIGHT] = {NULL};
+
+    for (int k = 0; k < PRIORITY_BULK_INFLIGHT; k++) {
+        dctIMG[k]  = planAllocateImage(plan, 0);
+        idctIMG[k] = planAllocateImage(plan, 0);
+    }
+
+    for (int j = 0; !__atomic_load_n(&sub->stop, __ATOMIC_RELAXED); j++) {
+        int slot = j % PRIORITY_BULK_INFLIGHT;
+        if (handles[slot] != NULL) {
+            planJobRelease(handles[slot]);
+            __atomic_fetch_add(&sub->jobs, 1, __ATOMIC_RELAXED);
         }
+
+        handles[slot] = planSubmitPriority(plan, srcIMG, dctIMG[slot], idctIMG[slot], 
+                                           PLAN_FORWARD | PLAN_INVERSE, sub->priority,
+                                           0.0, NULL, NULL);
     }
+
+    for (int k = 0; k < PRIORITY_BULK_INFLIGHT; k++) {
+        if (handles[k] != NULL)
+            planJobRelease(handles[k]);
+
+        imFree(dctIMG[k]);
+        imFree(idctIMG[k]);
+    }
+    imFree(srcIMG);
+    return NULL;
 }
 
 
 /*
-    Write an image structure out to a file
+    Submit previews (images an eighth of the size across) one after
+    another for PRIORITY_SECONDS while bulk transforms of full sized
+    images keep the same workers busy, first all in one class (so in
+    order of submission) and then with the previews as
+    POOL_INTERACTIVE jobs with a deadline and the bulk transforms as
+    POOL_BATCH; reports the latency percentiles of the previews, the
+    previews past the deadline, the bulk throughput and the deepest
+    bulk queue seen
 */
-void imwrite(image* im, char* fileName) {
-    FILE *inFile = fopen(fileName, "w+");
-    fprintf(inFile, "P2\n%i %i\n255\n", im->height, im->width);
+void runPriorityTest(int width, int height, const int* threads, int threadCount) {
+    const char* modes[]   = { "fifo", "priority" };
+    int previewWidth      = (width/8 >= planBlock? width/8/planBlock*planBlock:planBlock);
+    int previewHeight     = (height/8 >= 1? height/8:1);
+    poolClassStats classStats[POOL_CLASSES];
+
+    printf("Bulk size: %ix%i, preview size: %ix%i, deadline: %.0f ms\n\n", width, height,
+           previewWidth, previewHeight, PRIORITY_DEADLINE*1e3);
+    printf("%7s %9s %10s %10s %10s %10s %7s %8s %7s\n", "threads", "mode", 
+           "p50 (ms)", "p90 (ms)", "p99 (ms)", "max (ms)", "missed", "bulk/s", "depth");
+
+    for (int t = 0; t < threadCount; t++) {
+        int thread = threads[t];
+        for (int m = 0; m < 2; m++) {
+            dctPlan* plan    = createPlan(thread, width, height);
+            dctPlan* preview = createPlan(thread, previewWidth, previewHeight);
+            planSharePool(preview, plan);
+
+            image* srcIMG  = createSource(preview);
+            image* dctIMG  = planAllocateImage(preview, 0);
+            image* idctIMG = planAllocateImage(preview, 0);
+
+            prioritySubmitter sub = { plan, (m? POOL_BATCH:POOL_NORMAL), 0, 0 };
+            pthread_t tid;
+            struct timespec start, submitted;
+            clock_gettime(CLOCK_REALTIME, &start);
+            pthread_create(&tid, NULL, priorityBulk, &sub);
+
+            double latency[PRIORITY_PREVIEWS];
+            int missed = 0, depth = 0, previews = 0;
+            while (previews < PRIORITY_PREVIEWS && secondsSince(&start) < PRIORITY_SECONDS) {
+                struct timespec pause = { 0, 5000000 };
+                nanosleep(&pause, NULL);
+
+                poolStats(plan->pool, sub.priority, &classStats[sub.priority]);
+                depth = (classStats[sub.priority].queued > depth? 
+                         classStats[sub.priority].queued:depth);
+
+                clock_gettime(CLOCK_REALTIME, &submitted);
+                dctJob* job = planSubmitPriority(preview, srcIMG, dctIMG, idctIMG,
+                                                 PLAN_FORWARD | PLAN_INVERSE,
+                                                 (m? POOL_INTERACTIVE:POOL_NORMAL),
+                                                 (m? PRIORITY_DEADLINE:0.0), NULL, NULL);
+                planJobRelease(job);
+                latency[previews] = secondsSince(&submitted)*1e3;
+                missed += (latency[previews++] > PRIORITY_DEADLINE*1e3);
+            }
 
-    for (int y = 0; y < im->height; y++) {
-        for (int x = 0; x < im->width; x++) {
-            if (im->m[x][y].i >= (valueType)0.0)
-                fprintf(inFile, "%.0f%s", im->m[x][y].i, 
-                          (x+1 == im->width? "\n":" "));
+            // The bulk throughput while the previews were submitted
+            double elapsed = secondsSince(&start);
+            int bulkJobs   = __atomic_load_n(&sub.jobs, __ATOMIC_RELAXED);
+            __atomic_store_n(&sub.stop, 1, __ATOMIC_RELAXED);
+            pthread_join(tid, NULL);
 
-            else
-                fprintf(inFile, "0%s", (x+1 == im->width? "\n":" "));
+            qsort(latency, previews, sizeof(double), compareDoubles);
+            printf("%7i %9s %10.3f %10.3f %10.3f %10.3f %3i/%-3i %8.1f %7i\n", thread,
+                   modes[m], latency[previews/2], latency[previews*90/100],
+                   latency[previews*99/100], latency[previews - 1],
+                   missed, previews, bulkJobs/elapsed, depth);
+
+            for (int c = 0; c < POOL_CLASSES; c++)
+                poolStats(plan->pool, c, &classStats[c]);
+
+            imDelete(srcIMG, dctIMG, idctIMG);
+            planDestroy(preview);
+            planDestroy(plan);
         }
     }
+
+    // What the pool itself recorded for each class in the last run
+    const char* classNames[] = { "interactive", "normal", "batch" };
+    printf("\nPool statistics of the last run:\n\n%12s %7s %10s %7s %10s %10s %10s %10s\n",
+           "class", "queued", "completed", "missed", "p50 (ms)", "p90 (ms)", 
+           "p99 (ms)", "max (ms)");
+    for (int c = 0; c < POOL_CLASSES; c++)
+        printf("%12s %7i %10llu %7llu %10.3f %10.3f %10.3f %10.3f\n", classNames[c],
+               classStats[c].queued, (unsigned long long)classStats[c].completed,
+               (unsigned long long)classStats[c].missed, classStats[c].p50,
+               classStats[c].p90, classStats[c].p99, classStats[c].max);
 }
 
 
 /*
-    Delete an image from memory
+    Return the largest difference between the pixels of a preview and
+    the means of the blocks given by their DC coefficients
 */
-void imDelete(image* srcIMG, image* dctIMG, image* idctIMG) {
-    for (int y = 0; y < srcIMG->height; y++) {
-        free(srcIMG->m[y]);
-        free(dctIMG->m[y]);
-        free(idctIMG->m[y]);
+double budgetPreviewError(dctPlan* plan, image* dcIMG, image* dctIMG) {
+    int B        = plan->blockSize;
+    double scale = plan->basis[0]*plan->basis[0];
+    double error = 0.0;
+    for (int x = 0; x < plan->width/B; x++)
+        for (int y = 0; y < plan->paddedHeight/B; y++)
+            error = fmax(error, fabs(dcIMG->m[x][y].i - dctIMG->m[x*B][y*B].i*scale));
+
+    return error;
+}
+
+
+/*
+    Transform with planExecuteBudget() on every thread count, with budgets
+    from a tenth to twice the time a full transform takes there,
+    reporting the time taken past the budget, the blocks transformed in
+    full, the largest error of the preview (against the DC of a full
+    transform) and the validation (1 if the result is partial); then
+    cancel transforms once half their blocks are done, reporting how
+    long they take to stop and how far they got
+*/
+void runBudgetTest(int width, int height, const int* threads, int threadCount) {
+    double fractions[] = { 0.1, 0.25, 0.5, 1.0, 2.0 };
+    int iterations     = 3;
+    struct timespec start;
+
+    printf("%7s %11s %12s %12s %11s %14s %12s\n", "threads", "budget (ms)",
+           "elapsed (ms)", "overrun (ms)", "complete %", "preview error",
+           "validation");
+
+    for (int t = 0; t < threadCount; t++) {
+        int thread = threads[t];
+        dctPlan* plan  = createPlan(thread, width, height);
+        image* srcIMG  = createSource(plan);
+        image* refIMG  = planAllocateImage(plan, 0);
+        image* dctIMG  = planAllocateImage(plan, 0);
+        image* idctIMG = planAllocateImage(plan, 0);
+        image* dcIMG   = allocateImage(plan->width/plan->blockSize,
+                                       plan->paddedHeight/plan->blockSize, 1);
+
+        // The fastest full transform sets the budgets
+        double full = 0.0;
+        planExecute(plan, srcIMG, refIMG, idctIMG);
+        for (int it = 0; it < iterations; it++) {
+            clock_gettime(CLOCK_REALTIME, &start);
+            planExecute(plan, srcIMG, refIMG, idctIMG);
+
+            double seconds = secondsSince(&start);
+            full = (it == 0 || seconds < full? seconds:full);
+        }
+
+        for (int f = 0; f < 5; f++) {
+            dctBudgetResult result;
+            double budget = full*fractions[f];
+            int status    = planExecuteBudget(plan, srcIMG, dctIMG, idctIMG,
+                                              PLAN_FORWARD | PLAN_INVERSE, budget, 
+                                              dcIMG, &result);
+
+            printf("%7i %11.2f %12.2f %12.2f %11.1f %14.1e %12i\n", thread,
+                   budget*1e3, result.elapsed*1e3, fmax(0.0, result.elapsed - budget)*1e3,
+                   100.0*result.complete/result.blocks, 
+                   budgetPreviewError(plan, dcIMG, refIMG),
+                   (status == 0? imValidate(srcIMG, idctIMG, 1e-12):status));
+        }
+
+        imDelete(srcIMG, dctIMG, idctIMG);
+        imFree(refIMG);
+        imFree(dcIMG);
+        planDestroy(plan);
     }
-}
\ No newline at end of file
+
+    printf("\n%7s %10s %14s %14s %10s\n", "threads", "full (ms)", "cancelled at %",
+           "stopped (ms)", "done %");
+
+    for (int t = 0; t < threadCount; t++) {
+        int thread = threads[t];
+        dctPlan* plan  = createPlan(thread, width, height);
+        image* srcIMG  = createSource(plan);
+        image* dctIMG  = planAllocateImage(plan, 0);
+        image* idctIMG = planAllocateImage(plan, 0);
+
+        clock_gettime(CLOCK_REALTIME, &start);
+        planExecute(plan, srcIMG, dctIMG, idctIMG);
+        double full = secondsSince(&start);
+
+        // Watch the progress until half the blocks are done
+        long done, total;
+        dctJob* job = planSubmit(plan, srcIMG, dctIMG, idctIMG, 
+                                 PLAN_FORWARD | PLAN_INVERSE, NULL, NULL);
+        while ((done = planJobProgress(job, &total)) < total/2 && !planJobPoll(job)) {
+            struct timespec pause = { 0, 100000 };
+            nanosleep(&pause, NULL);
+        }
+
+        clock_gettime(CLOCK_REALTIME, &start);
+        planJobCancel(job);
+        planJobWait(job);
+        double stopped = secondsSince(&start);
+
+        printf("%7i %10.2f %14.1f %14.3f %10.1f\n", thread, full*1e3, 100.0*done/total,
+               stopped*1e3, 100.0*planJobProgress(job, NULL)/total);
+
+        planJobRelease(job);
+        imDelete(srcIMG, dctIMG, idctIMG);
+        planDestroy(plan);
+    }
+}
@@ -0,0 +1,28 @@
+#include <stdio.h> 
+#include <stdlib.h>
+#include "tcdct.h"
+
+/*
+    Worker process for distributed tiling; connects to a coordinator
+    (e.g. dct-tests with 'TCDCT_DISTRIBUTE' set) and transforms the 
+    tiles it is sent until the coordinator says to quit
+
+    Usage: dct-worker <unix:path | tcp:host:port> [threads]
+*/
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printf("Usage: %s <unix:path | tcp:host:port> [threads]\n", argv[0]);
+        return 1;
+    }
+
+    int totalThreads = (argc < 3? 1 : atoi(argv[2]));
+    int fd           = netConnect(argv[1]);
+    if (fd < 0) {
+        printf("Unable to connect to '%s'\n", argv[1]);
+        return 1;
+    }
+
+    int served = netServe(fd, totalThreads);
+    printf("Served %i tiles\n", served);
+    return (served < 0);
+}
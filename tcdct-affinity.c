@@ -0,0 +1,248 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "tcdct.h"
+
+#ifdef HAVE_LIBNUMA
+#include <numa.h>
+#endif
+
+// Amount of passes over the buffer in affinityBandwidth()
+#define BANDWIDTH_PASSES 4
+
+// Bandwidth measurement structure definition
+// --------------------------
+//
+// cpu     : CPU the measuring thread is pinned to
+// buffer  : Buffer being touched or read
+// bytes   : Size of the buffer in bytes
+// touch   : Non-zero to first-touch the buffer rather than read it
+// seconds : Time spent reading the buffer
+// sink    : Sum of the values read (keeps the reads from being elided)
+//
+typedef struct {
+    int cpu;
+    uint64_t* buffer;
+    size_t bytes;
+    int touch;
+    double seconds;
+    uint64_t sink;
+} bandwidthInfo;
+
+
+/*
+    Return whether or not libnuma is usable on this host
+*/
+static int affinityHasNUMA(void) {
+#ifdef HAVE_LIBNUMA
+    return (numa_available() != -1);
+#else
+    return 0;
+#endif
+}
+
+
+int affinityCPUCount(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count < 1? 1:(int)count);
+}
+
+
+int affinityNodeCount(void) {
+#ifdef HAVE_LIBNUMA
+    if (affinityHasNUMA())
+        return numa_max_node() + 1;
+#endif
+    return 1;
+}
+
+
+int affinityNodeOfCPU(int cpu) {
+#ifdef HAVE_LIBNUMA
+    if (affinityHasNUMA()) {
+        int node = numa_node_of_cpu(cpu);
+        return (node < 0? 0:node);
+    }
+#endif
+    return 0;
+}
+
+
+/*
+    Return the CPU that the 'threadIndex'-th of 'totalThreads' threads
+    should be pinned to;
+
+    CPUs are ordered by node, so that consecutive threads (which work
+    on consecutive row bands) land on the same node and the bands of
+    a node are contiguous in the image
+*/
+int affinityCPUForThread(int threadIndex, int totalThreads) {
+    int totalCPUs = affinityCPUCount();
+    int* cpus     = (int*)malloc(totalCPUs*sizeof(int));
+    int count     = 0, cpu;
+
+    for (int node = 0, nodes = affinityNodeCount(); node < nodes; node++)
+        for (int c = 0; c < totalCPUs; c++)
+            if (affinityNodeOfCPU(c) == node)
+                cpus[count++] = c;
+
+    // A node without any CPUs would leave the list short
+    if (count == 0)
+        for (; count < totalCPUs; count++)
+            cpus[count] = count;
+
+    if (totalThreads <= count)
+        cpu = cpus[(threadIndex*count)/totalThreads];
+
+    else
+        cpu = cpus[threadIndex % count];
+
+    free(cpus);
+    return cpu;
+}
+
+
+/*
+    Pin the calling thread to a single CPU, and prefer allocating
+    from that CPU's node when libnuma is available;
+
+    Returns 0 on success and -1 otherwise
+*/
+int affinityPinCPU(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set) != 0)
+        return -1;
+
+#ifdef HAVE_LIBNUMA
+    if (affinityHasNUMA())
+        numa_set_localalloc();
+#endif
+    return 0;
+}
+
+
+/*
+    Return the first CPU found on a given node (or CPU 0)
+*/
+static int affinityFirstCPU(int node) {
+    for (int c = 0, totalCPUs = affinityCPUCount(); c < totalCPUs; c++)
+        if (affinityNodeOfCPU(c) == node)
+            return c;
+
+    return 0;
+}
+
+
+/*
+    Either first-touch or stream-read a buffer from a pinned thread
+*/
+static void* affinityBandwidthWorker(void* arg) {
+    bandwidthInfo* info = (bandwidthInfo*)arg;
+    size_t count        = info->bytes/sizeof(uint64_t);
+    affinityPinCPU(info->cpu);
+
+    if (info->touch) {
+        for (size_t i = 0; i < count; i++)
+            info->buffer[i] = i;
+
+        return NULL;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    uint64_t sum = 0;
+    for (int pass = 0; pass < BANDWIDTH_PASSES; pass++)
+        for (size_t i = 0; i < count; i++)
+            sum += info->buffer[i];
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    info->seconds = (end.tv_sec - start.tv_sec) + 
+                    (end.tv_nsec - start.tv_nsec) / 1e9;
+    info->sink    = sum;
+    return NULL;
+}
+
+
+/*
+    Measure the read bandwidth (GB/s) of a thread running on 'cpuNode'
+    streaming through 'bytes' of memory placed on 'memNode';
+
+    Placement is done by libnuma when available and otherwise by
+    first-touching the buffer from a thread pinned to 'memNode'.
+    Returns -1.0 if the buffer couldn't be allocated
+*/
+double affinityBandwidth(int cpuNode, int memNode, size_t bytes) {
+    bandwidthInfo info;
+    pthread_t tid;
+    memset(&info, 0, sizeof(bandwidthInfo));
+    info.bytes = bytes;
+
+#ifdef HAVE_LIBNUMA
+    if (affinityHasNUMA())
+        info.buffer = (uint64_t*)numa_alloc_onnode(bytes, memNode);
+    else
+#endif
+        info.buffer = (uint64_t*)malloc(bytes);
+
+    if (info.buffer == NULL)
+        return -1.0;
+
+    // Place the pages by touching them from the memory node
+    info.cpu   = affinityFirstCPU(memNode);
+    info.touch = 1;
+    pthread_create(&tid, NULL, affinityBandwidthWorker, &info);
+    pthread_join(tid, NULL);
+
+    // Then read them back from the CPU node
+    info.cpu   = affinityFirstCPU(cpuNode);
+    info.touch = 0;
+    pthread_create(&tid, NULL, affinityBandwidthWorker, &info);
+    pthread_join(tid, NULL);
+
+#ifdef HAVE_LIBNUMA
+    if (affinityHasNUMA())
+        numa_free(info.buffer, bytes);
+    else
+#endif
+        free(info.buffer);
+
+    if (info.seconds <= 0.0)
+        return -1.0;
+
+    return (double)bytes*BANDWIDTH_PASSES/info.seconds/1e9;
+}
+
+
+/*
+    Print the node topology along with a matrix of the read bandwidth
+    from each node (rows) to memory on each node (columns)
+*/
+void affinityReport(FILE* outFile) {
+    int nodes = affinityNodeCount();
+    size_t bytes = (size_t)256 << 20;
+
+    fprintf(outFile, "NUMA: %s, %i node(s), %i CPU(s)\n",
+            (affinityHasNUMA()? "libnuma":"first-touch only"),
+            nodes, affinityCPUCount());
+
+    fprintf(outFile, "Read bandwidth (GB/s), CPU node x memory node:\n");
+    for (int cpuNode = 0; cpuNode < nodes; cpuNode++) {
+        fprintf(outFile, "  node %i:", cpuNode);
+        for (int memNode = 0; memNode < nodes; memNode++)
+            fprintf(outFile, " %8.2f%s", 
+                    affinityBandwidth(cpuNode, memNode, bytes),
+                    (cpuNode == memNode? " (local) ":" (remote)"));
+
+        fprintf(outFile, "\n");
+    }
+    fprintf(outFile, "\n");
+}
@@ -0,0 +1,380 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tcdct.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+// Coefficient file job structure definition
+// --------------------------
+//
+// dctIMG      : Image of coefficients written or read
+// blockSize   : Size of the blocks, and rows per strip
+// compression : COEF_* of every strip
+// index       : Strip index (of the file being written)
+// strips      : Encoded strips (of the file being written)
+// cf          : File being read
+// fd          : Descriptor of the file being written
+// failed      : Set if any strip couldn't be encoded, written or read
+//
+typedef struct {
+    image* dctIMG;
+    int blockSize;
+    int compression;
+    coefStrip* index;
+    uint8_t** strips;
+    coefFile* cf;
+    int fd;
+    int failed;
+} coefJob;
+
+
+/*
+    Copy the coefficients of block row 'strip' into 'out', block after
+    block, each ordered [x*blockSize + y] like the image's m[x][y]
+*/
+static void coefLayoutStrip(image* im, int strip, int B, double* out) {
+    for (int x = 0; x < im->width; x++) {
+        pixel* column = &im->m[x][strip*B];
+        double* block = &out[(x/B)*B*B + (x%B)*B];
+        for (int y = 0; y < B; y++)
+            block[y] = column[y].i;
+    }
+}
+
+
+/*
+    Copy the coefficients of a strip laid out by coefLayoutStrip() 
+    back into block row 'strip' of an image
+*/
+static void coefUnlayoutStrip(image* im, int strip, int B, const double* in) {
+    for (int x = 0; x < im->width; x++) {
+        pixel* column       = &im->m[x][strip*B];
+        const double* block = &in[(x/B)*B*B + (x%B)*B];
+        for (int y = 0; y < B; y++)
+            column[y].i = block[y];
+    }
+}
+
+
+#ifdef HAVE_ZLIB
+/*
+    Gather byte 'b' of every coefficient into plane 'b', so that the
+    (mostly similar) sign and exponent bytes end up next to each other
+*/
+static void coefShuffle(const uint8_t* in, uint8_t* out, size_t count) {
+    for (size_t i = 0; i < count; i++)
+        for (int b = 0; b < (int)sizeof(double); b++)
+            out[b*count + i] = in[i*sizeof(double) + b];
+}
+
+
+static void coefUnshuffle(const uint8_t* in, uint8_t* out, size_t count) {
+    for (size_t i = 0; i < count; i++)
+        for (int b = 0; b < (int)sizeof(double); b++)
+            out[i*sizeof(double) + b] = in[b*count + i];
+}
+#endif
+
+
+/*
+    Run 'totalTasks' tasks on a pool, or one after another on the 
+    calling thread if there is no pool
+*/
+static void coefRunTasks(threadPool* pool, poolTask task, void* arg, int totalTasks) {
+    if (pool != NULL) {
+        poolRun(pool, task, arg, totalTasks, POOL_DYNAMIC);
+        return;
+    }
+
+    for (int i = 0; i < totalTasks; i++)
+        task(arg, i, 0);
+}
+
+
+/*
+    Lay out and (optionally) compress one strip of the image
+*/
+static void coefEncodeTask(void* arg, int taskIndex, int workerIndex) {
+    coefJob* job   = (coefJob*)arg;
+    int B          = job->blockSize;
+    size_t rawSize = (size_t)job->dctIMG->width*B*sizeof(double);
+    double* raw    = (double*)malloc(rawSize);
+
+    coefLayoutStrip(job->dctIMG, taskIndex, B, raw);
+    job->index[taskIndex].rawSize = rawSize;
+
+    if (job->compression == COEF_RAW) {
+        job->strips[taskIndex]     = (uint8_t*)raw;
+        job->index[taskIndex].size = rawSize;
+        return;
+    }
+
+#ifdef HAVE_ZLIB
+    uint8_t* shuffled = (uint8_t*)malloc(rawSize);
+    uLongf size       = compressBound(rawSize);
+    uint8_t* packed   = (uint8_t*)malloc(size);
+
+    coefShuffle((const uint8_t*)raw, shuffled, rawSize/sizeof(double));
+    if (compress2(packed, &size, shuffled, rawSize, Z_BEST_SPEED) != Z_OK)
+        job->failed = 1;
+
+    job->strips[taskIndex]     = packed;
+    job->index[taskIndex].size = size;
+    free(shuffled);
+#endif
+    free(raw);
+}
+
+
+/*
+    Write one encoded strip at its offset in the file
+*/
+static void coefWriteTask(void* arg, int taskIndex, int workerIndex) {
+    coefJob* job        = (coefJob*)arg;
+    const uint8_t* data = job->strips[taskIndex];
+    size_t left         = job->index[taskIndex].size;
+    off_t offset        = (off_t)job->index[taskIndex].offset;
+
+    while (left > 0) {
+        ssize_t written = pwrite(job->fd, data, left, offset);
+        if (written <= 0) {
+            job->failed = 1;
+            return;
+        }
+
+        data   += written;
+        offset += written;
+        left   -= written;
+    }
+}
+
+
+/*
+    Write the coefficients of 'dctIMG' to a file, one strip per row of
+    blocks, with a header and an index of where every strip is;
+
+    Strips are encoded and written in parallel on 'pool' (or on the 
+    calling thread if it is NULL) and each starts on a cache line, so
+    that raw strips of a mapped file are aligned. The width and height
+    must be multiples of the block size. Returns 0 on success and -1 
+    on failure
+*/
+int coefWrite(image* dctIMG, int blockSize, int compression, 
+              threadPool* pool, const char* fileName) {
+    if (blockSize < 1 || dctIMG->width % blockSize || dctIMG->height % blockSize)
+        return -1;
+
+#ifndef HAVE_ZLIB
+    if (compression == COEF_DEFLATE)
+        return -1;
+#endif
+    if (compression != COEF_RAW && compression != COEF_DEFLATE)
+        return -1;
+
+    coefHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, COEF_MAGIC, sizeof(header.magic));
+    header.version     = COEF_VERSION;
+    header.width       = dctIMG->width;
+    header.height      = dctIMG->height;
+    header.blockSize   = blockSize;
+    header.compression = compression;
+    header.stripCount  = dctIMG->height/blockSize;
+
+    int stripCount = header.stripCount;
+    coefJob job;
+    memset(&job, 0, sizeof(job));
+    job.dctIMG      = dctIMG;
+    job.blockSize   = blockSize;
+    job.compression = compression;
+    job.index       = (coefStrip*)calloc(stripCount, sizeof(coefStrip));
+    job.strips      = (uint8_t**)calloc(stripCount, sizeof(uint8_t*));
+
+    coefRunTasks(pool, coefEncodeTask, &job, stripCount);
+
+    // Place the strips one after another once their sizes are known
+    uint64_t offset = sizeof(coefHeader) + stripCount*sizeof(coefStrip);
+    for (int s = 0; s < stripCount; s++) {
+        offset              = (offset + CACHE_LINE - 1)/CACHE_LINE*CACHE_LINE;
+        job.index[s].offset = offset;
+        offset             += job.index[s].size;
+    }
+
+    job.fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (job.fd < 0)
+        job.failed = 1;
+
+    else {
+        if (pwrite(job.fd, &header, sizeof(header), 0) != sizeof(header) ||
+            pwrite(job.fd, job.index, stripCount*sizeof(coefStrip), sizeof(header))
+                                   != (ssize_t)(stripCount*sizeof(coefStrip)))
+            job.failed = 1;
+
+        if (!job.failed)
+            coefRunTasks(pool, coefWriteTask, &job, stripCount);
+
+        if (close(job.fd) != 0)
+            job.failed = 1;
+    }
+
+    for (int s = 0; s < stripCount; s++)
+        free(job.strips[s]);
+
+    free(job.strips);
+    free(job.index);
+    return (job.failed? -1:0);
+}
+
+
+/*
+    Map a coefficient file into memory and check its header and index;
+
+    Returns NULL if the file can't be mapped or isn't valid
+*/
+coefFile* coefOpen(const char* fileName) {
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(coefHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return NULL;
+
+    coefFile* cf = (coefFile*)malloc(sizeof(coefFile));
+    cf->data     = (const uint8_t*)data;
+    cf->size     = st.st_size;
+    cf->header   = (const coefHeader*)data;
+    cf->index    = (const coefStrip*)(cf->data + sizeof(coefHeader));
+
+    const coefHeader* h = cf->header;
+    int valid = (memcmp(h->magic, COEF_MAGIC, sizeof(h->magic)) == 0 &&
+                 h->version == COEF_VERSION && h->blockSize > 0 &&
+                 h->stripCount == h->height/h->blockSize &&
+                 sizeof(coefHeader) + h->stripCount*sizeof(coefStrip) <= cf->size);
+
+    for (uint32_t s = 0; valid && s < h->stripCount; s++)
+        valid = (cf->index[s].offset + cf->index[s].size <= cf->size &&
+                 cf->index[s].rawSize == (uint64_t)h->width*h->blockSize*sizeof(double));
+
+    if (!valid) {
+        coefClose(cf);
+        return NULL;
+    }
+    return cf;
+}
+
+
+/*
+    Return the coefficients of a strip straight from the mapping (laid
+    out block after block, each ordered [x*blockSize + y]), or NULL if 
+    the strip is compressed or doesn't exist
+*/
+const double* coefStripData(coefFile* cf, int strip) {
+    if (strip < 0 || strip >= (int)cf->header->stripCount || 
+        cf->header->compression != COEF_RAW)
+        return NULL;
+
+    return (const double*)(cf->data + cf->index[strip].offset);
+}
+
+
+/*
+    Decode a single strip into 'out' (width*blockSize doubles, laid out
+    as by coefStripData()) without touching any other strip;
+
+    Returns 0 on success and -1 on failure
+*/
+int coefReadStrip(coefFile* cf, int strip, double* out) {
+    if (strip < 0 || strip >= (int)cf->header->stripCount)
+        return -1;
+
+    const coefStrip* entry = &cf->index[strip];
+    const uint8_t* data    = cf->data + entry->offset;
+
+    if (cf->header->compression == COEF_RAW) {
+        memcpy(out, data, entry->rawSize);
+        return 0;
+    }
+
+#ifdef HAVE_ZLIB
+    if (cf->header->compression == COEF_DEFLATE) {
+        uint8_t* shuffled = (uint8_t*)malloc(entry->rawSize);
+        uLongf size       = entry->rawSize;
+        int status        = uncompress(shuffled, &size, data, entry->size);
+
+        if (status == Z_OK && size == entry->rawSize)
+            coefUnshuffle(shuffled, (uint8_t*)out, size/sizeof(double));
+
+        free(shuffled);
+        return (status == Z_OK && size == entry->rawSize? 0:-1);
+    }
+#endif
+    return -1;
+}
+
+
+/*
+    Decode one strip of the file into its block row of the image
+*/
+static void coefReadTask(void* arg, int taskIndex, int workerIndex) {
+    coefJob* job      = (coefJob*)arg;
+    int B             = job->blockSize;
+    const double* raw = coefStripData(job->cf, taskIndex);
+
+    if (raw != NULL) {
+        coefUnlayoutStrip(job->dctIMG, taskIndex, B, raw);
+        return;
+    }
+
+    double* decoded = (double*)malloc(job->cf->index[taskIndex].rawSize);
+    if (coefReadStrip(job->cf, taskIndex, decoded) == 0)
+        coefUnlayoutStrip(job->dctIMG, taskIndex, B, decoded);
+
+    else
+        job->failed = 1;
+
+    free(decoded);
+}
+
+
+/*
+    Decode every strip of a file into an image (at least as large as
+    the file's coefficients) in parallel on 'pool', or on the calling
+    thread if it is NULL;
+
+    Returns 0 on success and -1 on failure
+*/
+int coefRead(coefFile* cf, image* dctIMG, threadPool* pool) {
+    if (dctIMG->width != (int)cf->header->width || 
+        dctIMG->height < (int)cf->header->height)
+        return -1;
+
+    coefJob job;
+    memset(&job, 0, sizeof(job));
+    job.dctIMG    = dctIMG;
+    job.blockSize = cf->header->blockSize;
+    job.cf        = cf;
+
+    coefRunTasks(pool, coefReadTask, &job, cf->header->stripCount);
+    return (job.failed? -1:0);
+}
+
+
+void coefClose(coefFile* cf) {
+    munmap((void*)cf->data, cf->size);
+    free(cf);
+}
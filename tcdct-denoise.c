@@ -0,0 +1,381 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "tcdct.h"
+
+#if defined(__x86_64__)
+#define DENOISE_HAVE_AVX2 1
+#endif
+
+// Rows of window starts per band of planDenoise(), in blocks; bands
+// are at least a block high, so those run at once never overlap
+#define DENOISE_BAND 4
+
+// Sliding-window denoise structure definition
+// --------------------------
+//
+// plan      : Plan whose block size, basis and workers are used
+// srcIMG    : Noisy image
+// threshold : Coefficients smaller than it (in magnitude) are zeroed
+// startsX   : Start of every window along the width, on the stride
+//             and at the last position a whole window fits
+// startsY   : Likewise along the height
+// countX    : Amount of window starts along the width
+// countY    : Amount of window starts along the height
+// firstY    : Index of the first window start of every band (and one
+//             past the last, at the end)
+// bands     : Amount of bands
+// phase     : Parity of the bands being run (0 or 1)
+// rows      : Rows of a band's accumulators (its pixel rows plus the
+//             last window's overhang)
+// rowT      : Per-worker transforms of every column of a window row
+// accum     : Per-worker sums of weighted pixels, then weights, of the
+//             band being run (column-major, 'rows' per column)
+// sum       : Sums of weighted pixels of the whole image
+// weight    : Sums of weights of the whole image
+//
+typedef struct {
+    dctPlan* plan;
+    image* srcIMG;
+    double threshold;
+    int* startsX;
+    int* startsY;
+    int countX;
+    int countY;
+    int* firstY;
+    int bands;
+    int phase;
+    int rows;
+    double* rowT;
+    double* accum;
+    double* sum;
+    double* weight;
+} denoiseRun;
+
+
+/*
+    Fill in the starts of windows of 'B' pixels over 'size' pixels at
+    'stride', adding the last position when the stride skips it so the
+    windows reach every pixel; returns the amount of starts
+*/
+static int denoiseStarts(int* starts, int size, int B, int stride) {
+    int count = 0;
+    for (int s = 0; s + B <= size; s += stride)
+        starts[count++] = s;
+
+    if (count == 0 || starts[count - 1] != size - B)
+        starts[count++] = size - B;
+
+    return count;
+}
+
+
+/*
+    Denoise one band of window rows on a worker into its accumulators,
+    then add them into the image's sums;
+
+    Every window starting on a row shares the 1-D transforms of the
+    columns (along y) under it, so those are done once per column and
+    window row, leaving each window only the transform across its
+    columns. The thresholded coefficients are reconstructed and added
+    in, weighted by 1 over the amount of coefficients kept, so that
+    flat windows (likely pure noise) count the most. Every 1-D
+    transform is split into even and odd halves over the symmetric
+    sums and differences of its inputs (C[u][B-1-x] = (-1)^u C[u][x]),
+    where odd block sizes add their middle input to the even half only
+    (C[u][B/2] = 0 for odd u), and the block size is a constant for
+    the sizes in common use
+*/
+static inline __attribute__((always_inline))
+void denoiseBand(denoiseRun* run, int taskIndex, int workerIndex, const int B) {
+    dctPlan* plan   = run->plan;
+    int W           = plan->width;
+    int h           = B/2;
+    int hs          = B - h;
+    const double* C = plan->basis;
+    int band        = 2*taskIndex + run->phase;
+    int y0          = run->startsY[run->firstY[band]];
+    int rows        = run->rows;
+    double T        = run->threshold;
+
+    double* rowT  = run->rowT  + (size_t)workerIndex*W*B;
+    double* accum = run->accum + (size_t)workerIndex*2*W*rows;
+    double* aSum  = accum;
+    double* aWt   = accum + (size_t)W*rows;
+    memset(accum, 0, 2*(size_t)W*rows*sizeof(double));
+
+    double X[PLAN_MAX_BLOCK*PLAN_MAX_BLOCK];
+    double E[PLAN_MAX_BLOCK*PLAN_MAX_BLOCK];
+    double tmp[PLAN_MAX_BLOCK*PLAN_MAX_BLOCK];
+
+    int last = y0;
+    for (int wy = run->firstY[band]; wy < run->firstY[band + 1]; wy++) {
+        int y = run->startsY[wy];
+        last  = y;
+
+        // rowT[x][v] = sum_y C[v][y] P[x][y] for every column under the row
+        for (int x = 0; x < W; x++) {
+            const pixel* column = &run->srcIMG->m[x][y];
+            double* out         = &rowT[x*B];
+            double sum[PLAN_MAX_BLOCK/2 + 1], diff[PLAN_MAX_BLOCK/2];
+            for (int k = 0; k < h; k++) {
+                sum[k]  = column[k].i + column[B - 1 - k].i;
+                diff[k] = column[k].i - column[B - 1 - k].i;
+            }
+            if (B % 2)
+                sum[h] = column[h].i;
+
+            for (int v = 0; v < B; v++) {
+                const double* in = (v % 2? diff:sum);
+                int n            = (v % 2? h:hs);
+                double s = 0.0;
+                for (int k = 0; k < n; k++)
+                    s += C[v*B + k] * in[k];
+                out[v] = s;
+            }
+        }
+
+        for (int wx = 0; wx < run->countX; wx++) {
+            int x = run->startsX[wx];
+
+            // Symmetric sums (E[k], then the middle column) and
+            // differences (E[hs + k]) of the columns
+            for (int k = 0; k < h; k++) {
+                const double* R0 = &rowT[(x + k)*B];
+                const double* R1 = &rowT[(x + B - 1 - k)*B];
+                for (int v = 0; v < B; v++) {
+                    E[k*B + v]        = R0[v] + R1[v];
+                    E[(hs + k)*B + v] = R0[v] - R1[v];
+                }
+            }
+            if (B % 2)
+                memcpy(&E[h*B], &rowT[(x + h)*B], B*sizeof(double));
+
+            // X[u][v] = sum_x C[u][x] rowT[x0 + x][v]
+            for (int u = 0; u < B; u++) {
+                const double* in = &E[(u % 2? hs:0)*B];
+                double* Xu       = &X[u*B];
+                int n            = (u % 2? h:hs);
+                for (int v = 0; v < B; v++)
+                    Xu[v] = C[u*B] * in[v];
+
+                for (int k = 1; k < n; k++) {
+                    double c = C[u*B + k];
+                    for (int v = 0; v < B; v++)
+                        Xu[v] += c * in[k*B + v];
+                }
+            }
+
+            // Hard threshold every coefficient but the DC term
+            int kept = 0;
+            double dc = X[0];
+            for (int k = 0; k < B*B; k++) {
+                int keep = (fabs(X[k]) >= T);
+                X[k]     = (keep? X[k]:0.0);
+                kept    += keep;
+            }
+            if (fabs(dc) < T)
+                X[0] = dc, kept++;
+            double w = 1.0/kept;
+
+            // tmp[x][v] = sum_u C[u][x] X[u][v], even and odd u apart
+            for (int k = 0; k < h; k++) {
+                double e[PLAN_MAX_BLOCK], o[PLAN_MAX_BLOCK];
+                for (int v = 0; v < B; v++) {
+                    e[v] = C[k] * X[v];
+                    o[v] = C[B + k] * X[B + v];
+                }
+
+                for (int u = 2; u + 1 < B; u += 2) {
+                    double ce = C[u*B + k], co = C[(u + 1)*B + k];
+                    for (int v = 0; v < B; v++) {
+                        e[v] += ce * X[u*B + v];
+                        o[v] += co * X[(u + 1)*B + v];
+                    }
+                }
+
+                if (B % 2) {
+                    double ce = C[(B - 1)*B + k];
+                    for (int v = 0; v < B; v++)
+                        e[v] += ce * X[(B - 1)*B + v];
+                }
+
+                for (int v = 0; v < B; v++) {
+                    tmp[k*B + v]           = e[v] + o[v];
+                    tmp[(B - 1 - k)*B + v] = e[v] - o[v];
+                }
+            }
+
+            // The middle row of odd block sizes only has even terms
+            if (B % 2) {
+                for (int v = 0; v < B; v++)
+                    tmp[h*B + v] = C[h] * X[v];
+
+                for (int u = 2; u < B; u += 2)
+                    for (int v = 0; v < B; v++)
+                        tmp[h*B + v] += C[u*B + h] * X[u*B + v];
+            }
+
+            // P[x][y] = sum_v tmp[x][v] C[v][y], accumulated with its weight
+            for (int k = 0; k < B; k++) {
+                double* s  = &aSum[(size_t)(x + k)*rows + (y - y0)];
+                double* ws = &aWt[(size_t)(x + k)*rows + (y - y0)];
+                const double* t = &tmp[k*B];
+                for (int j = 0; j < h; j++) {
+                    double e = t[0] * C[j], o = t[1] * C[B + j];
+                    for (int v = 2; v + 1 < B; v += 2) {
+                        e += t[v] * C[v*B + j];
+                        o += t[v + 1] * C[(v + 1)*B + j];
+                    }
+                    if (B % 2)
+                        e += t[B - 1] * C[(B - 1)*B + j];
+
+                    s[j]         += w * (e + o);
+                    s[B - 1 - j] += w * (e - o);
+                }
+
+                if (B % 2) {
+                    double e = 0.0;
+                    for (int v = 0; v < B; v += 2)
+                        e += t[v] * C[v*B + h];
+                    s[h] += w * e;
+                }
+
+                for (int j = 0; j < B; j++)
+                    ws[j] += w;
+            }
+        }
+    }
+
+    // No band running alongside this one reaches the same rows
+    int height = last + B - y0;
+    for (int x = 0; x < W; x++) {
+        double* s  = &run->sum[(size_t)x*plan->height + y0];
+        double* ws = &run->weight[(size_t)x*plan->height + y0];
+        for (int y = 0; y < height; y++) {
+            s[y]  += aSum[(size_t)x*rows + y];
+            ws[y] += aWt[(size_t)x*rows + y];
+        }
+    }
+}
+
+
+/*
+    Run denoiseBand() with the block size known at compile time for
+    the common ones, and again built for AVX2 and FMA
+*/
+static void denoiseBandGeneric(void* arg, int taskIndex, int workerIndex) {
+    denoiseRun* run = (denoiseRun*)arg;
+    switch (run->plan->blockSize) {
+        case 4:  denoiseBand(run, taskIndex, workerIndex, 4);  break;
+        case 8:  denoiseBand(run, taskIndex, workerIndex, 8);  break;
+        case 16: denoiseBand(run, taskIndex, workerIndex, 16); break;
+        default: denoiseBand(run, taskIndex, workerIndex, run->plan->blockSize);
+    }
+}
+
+#ifdef DENOISE_HAVE_AVX2
+__attribute__((target("avx2,fma")))
+static void denoiseBandAVX2(void* arg, int taskIndex, int workerIndex) {
+    denoiseRun* run = (denoiseRun*)arg;
+    switch (run->plan->blockSize) {
+        case 4:  denoiseBand(run, taskIndex, workerIndex, 4);  break;
+        case 8:  denoiseBand(run, taskIndex, workerIndex, 8);  break;
+        case 16: denoiseBand(run, taskIndex, workerIndex, 16); break;
+        default: denoiseBand(run, taskIndex, workerIndex, run->plan->blockSize);
+    }
+}
+#endif
+
+
+/*
+    Divide the sums of one column of the image by their weights
+*/
+static void denoiseColumnTask(void* arg, int taskIndex, int workerIndex) {
+    void** args      = (void**)arg;
+    denoiseRun* run  = (denoiseRun*)args[0];
+    image* outIMG    = (image*)args[1];
+    int H            = run->plan->height;
+
+    for (int y = 0; y < H; y++)
+        outIMG->m[taskIndex][y].i = run->sum[(size_t)taskIndex*H + y] /
+                                    run->weight[(size_t)taskIndex*H + y];
+}
+
+
+/*
+    Denoise 'srcIMG' into 'outIMG' by hard thresholding the DCT of
+    every (blockSize x blockSize) window at 'stride' pixels apart,
+    overlapping unless the stride is the block size, and averaging
+    the reconstructions of the windows covering each pixel;
+
+    The windows are done a band of window rows at a time, bands of
+    even and then of odd index being split over the plan's workers so
+    that no two of them write to the same rows, each into accumulators
+    of its own worker. A threshold of about 3 times the deviation of
+    the noise works well. Only the first 'height' rows of the images
+    are used, and the windows are always transformed in double
+    precision. Returns 0 on success and -1 on failure
+*/
+int planDenoise(dctPlan* plan, image* srcIMG, image* outIMG, int stride,
+                double threshold) {
+    int B = plan->blockSize;
+    int W = plan->width, H = plan->height;
+    if (stride < 1 || stride > B || H < B ||
+        srcIMG->width != W || srcIMG->height < H ||
+        outIMG->width != W || outIMG->height < H)
+        return -1;
+
+    denoiseRun run;
+    run.plan      = plan;
+    run.srcIMG    = srcIMG;
+    run.threshold = threshold;
+    run.startsX   = (int*)malloc((W/stride + 2)*sizeof(int));
+    run.startsY   = (int*)malloc((H/stride + 2)*sizeof(int));
+    run.countX    = denoiseStarts(run.startsX, W, B, stride);
+    run.countY    = denoiseStarts(run.startsY, H, B, stride);
+
+    // Split the window rows into bands of DENOISE_BAND blocks of rows
+    int bandRows = DENOISE_BAND*B;
+    run.firstY   = (int*)malloc((H/bandRows + 2)*sizeof(int));
+    run.bands    = 0;
+    for (int wy = 0; wy < run.countY; wy++)
+        if (wy == 0 || run.startsY[wy]/bandRows != run.startsY[wy - 1]/bandRows)
+            run.firstY[run.bands++] = wy;
+    run.firstY[run.bands] = run.countY;
+    run.rows = bandRows + B;
+
+    int workers = plan->totalThreads;
+    run.rowT    = (double*)malloc((size_t)workers*W*B*sizeof(double));
+    run.accum   = (double*)malloc((size_t)workers*2*W*run.rows*sizeof(double));
+    run.sum     = (double*)calloc((size_t)W*H, sizeof(double));
+    run.weight  = (double*)calloc((size_t)W*H, sizeof(double));
+
+    int status = 0;
+    if (run.rowT == NULL || run.accum == NULL || run.sum == NULL || run.weight == NULL)
+        status = -1;
+
+    else {
+        poolTask task = denoiseBandGeneric;
+#ifdef DENOISE_HAVE_AVX2
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            task = denoiseBandAVX2;
+#endif
+
+        for (run.phase = 0; run.phase < 2; run.phase++)
+            poolRun(plan->pool, task, &run, (run.bands + 1 - run.phase)/2, POOL_DYNAMIC);
+
+        void* args[2] = { &run, outIMG };
+        poolRun(plan->pool, denoiseColumnTask, args, W, POOL_STATIC);
+    }
+
+    free(run.startsX);
+    free(run.startsY);
+    free(run.firstY);
+    free(run.rowT);
+    free(run.accum);
+    free(run.sum);
+    free(run.weight);
+    return status;
+}
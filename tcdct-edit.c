@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "tcdct.h"
+
+// Compressed-domain edit structure definition
+// --------------------------
+//
+// plan      : Plan whose coefficients are edited
+// dctIMG    : Image of coefficients
+// outIMG    : Image the edited coefficients are written to
+// transpose : Swap the sides of the image (and of every block)
+// flipX     : Mirror the columns of blocks after transposing
+// flipY     : Mirror the rows of blocks after transposing
+// bx0/by0   : First block (column, row) of 'dctIMG' to copy
+// columns   : Amount of block columns to copy
+// blocksX   : Block columns of the edited image
+// blocksY   : Block rows of the edited image
+//
+typedef struct {
+    dctPlan* plan;
+    image* dctIMG;
+    image* outIMG;
+    int transpose;
+    int flipX;
+    int flipY;
+    int bx0;
+    int by0;
+    int columns;
+    int blocksX;
+    int blocksY;
+} editRun;
+
+
+// Transposing and flipping of each edit, in the order of EDIT_*
+static const int editTranspose[EDIT_COUNT] = { 0, 0, 1, 0, 1, 1, 1 };
+static const int editFlipX[EDIT_COUNT]     = { 1, 0, 1, 1, 0, 0, 1 };
+static const int editFlipY[EDIT_COUNT]     = { 0, 1, 0, 1, 1, 0, 1 };
+
+static const char* editNames[EDIT_COUNT] = {
+    "flip-h", "flip-v", "rotate-90", "rotate-180", "rotate-270",
+    "transpose", "transverse"
+};
+
+
+/*
+    Move one row of blocks to where an edit puts them;
+
+    Mirroring the pixels of a block flips the sign of its odd
+    frequencies along that axis, since C[u][B-1-x] = (-1)^u C[u][x],
+    and transposing its pixels transposes its coefficients, so every
+    coefficient is only moved and possibly negated
+*/
+static void editRowTask(void* arg, int taskIndex, int workerIndex) {
+    editRun* run = (editRun*)arg;
+    int B        = run->plan->blockSize;
+    int by       = taskIndex;
+
+    for (int bx = 0; bx < run->blocksX; bx++) {
+        int tx = (run->transpose? by:bx);
+        int ty = (run->transpose? bx:by);
+        if (run->flipX)
+            tx = (run->transpose? run->blocksY:run->blocksX) - 1 - tx;
+        if (run->flipY)
+            ty = (run->transpose? run->blocksX:run->blocksY) - 1 - ty;
+
+        for (int u = 0; u < B; u++) {
+            pixel* column = &run->dctIMG->m[bx*B + u][by*B];
+            for (int v = 0; v < B; v++) {
+                int tu = (run->transpose? v:u);
+                int tv = (run->transpose? u:v);
+                int negate = (run->flipX & tu) ^ (run->flipY & tv);
+                run->outIMG->m[tx*B + tu][ty*B + tv].i = (negate? -column[v].i:column[v].i);
+            }
+        }
+    }
+}
+
+
+/*
+    Apply a lossless EDIT_* flip, rotation or transposition to the
+    coefficients of 'dctIMG', writing them into 'outIMG' without any
+    inverse or forward transform;
+
+    The edit works on the whole (width x paddedHeight) blocks of the
+    plan, so rows padded onto the bottom of an image end up on the
+    edge the edit moves the bottom to. 'outIMG' must be at least as
+    large as the edited image, with its sides swapped for rotations
+    by a quarter turn and transpositions (planEditSwapsSides()), and
+    can't be 'dctIMG'. Returns 0 on success and -1 on failure
+*/
+int planCoefTransform(dctPlan* plan, image* dctIMG, image* outIMG, int edit) {
+    if (edit < 0 || edit >= EDIT_COUNT || dctIMG == outIMG ||
+        dctIMG->width != plan->width || dctIMG->height < plan->paddedHeight)
+        return -1;
+
+    int swaps  = planEditSwapsSides(edit);
+    int width  = (swaps? plan->paddedHeight:plan->width);
+    int height = (swaps? plan->width:plan->paddedHeight);
+    if (outIMG->width < width || outIMG->height < height)
+        return -1;
+
+    editRun run;
+    run.plan      = plan;
+    run.dctIMG    = dctIMG;
+    run.outIMG    = outIMG;
+    run.transpose = editTranspose[edit];
+    run.flipX     = editFlipX[edit];
+    run.flipY     = editFlipY[edit];
+    run.blocksX   = plan->width/plan->blockSize;
+    run.blocksY   = plan->paddedHeight/plan->blockSize;
+
+    poolRun(plan->pool, editRowTask, &run, run.blocksY, POOL_DYNAMIC);
+    return 0;
+}
+
+
+/*
+    Copy one row of blocks out of the cropped rectangle
+*/
+static void cropRowTask(void* arg, int taskIndex, int workerIndex) {
+    editRun* run = (editRun*)arg;
+    int B        = run->plan->blockSize;
+    int y        = taskIndex*B;
+
+    for (int x = 0; x < run->columns*B; x++)
+        memcpy(&run->outIMG->m[x][y], &run->dctIMG->m[run->bx0*B + x][run->by0*B + y],
+               B*sizeof(pixel));
+}
+
+
+/*
+    Crop the coefficients of 'dctIMG' to the blocks overlapping a
+    rectangle (in pixels), writing them into the top-left of 'outIMG';
+
+    As with jpegtran, the rectangle grows out to whole blocks, its top
+    left corner moving up and left to the block it falls in. 'outIMG'
+    must be at least as large as the grown rectangle, whose size is
+    ((x + width) rounded up - x rounded down) wide and likewise high.
+    Returns 0 on success and -1 on failure (or an empty rectangle)
+*/
+int planCoefCrop(dctPlan* plan, image* dctIMG, image* outIMG, const dctRect* rect) {
+    int B = plan->blockSize;
+    if (dctIMG == outIMG || dctIMG->width != plan->width ||
+        dctIMG->height < plan->paddedHeight)
+        return -1;
+
+    // Clip the rectangle to the image and grow it to whole blocks
+    int x0 = (rect->x > 0? rect->x:0);
+    int y0 = (rect->y > 0? rect->y:0);
+    int x1 = rect->x + rect->width;
+    int y1 = rect->y + rect->height;
+    if (x1 > plan->width)          x1 = plan->width;
+    if (y1 > plan->paddedHeight)   y1 = plan->paddedHeight;
+    if (x1 <= x0 || y1 <= y0)
+        return -1;
+
+    editRun run;
+    run.plan    = plan;
+    run.dctIMG  = dctIMG;
+    run.outIMG  = outIMG;
+    run.bx0     = x0/B;
+    run.by0     = y0/B;
+    run.columns = (x1 + B - 1)/B - run.bx0;
+    run.blocksY = (y1 + B - 1)/B - run.by0;
+    if (outIMG->width < run.columns*B || outIMG->height < run.blocksY*B)
+        return -1;
+
+    poolRun(plan->pool, cropRowTask, &run, run.blocksY, POOL_DYNAMIC);
+    return 0;
+}
+
+
+// Coefficient-domain downscale structure definition
+// --------------------------
+//
+// plan    : Plan whose coefficients are downscaled
+// dctIMG  : Image of coefficients
+// outIMG  : Image of the coefficients at half of each side
+// M       : M0, mapping the coefficients of the first block of a pair
+//           to the coefficients of its half of the downscaled block,
+//           M0[k][u] (the second block's M1 is F M0 F, F negating the
+//           odd frequencies, as the pair mirrors onto itself)
+// blocksX : Block columns of 'dctIMG'
+// blocksY : Block rows of 'dctIMG'
+//
+typedef struct {
+    dctPlan* plan;
+    image* dctIMG;
+    image* outIMG;
+    double M[PLAN_MAX_BLOCK*PLAN_MAX_BLOCK];
+    int blocksX;
+    int blocksY;
+} downscaleRun;
+
+
+/*
+    Compute one row of downscaled blocks, each out of the (2 x 2)
+    blocks it covers;
+
+    Averaging pairs of pixels along one side is linear, so in the
+    coefficient domain the two blocks of a pair map to the downscaled
+    block as T = M0 X0 + M1 X1, with M_i = C E_i D C^T (D averaging
+    pairs and E_i placing them in half i of the block). Since M1 is 
+    F M0 F, the even rows of T are M0 (X0 + F X1) and the odd ones
+    M0 (X0 - F X1), halving the work; both sides together give 
+    Y = sum_ij M_i X_ij M_j^T, done one side at a time. A missing last
+    block of a pair is the first one mirrored, i.e. F X0, so that 
+    F X1 is simply X0
+*/
+static void downscaleRowTask(void* arg, int taskIndex, int workerIndex) {
+    downscaleRun* run = (downscaleRun*)arg;
+    int B             = run->plan->blockSize;
+    const double* M   = run->M;
+    int oy            = taskIndex;
+
+    double X[PLAN_MAX_BLOCK*PLAN_MAX_BLOCK];
+    double even[PLAN_MAX_BLOCK*PLAN_MAX_BLOCK];
+    double odd[PLAN_MAX_BLOCK*PLAN_MAX_BLOCK];
+    double T[2][PLAN_MAX_BLOCK*PLAN_MAX_BLOCK];
+
+    for (int ox = 0; ox < (run->blocksX + 1)/2; ox++) {
+        int bx = 2*ox;
+
+        // T_j = M0 X0j + M1 X1j for each row j of the pair of rows
+        for (int j = 0; j < 2; j++) {
+            int by = 2*oy + j;
+            if (by >= run->blocksY) {
+                for (int k = 0; k < B; k++)
+                    for (int v = 0; v < B; v++)
+                        T[1][k*B + v] = (v % 2? -T[0][k*B + v]:T[0][k*B + v]);
+                break;
+            }
+
+            // even = X0 + F X1, odd = X0 - F X1
+            for (int u = 0; u < B; u++) {
+                pixel* first = &run->dctIMG->m[bx*B + u][by*B];
+                for (int v = 0; v < B; v++)
+                    even[u*B + v] = odd[u*B + v] = first[v].i;
+            }
+
+            if (bx + 1 < run->blocksX) {
+                for (int u = 0; u < B; u++) {
+                    pixel* second = &run->dctIMG->m[(bx + 1)*B + u][by*B];
+                    double sign   = (u % 2? -1.0:1.0);
+                    for (int v = 0; v < B; v++) {
+                        even[u*B + v] += sign*second[v].i;
+                        odd[u*B + v]  -= sign*second[v].i;
+                    }
+                }
+            }
+
+            else {
+                for (int u = 0; u < B*B; u++) {
+                    even[u] *= 2.0;
+                    odd[u]   = 0.0;
+                }
+            }
+
+            // T_j[k][v] = sum_u M0[k][u] (k even? even:odd)[u][v]
+            for (int k = 0; k < B; k++) {
+                const double* Xk = (k % 2? odd:even);
+                double* Tk       = &T[j][k*B];
+                for (int v = 0; v < B; v++)
+                    Tk[v] = 0.0;
+
+                for (int u = 0; u < B; u++) {
+                    double m = M[k*B + u];
+                    for (int v = 0; v < B; v++)
+                        Tk[v] += m * Xk[u*B + v];
+                }
+            }
+        }
+
+        // Y[k][l] = sum_v M0[l][v] (T0[k][v] +/- (-1)^v T1[k][v]), the
+        // sign following the parity of l as above
+        for (int k = 0; k < B; k++) {
+            for (int v = 0; v < B; v++) {
+                double t1 = (v % 2? -T[1][k*B + v]:T[1][k*B + v]);
+                X[v]      = T[0][k*B + v] + t1;
+                X[B + v]  = T[0][k*B + v] - t1;
+            }
+
+            pixel* column = &run->outIMG->m[ox*B + k][oy*B];
+            for (int l = 0; l < B; l++) {
+                const double* Tl = &X[(l % 2)*B];
+                double sum = 0.0;
+                for (int v = 0; v < B; v++)
+                    sum += M[l*B + v] * Tl[v];
+                column[l].i = sum;
+            }
+        }
+    }
+}
+
+
+/*
+    Downscale the coefficients of 'dctIMG' to half of each side,
+    writing the coefficients of the downscaled image into 'outIMG'
+    without any inverse or forward transform;
+
+    Every (2 x 2) blocks become one block of the average of each
+    (2 x 2) pixels, exactly what the inverse transform, averaging and
+    a forward transform would give. An odd last column or row of
+    blocks is mirrored onto itself. 'outIMG' must be at least as large
+    as the block columns and rows of the plan halved and rounded up,
+    times the block size. Returns 0 on success and -1 on failure
+*/
+int planCoefDownscale(dctPlan* plan, image* dctIMG, image* outIMG) {
+    int B = plan->blockSize;
+    if (B % 2 || dctIMG == outIMG || dctIMG->width != plan->width ||
+        dctIMG->height < plan->paddedHeight)
+        return -1;
+
+    downscaleRun run;
+    run.plan    = plan;
+    run.dctIMG  = dctIMG;
+    run.outIMG  = outIMG;
+    run.blocksX = plan->width/B;
+    run.blocksY = plan->paddedHeight/B;
+    if (outIMG->width < (run.blocksX + 1)/2*B ||
+        outIMG->height < (run.blocksY + 1)/2*B)
+        return -1;
+
+    // M0[k][u] = sum_x' C[k][x'] * (C[u][2x'] + C[u][2x' + 1])/2
+    double C[PLAN_MAX_BLOCK*PLAN_MAX_BLOCK];
+    for (int u = 0; u < B; u++) {
+        double s = (u == 0? sqrt(1.0/B):sqrt(2.0/B));
+        for (int x = 0; x < B; x++)
+            C[u*B + x] = s * cos((2.0*x + 1.0) * u * M_PI/(2.0*B));
+    }
+
+    for (int k = 0; k < B; k++)
+        for (int u = 0; u < B; u++) {
+            double sum = 0.0;
+            for (int x = 0; x < B/2; x++)
+                sum += C[k*B + x] * 0.5*(C[u*B + 2*x] + C[u*B + 2*x + 1]);
+            run.M[k*B + u] = sum;
+        }
+
+    poolRun(plan->pool, downscaleRowTask, &run, (run.blocksY + 1)/2, POOL_DYNAMIC);
+    return 0;
+}
+
+
+/*
+    Return whether an edit swaps the width and height of an image
+*/
+int planEditSwapsSides(int edit) {
+    return (edit >= 0 && edit < EDIT_COUNT && editTranspose[edit]);
+}
+
+
+/*
+    Return the name of an edit
+*/
+const char* planEditName(int edit) {
+    return (edit >= 0 && edit < EDIT_COUNT? editNames[edit]:"unknown");
+}
@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "tcdct.h"
+
+// Columns of an image generated per task
+#define GEN_TILE 32
+
+// Octaves summed for GEN_NATURAL, the coarsest with cells of
+// (1 << GEN_OCTAVES) pixels
+#define GEN_OCTAVES 8
+
+// Streams of the generator, so that each content mode (and each 
+// octave of GEN_NATURAL) draws from independent counters
+#define STREAM_NOISE    0
+#define STREAM_GRADIENT 1
+#define STREAM_NATURAL  2
+#define STREAM_TEXT     (STREAM_NATURAL + GEN_OCTAVES + 1)
+
+// Layout of the page of GEN_TEXT, in pixels; 5x7 glyphs in the 8x16
+// cells of a console font, so a letter looks the same wherever it is
+#define TEXT_MARGIN  24
+#define TEXT_GLYPHS  26
+#define TEXT_ADVANCE 8
+#define TEXT_LINE    16
+
+// Generation structure definition
+// --------------------------
+//
+// im     : Image being generated
+// height : Amount of rows generated (the rest are zeroed)
+// seed   : Key of the generator
+// mode   : GEN_* content
+//
+typedef struct {
+    image* im;
+    int height;
+    uint64_t seed;
+    int mode;
+} genRun;
+
+
+/*
+    Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy
+    as 1, 2, 3"); maps a 128-bit counter and 64-bit key to 128 random
+    bits, so any pixel can be generated on its own from its position
+*/
+static inline void genPhilox(uint32_t ctr[4], uint64_t seed) {
+    uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+
+    for (int round = 0; round < 10; round++) {
+        uint64_t p0 = (uint64_t)0xD2511F53u * ctr[0];
+        uint64_t p1 = (uint64_t)0xCD9E8D57u * ctr[2];
+
+        uint32_t c0 = (uint32_t)(p1 >> 32) ^ ctr[1] ^ k0;
+        uint32_t c2 = (uint32_t)(p0 >> 32) ^ ctr[3] ^ k1;
+        ctr[1] = (uint32_t)p1;
+        ctr[3] = (uint32_t)p0;
+        ctr[0] = c0;
+        ctr[2] = c2;
+
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+}
+
+
+/*
+    Return a random value in [0, 1) for a lattice point of a stream
+*/
+static inline double genLattice(uint64_t seed, int stream, int cx, int cy) {
+    uint32_t ctr[4] = { (uint32_t)cx, (uint32_t)cy, (uint32_t)stream, 0 };
+    genPhilox(ctr, seed);
+    return ctr[0] * (1.0/4294967296.0);
+}
+
+
+/*
+    Uniform values in [0, 254], as rand() % 255 gave, four rows of a
+    column at a time
+*/
+static void genNoise(genRun* run, int x) {
+    pixel* column = run->im->m[x];
+    for (int y = 0; y < run->height; y += 4) {
+        uint32_t ctr[4] = { (uint32_t)x, (uint32_t)(y/4), STREAM_NOISE, 0 };
+        genPhilox(ctr, run->seed);
+
+        for (int k = 0; k < 4 && y + k < run->height; k++)
+            column[y + k].i = (double)(((uint64_t)ctr[k]*255) >> 32);
+    }
+}
+
+
+/*
+    A linear ramp from 0 to 254 across the image, in a direction
+    picked by the seed
+*/
+static void genGradient(genRun* run, int x) {
+    double angle = 2.0*M_PI*genLattice(run->seed, STREAM_GRADIENT, 0, 0);
+    double dx = cos(angle), dy = sin(angle);
+    double w  = run->im->width, h = run->height;
+
+    // Range of the projection over the corners, for normalizing
+    double lo = fmin(0.0, dx*w) + fmin(0.0, dy*h);
+    double hi = fmax(0.0, dx*w) + fmax(0.0, dy*h);
+
+    pixel* column = run->im->m[x];
+    for (int y = 0; y < run->height; y++)
+        column[y].i = floor(254.0*((dx*x + dy*y) - lo)/(hi - lo) + 0.5);
+}
+
+
+static inline double genSmooth(double t) {
+    return t*t*(3.0 - 2.0*t);
+}
+
+
+/*
+    Value noise summed over octaves with amplitudes proportional to
+    their cell sizes, giving the roughly 1/f spectrum of natural
+    images (smooth regions, soft edges, and some fine texture), for
+    columns [x0, x1);
+
+    Each octave draws the lattice points around the tile one row of
+    cells at a time, so every lattice point is only drawn once per 
+    tile rather than once per pixel
+*/
+static void genNatural(genRun* run, int x0, int x1) {
+    double total = 0.0;
+    for (int o = 1; o <= GEN_OCTAVES; o++)
+        total += (double)(1 << o);
+
+    for (int x = x0; x < x1; x++)
+        for (int y = 0; y < run->height; y++)
+            run->im->m[x][y].i = 0.0;
+
+    for (int o = 1; o <= GEN_OCTAVES; o++) {
+        int cell      = 1 << o;
+        int cx0       = x0/cell;
+        int points    = (x1 - 1)/cell - cx0 + 2;
+        double weight = cell/total;
+        double top[points], bottom[points];
+
+        for (int i = 0; i < points; i++)
+            bottom[i] = genLattice(run->seed, STREAM_NATURAL + o, cx0 + i, 0);
+
+        for (int cy = 0; cy*cell < run->height; cy++) {
+            for (int i = 0; i < points; i++) {
+                top[i]    = bottom[i];
+                bottom[i] = genLattice(run->seed, STREAM_NATURAL + o, cx0 + i, cy + 1);
+            }
+
+            int y0 = cy*cell;
+            int y1 = (y0 + cell < run->height? y0 + cell:run->height);
+            for (int x = x0; x < x1; x++) {
+                int i         = x/cell - cx0;
+                double fx     = genSmooth((double)(x % cell)/cell);
+                double upper  = top[i]*(1.0 - fx) + top[i + 1]*fx;
+                double lower  = bottom[i]*(1.0 - fx) + bottom[i + 1]*fx;
+                pixel* column = run->im->m[x];
+
+                for (int y = y0; y < y1; y++) {
+                    double fy    = genSmooth((double)(y - y0)/cell);
+                    column[y].i += weight*(upper*(1.0 - fy) + lower*fy);
+                }
+            }
+        }
+    }
+
+    // Sums of many octaves bunch up around the middle, so stretch
+    // them back out over the whole range of values
+    for (int x = x0; x < x1; x++) {
+        pixel* column = run->im->m[x];
+        for (int y = 0; y < run->height; y++) {
+            double v    = 127.0 + 2.5*254.0*(column[y].i - 0.5);
+            column[y].i = floor(fmin(254.0, fmax(0.0, v)) + 0.5);
+        }
+    }
+}
+
+
+/*
+    Dark 5x7 glyphs on a light page, like a screenshot of a terminal
+    or of a document in a monospace font; lines of words with ragged
+    ends, a blank line between paragraphs, and the same glyph bitmaps
+    wherever a letter repeats
+*/
+static void genText(genRun* run, int x) {
+    pixel* column = run->im->m[x];
+    int width     = run->im->width;
+    int col       = (x - TEXT_MARGIN)/TEXT_ADVANCE;
+    int cx        = (x - TEXT_MARGIN)%TEXT_ADVANCE;
+
+    for (int y = 0; y < run->height; y++)
+        column[y].i = 254.0;
+
+    if (x < TEXT_MARGIN || x >= width - TEXT_MARGIN || cx >= 5)
+        return;
+
+    for (int line = 0; TEXT_MARGIN + line*TEXT_LINE < run->height - TEXT_MARGIN; line++) {
+
+        // Every 8th line ends a paragraph, other lines end somewhere
+        // in the last third of the page
+        uint32_t ctr[4] = { (uint32_t)line, 0, STREAM_TEXT, 0 };
+        genPhilox(ctr, run->seed);
+        int length = (width - 2*TEXT_MARGIN)/TEXT_ADVANCE;
+        if (line % 8 == 7 || col >= length - (int)(ctr[0] % (length/3 + 1)))
+            continue;
+
+        // One in six characters is a space between words
+        ctr[0] = (uint32_t)col, ctr[1] = (uint32_t)line; 
+        ctr[2] = STREAM_TEXT + 1, ctr[3] = 0;
+        genPhilox(ctr, run->seed);
+        if (ctr[0] % 6 == 0)
+            continue;
+
+        uint32_t glyph[4] = { ctr[1] % TEXT_GLYPHS, 0, STREAM_TEXT + 2, 0 };
+        genPhilox(glyph, run->seed);
+
+        int y0 = TEXT_MARGIN + line*TEXT_LINE;
+        for (int cy = 0; cy < 7 && y0 + 4 + cy < run->height; cy++) {
+            uint64_t bits = ((uint64_t)glyph[1] << 32) | glyph[0];
+            if ((bits >> (cy*5 + cx)) & 1)
+                column[y0 + 4 + cy].i = 16.0;
+        }
+    }
+}
+
+
+/*
+    Generate one tile of GEN_TILE columns
+*/
+static void genTileTask(void* arg, int taskIndex, int workerIndex) {
+    genRun* run = (genRun*)arg;
+    int first   = taskIndex*GEN_TILE;
+    int last    = (first + GEN_TILE < run->im->width? first + GEN_TILE:run->im->width);
+
+    if (run->mode == GEN_NATURAL)
+        genNatural(run, first, last);
+
+    for (int x = first; x < last; x++) {
+        if (run->mode == GEN_GRADIENT)
+            genGradient(run, x);
+
+        else if (run->mode == GEN_TEXT)
+            genText(run, x);
+
+        else if (run->mode != GEN_NATURAL)
+            genNoise(run, x);
+
+        for (int y = run->height; y < run->im->height; y++)
+            run->im->m[x][y].i = 0;
+    }
+}
+
+
+/*
+    Generate content of a given GEN_* mode in the first 'height' rows
+    of an image and zero out the (padded) rows after them;
+
+    Every pixel only depends on the seed and its position, so the 
+    image is the same however the tiles of columns are split over 
+    the workers of 'pool' (or generated on the calling thread if it 
+    is NULL), and the same seed always gives the same image
+*/
+void imGenerate(image* im, int height, uint64_t seed, int mode, threadPool* pool) {
+    genRun run = { im, height, seed, mode };
+    int tiles  = (im->width + GEN_TILE - 1)/GEN_TILE;
+
+    if (pool != NULL) {
+        poolRun(pool, genTileTask, &run, tiles, POOL_DYNAMIC);
+        return;
+    }
+
+    for (int t = 0; t < tiles; t++)
+        genTileTask(&run, t, 0);
+}
+
+
+/*
+    Return the GEN_* mode matching a name, or -1 if there is none
+*/
+int imGenerateMode(const char* name) {
+    const char* names[] = { "noise", "gradient", "natural", "text" };
+    for (int m = 0; m < (int)(sizeof(names)/sizeof(names[0])); m++)
+        if (strcmp(name, names[m]) == 0)
+            return m;
+
+    return -1;
+}
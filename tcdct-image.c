@@ -0,0 +1,393 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "tcdct.h"
+
+
+/*
+    Allocate space for a (width x height) size image and 
+    return it's pointer
+*/
+image* allocateImage(int width, int height, int channels) {
+    return allocateImageFlags(width, height, channels, 0);
+}
+
+
+/*
+    Map 'size' bytes for the plane of an image with huge pages;
+
+    A plane from the huge page pool is used as it is, otherwise twice
+    the huge page size is mapped so the plane can be trimmed to start
+    on a huge page boundary, where the kernel can back it with
+    transparent huge pages. Returns NULL if nothing could be mapped
+*/
+static void* imMapPlane(image* im, size_t size, int flags) {
+    size = (size + IM_HUGE_PAGE - 1) / IM_HUGE_PAGE * IM_HUGE_PAGE;
+
+#ifdef MAP_HUGETLB
+    if (flags & IM_ALLOC_HUGETLB) {
+        void* plane = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (plane != MAP_FAILED) {
+            im->planeSize = size;
+            im->pages     = IM_PAGES_HUGETLB;
+            return plane;
+        }
+    }
+#endif
+
+    char* mapped = (char*)mmap(NULL, size + IM_HUGE_PAGE, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED)
+        return NULL;
+
+    // Give back the unaligned head and the tail past the plane
+    char* plane = (char*)(((uintptr_t)mapped + IM_HUGE_PAGE - 1) 
+                          & ~(uintptr_t)(IM_HUGE_PAGE - 1));
+    if (plane > mapped)
+        munmap(mapped, plane - mapped);
+
+    if (plane + size < mapped + size + IM_HUGE_PAGE)
+        munmap(plane + size, (mapped + size + IM_HUGE_PAGE) - (plane + size));
+
+    im->planeSize = size;
+    im->pages     = IM_PAGES_SMALL;
+
+#ifdef MADV_HUGEPAGE
+    if (madvise(plane, size, MADV_HUGEPAGE) == 0)
+        im->pages = IM_PAGES_THP;
+#endif
+
+    return plane;
+}
+
+
+/*
+    Allocate space for a (width x height) size image with the
+    given IM_ALLOC_* flags and return it's pointer
+*/
+image* allocateImageFlags(int width, int height, int channels, int flags) {
+
+    
+    // Allocate an image structure
+    //
+    // NOTE:
+    // 
+    //    To be able to index with im[x][y], I need 
+    //    to initialize with WIDTH, and then iterate over
+    //    WIDTH pointing each column of a certain HEIGHT
+    //    into a single plane
+    //
+    //    Each column is cache line aligned and padded out to a
+    //    whole amount of cache lines; since bands always start on
+    //    a multiple of 8 rows, every thread then only writes to 
+    //    cache lines that no other thread writes to
+    //
+    image* im = (image*)malloc(1*sizeof(image));
+    im->m         = (pixel**)malloc((width)*sizeof(pixel*));
+    im->plane     = NULL;
+    im->planeSize = 0;
+    im->pages     = IM_PAGES_SMALL;
+
+    size_t columnSize = (height*sizeof(pixel) + CACHE_LINE - 1) 
+                        / CACHE_LINE * CACHE_LINE;
+
+    // Allocate each column of the image matrix on its own
+    if (flags & (IM_ALLOC_LEGACY | IM_ALLOC_COLUMNS)) {
+        for (int x = 0; x < width; x++) {
+            if (flags & IM_ALLOC_LEGACY)
+                im->m[x] = (pixel*)malloc((height)*sizeof(pixel));
+
+            else
+                im->m[x] = (pixel*)aligned_alloc(CACHE_LINE, columnSize);
+        }
+    }
+
+    // Or carve them all out of one plane, mapped with huge pages if
+    // asked for, so a sweep across the columns stays within few pages;
+    //
+    // The columns are spaced an odd amount of cache lines apart, or
+    // the same row of neighbouring columns would keep landing in the
+    // same few cache sets whenever the height is a power of two apart
+    else {
+        size_t stride    = columnSize + ((columnSize/CACHE_LINE) % 2 == 0? CACHE_LINE:0);
+        size_t planeSize = (size_t)width*stride;
+        if (flags & (IM_ALLOC_THP | IM_ALLOC_HUGETLB))
+            im->plane = imMapPlane(im, planeSize, flags);
+
+        if (im->plane == NULL)
+            im->plane = aligned_alloc(CACHE_LINE, planeSize);
+
+        for (int x = 0; x < width; x++)
+            im->m[x] = (pixel*)((char*)im->plane + x*stride);
+    }
+
+    im->height    = height;
+    im->width     = width;
+    im->channels  = channels;
+    return im;
+}
+
+
+/*
+    Randomly generate a (width x height) size image and 
+    return it's pointer
+*/
+image* generateImage(int width, int height, int channels, int padAmnt) {
+
+    // Allocate the image structure
+    image* im = allocateImage(width, (height + padAmnt), channels);
+
+    imRandomize(im, height);
+    return im;
+}
+
+
+/*
+    Randomly generate values at each pixel of the first 'height' 
+    rows of an image and zero out the (padded) rows after them;
+
+    The values come from the seeded generator of imGenerate(), so 
+    every call generates the same image for the same dimensions
+*/
+void imRandomize(image* im, int height) {
+    imGenerate(im, height, GEN_DEFAULT_SEED, GEN_NOISE, NULL);
+}
+
+
+/*
+    Return a height that an image should have with extra padding;
+
+    This number is determined by the starting (minimum) size
+    and the amount of threads used in the process
+
+    Ts = idx     * s / totalThreads;
+    Te = (idx+1) * s / totalThreads;
+   
+    For it to work, either (Te-Ts)%8 == 0
+    or                     (h/totalThreads)%8 == 0
+*/
+int imGetPadSize(int totalThreads, int startingSize) {
+    int found = 0;
+    for (int s = startingSize; s < 15000; s++) {  
+        for (int idx = 0; idx < totalThreads; idx++) {
+            int start = idx     * s / totalThreads;
+            int end   = (idx+1) * s / totalThreads;
+
+            if (((end-start) % 8) == 0)
+                found = 1;
+
+            else {
+                found = 0;
+                break;
+            }
+        }
+        if (found == 1)
+            return s;
+    }
+    return -1;
+}
+
+
+/*
+    Remove padding from an image and reset it's variables 
+    for dimensions based on the padding amount removed;
+
+    The padded rows are at the end of each column, so the columns
+    keep their allocation and only the height is reduced
+*/
+void imRemovePadding(image* srcIMG, image* dctIMG, image* idctIMG, int padAmnt) {
+    srcIMG->height  = (srcIMG->height  - padAmnt);
+    dctIMG->height  = (dctIMG->height  - padAmnt);
+    idctIMG->height = (idctIMG->height - padAmnt);
+}
+
+
+
+/*
+    Free a single image along with all of its columns
+*/
+void imFree(image* im) {
+    if (im == NULL)
+        return;
+
+    if (im->plane == NULL)
+        for (int x = 0; x < im->width; x++)
+            free(im->m[x]);
+
+    else if (im->planeSize > 0)
+        munmap(im->plane, im->planeSize);
+
+    else
+        free(im->plane);
+
+    free(im->m);
+    free(im);
+}
+
+
+/*
+    Return the name of a kind of pages
+*/
+const char* imPagesName(int pages) {
+    switch (pages) {
+        case IM_PAGES_THP:     return "thp";
+        case IM_PAGES_HUGETLB: return "hugetlb";
+        default:               return "4k";
+    }
+}
+
+
+/*
+    Delete the source, DCT, and IDCT images from memory
+*/
+void imDelete(image* srcIMG, image* dctIMG, image* idctIMG) {
+    imFree(srcIMG);
+    imFree(dctIMG);
+    imFree(idctIMG);
+}
+
+
+/*
+    Print an image to STDOUT
+*/
+void imPrint(image* im) {
+
+    // If input image is a grayscale image
+    if (im->channels == 1) {
+        for (int y = 0; y < im->height; y++) {
+            for (int x = 0; x < im->width; x++) {
+
+                // NOTE: This should be a %X.Yf, where
+                //       X = Y+5 for spacing values and 
+                //       the sign of the values neatly
+                //
+                printf("[%8.3f] ", im->m[x][y].i);
+            }
+            printf("\n");
+        }
+    }
+
+    // Else the input is a RGB image
+    else {
+        for (int y = 0; y < im->height; y++) {
+            for (int x = 0; x < im->width; x++) {
+                printf("[%3f,%3f,%3f]\t", 
+                             im->m[x][y].r,
+                             im->m[x][y].g,
+                             im->m[x][y].b);
+            }
+            printf("\n");
+        }
+    }
+}
+
+
+/*
+    Get the amount of average error per ELEMENT of two images;
+
+    This is helpful in illustrating the percision of doubles
+    as you +/- the percision in imValidate()
+*/
+double imERR1(image* imA, image* imB) {
+    
+    double avg_err = 0.0;
+    for (int y = 0; y < imA->height; y++) {
+        for (int x = 0; x < imA->width; x++) {
+
+            // In the case of either being zero you get really bad
+            // values, and I'm not sure what else to do but skip it
+            if (imA->m[x][y].i == 0.0 || imB->m[x][y].i == 0.0)
+                continue;
+
+            avg_err += fabs(imB->m[x][y].i - imA->m[x][y].i)/imA->m[x][y].i;
+        }
+    }
+    return avg_err;
+}
+
+
+/*
+    Get the amount of average error over the entirety of two images
+*/
+double imERR2(image* imA, image* imB) {
+    double total_A = 0.0;
+    double total_B = 0.0;
+    for (int y = 0; y < imA->height; y++) {
+        for (int x = 0; x < imA->width; x++) {
+            total_A += (double)fabs(imA->m[x][y].i);
+            total_B += (double)fabs(imB->m[x][y].i);
+        }
+    }
+    return (100.0 * fabs(total_B - total_A)/total_A);
+}
+
+
+/*
+    Get the mean-squared-error of two images
+*/
+long double imMSE(image* imA, image* imB) {
+    long double MSE = (long double)0.0;
+    for (int y = 0; y < imA->height; y++) {
+        for (int x = 0; x < imA->width; x++) {
+            MSE += pow((long double)(imB->m[x][y].i - imA->m[x][y].i), 
+                                                    (long double)2.0);
+        }
+    }
+    return (MSE / (long double)(imA->height * imA->width));
+}
+
+
+/*
+    Check wether two images are the same given a 
+    particular amount of precision, i.e. no pixel differs by
+    more than 'threshold' (0.0 for exactly the same images)
+*/
+int imValidate(image* imA, image* imB, double threshold) {
+    if (imA->height != imB->height)
+        return -7;
+
+    if (imA->width != imB->width)
+        return -6;
+
+    if (imA->channels != imB->channels)
+        return -5;
+    
+    // If input image is a grayscale image
+    if (imA->channels == 1) {
+        for (int y = 0; y < imA->height; y++) {
+            for (int x = 0; x < imA->width; x++) {
+                if (fabs(imA->m[x][y].i - imB->m[x][y].i) > threshold) {
+                        printf("INVALID POINT: (%i, %i)\n", x, y);
+                        printf("A(%i, %i): [%.20f]\n", x, y, imA->m[x][y].i);
+                        printf("B(%i, %i): [%.20f]\n", x, y, imB->m[x][y].i);
+                        printf("A(x,y) - B(x,y): %.38f\n\n", 
+                            imA->m[x][y].i - imB->m[x][y].i);
+                    
+                    return -4;
+                }
+            }
+        }
+    }
+
+    // Else the input is a RGB image
+    else {
+        for (int y = 0; y < imA->height; y++) {
+            for (int x = 0; x < imA->width; x++) {
+                if (fabs(imA->m[x][y].r - imB->m[x][y].r) > threshold)
+                    return -1;
+
+                if (fabs(imA->m[x][y].g - imB->m[x][y].g) > threshold)
+                    return -2;
+
+                if (fabs(imA->m[x][y].b - imB->m[x][y].b) > threshold)
+                    return -3;
+            }
+        }
+    }
+
+    return 0;
+}
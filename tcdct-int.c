@@ -0,0 +1,369 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "tcdct.h"
+
+#if defined(__x86_64__)
+#define INT_HAVE_AVX2 1
+#endif
+
+// Fractional bits of the lifting multipliers
+#define LIFT_BITS 8
+
+// Lifting multipliers (p, u) of the rotations, in 1/256ths; rotating
+// (x, y) by t into (c x + s y, -s x + c y) is done in three lifting
+// steps, x += p y, y += u x, x += p y, with p = tan(t/2) and u = -sin(t)
+#define LIFT_P1  25     // pi/16
+#define LIFT_U1  -50
+#define LIFT_P3  78     // 3pi/16
+#define LIFT_U3  -142
+#define LIFT_P6  171    // 3pi/8
+#define LIFT_U6  -237
+#define LIFT_P4  106    // pi/4
+#define LIFT_U4  -181
+
+// Multiply by a lifting multiplier, rounding to the nearest integer
+#define LIFT(m, y) (((m)*(y) + (1 << (LIFT_BITS - 1))) >> LIFT_BITS)
+
+// Integer transform structure definition
+// --------------------------
+//
+// plan    : Plan whose geometry and workers are used
+// inPlane : Plane transformed
+// outPlane: Plane written
+// tiles   : Per-worker tiles of a row of blocks, one row-major and
+//           one column-major (each 8 x width int32's)
+//
+typedef struct {
+    dctPlan* plan;
+    intPlane* inPlane;
+    intPlane* outPlane;
+    int32_t* tiles;
+} intRun;
+
+
+/*
+    Allocate an integer plane of (width x height) elements of 'bits'
+    (INT_PLANE_16 or INT_PLANE_32), returning NULL on failure
+*/
+intPlane* intPlaneAllocate(int width, int height, int bits) {
+    if (bits != INT_PLANE_16 && bits != INT_PLANE_32)
+        return NULL;
+
+    int size          = bits/8;
+    intPlane* plane   = (intPlane*)malloc(sizeof(intPlane));
+    plane->width      = width;
+    plane->height     = height;
+    plane->bits       = bits;
+    plane->stride     = (height*size + CACHE_LINE - 1)/CACHE_LINE*CACHE_LINE/size;
+    plane->data       = aligned_alloc(CACHE_LINE, (size_t)width*plane->stride*size);
+    if (plane->data == NULL) {
+        free(plane);
+        return NULL;
+    }
+
+    memset(plane->data, 0, (size_t)width*plane->stride*size);
+    return plane;
+}
+
+
+/*
+    Free an integer plane
+*/
+void intPlaneFree(intPlane* plane) {
+    if (plane == NULL)
+        return;
+
+    free(plane->data);
+    free(plane);
+}
+
+
+/*
+    Read an element of an integer plane
+*/
+static inline int32_t intGet(const intPlane* plane, int x, int y) {
+    if (plane->bits == INT_PLANE_16)
+        return ((const int16_t*)plane->data)[(size_t)x*plane->stride + y];
+
+    return ((const int32_t*)plane->data)[(size_t)x*plane->stride + y];
+}
+
+
+/*
+    Write an element of an integer plane (truncating to 16 bits)
+*/
+static inline void intSet(intPlane* plane, int x, int y, int32_t value) {
+    if (plane->bits == INT_PLANE_16)
+        ((int16_t*)plane->data)[(size_t)x*plane->stride + y] = (int16_t)value;
+
+    else
+        ((int32_t*)plane->data)[(size_t)x*plane->stride + y] = value;
+}
+
+
+/*
+    Round the grayscale pixels of an image into an integer plane (as
+    much of either as both have)
+*/
+void intPlaneFromImage(intPlane* plane, image* im) {
+    int width  = (plane->width < im->width? plane->width:im->width);
+    int height = (plane->height < im->height? plane->height:im->height);
+    for (int x = 0; x < width; x++)
+        for (int y = 0; y < height; y++)
+            intSet(plane, x, y, (int32_t)lrint(im->m[x][y].i));
+}
+
+
+/*
+    Copy the elements of an integer plane into the grayscale pixels
+    of an image (as much of either as both have)
+*/
+void intPlaneToImage(intPlane* plane, image* im) {
+    int width  = (plane->width < im->width? plane->width:im->width);
+    int height = (plane->height < im->height? plane->height:im->height);
+    for (int x = 0; x < width; x++)
+        for (int y = 0; y < height; y++)
+            im->m[x][y].i = (double)intGet(plane, x, y);
+}
+
+
+/*
+    Run the reversible 8-point transform over 'n' sets of 8 values,
+    the k'th value of set j at r[k*stride + j];
+
+    The structure follows the even/odd split of the DCT: butterflies
+    of x[i] and x[7-i] keeping the difference and half of the sum (so
+    either can be undone from the other), the even half split again
+    with a rotation by 3pi/8 for X2 and X6, and the odd half rotated
+    by pi/16 and 3pi/16, butterflied and rotated by pi/4 for X3 and
+    X5. Every step adds a rounded integer function of values it leaves
+    alone, so running them backwards subtracting the same amounts gives
+    back every input exactly. The coefficients come out scaled per
+    frequency (X0 being the mean of the inputs), and the inner loop
+    runs across the sets so it vectorizes
+*/
+static inline __attribute__((always_inline))
+void liftForward(int32_t* r, int stride, int n) {
+    for (int j = 0; j < n; j++) {
+        int32_t o0 = r[j]              - r[7*stride + j];
+        int32_t o1 = r[stride + j]     - r[6*stride + j];
+        int32_t o2 = r[2*stride + j]   - r[5*stride + j];
+        int32_t o3 = r[3*stride + j]   - r[4*stride + j];
+        int32_t e0 = r[7*stride + j] + (o0 >> 1);
+        int32_t e1 = r[6*stride + j] + (o1 >> 1);
+        int32_t e2 = r[5*stride + j] + (o2 >> 1);
+        int32_t e3 = r[4*stride + j] + (o3 >> 1);
+
+        // Even half
+        int32_t a3 = e0 - e3, A = e3 + (a3 >> 1);
+        int32_t a2 = e1 - e2, B = e2 + (a2 >> 1);
+        int32_t X4 = A - B,   X0 = B + (X4 >> 1);
+        a2 += LIFT(LIFT_P6, a3);
+        a3 += LIFT(LIFT_U6, a2);
+        a2 += LIFT(LIFT_P6, a3);
+
+        // Odd half
+        o0 += LIFT(LIFT_P1, o3);
+        o3 += LIFT(LIFT_U1, o0);
+        o0 += LIFT(LIFT_P1, o3);
+        o1 += LIFT(LIFT_P3, o2);
+        o2 += LIFT(LIFT_U3, o1);
+        o1 += LIFT(LIFT_P3, o2);
+
+        int32_t U1 = o0 - o1, U0 = o1 + (U1 >> 1);
+        int32_t U2 = o2 + o3, U3 = o3 - (U2 >> 1);
+        U1 += LIFT(LIFT_P4, U2);
+        U2 += LIFT(LIFT_U4, U1);
+        U1 += LIFT(LIFT_P4, U2);
+
+        r[j]            = X0;
+        r[stride + j]   = U0;
+        r[2*stride + j] = a2;
+        r[3*stride + j] = -U2;
+        r[4*stride + j] = X4;
+        r[5*stride + j] = U1;
+        r[6*stride + j] = a3;
+        r[7*stride + j] = -U3;
+    }
+}
+
+
+/*
+    Undo liftForward(), running its steps backwards
+*/
+static inline __attribute__((always_inline))
+void liftInverse(int32_t* r, int stride, int n) {
+    for (int j = 0; j < n; j++) {
+        int32_t X0 = r[j],            U0 = r[stride + j];
+        int32_t a2 = r[2*stride + j], U2 = -r[3*stride + j];
+        int32_t X4 = r[4*stride + j], U1 = r[5*stride + j];
+        int32_t a3 = r[6*stride + j], U3 = -r[7*stride + j];
+
+        // Odd half
+        U1 -= LIFT(LIFT_P4, U2);
+        U2 -= LIFT(LIFT_U4, U1);
+        U1 -= LIFT(LIFT_P4, U2);
+        int32_t o3 = U3 + (U2 >> 1), o2 = U2 - o3;
+        int32_t o1 = U0 - (U1 >> 1), o0 = U1 + o1;
+
+        o1 -= LIFT(LIFT_P3, o2);
+        o2 -= LIFT(LIFT_U3, o1);
+        o1 -= LIFT(LIFT_P3, o2);
+        o0 -= LIFT(LIFT_P1, o3);
+        o3 -= LIFT(LIFT_U1, o0);
+        o0 -= LIFT(LIFT_P1, o3);
+
+        // Even half
+        a2 -= LIFT(LIFT_P6, a3);
+        a3 -= LIFT(LIFT_U6, a2);
+        a2 -= LIFT(LIFT_P6, a3);
+        int32_t B  = X0 - (X4 >> 1), A  = X4 + B;
+        int32_t e2 = B - (a2 >> 1),  e1 = a2 + e2;
+        int32_t e3 = A - (a3 >> 1),  e0 = a3 + e3;
+
+        int32_t x7 = e0 - (o0 >> 1), x6 = e1 - (o1 >> 1);
+        int32_t x5 = e2 - (o2 >> 1), x4 = e3 - (o3 >> 1);
+        r[j]            = o0 + x7;
+        r[stride + j]   = o1 + x6;
+        r[2*stride + j] = o2 + x5;
+        r[3*stride + j] = o3 + x4;
+        r[4*stride + j] = x4;
+        r[5*stride + j] = x5;
+        r[6*stride + j] = x6;
+        r[7*stride + j] = x7;
+    }
+}
+
+
+/*
+    Transform one row of blocks of a plane, forward or inverse;
+
+    The row is loaded into a tile of 8 rows of the whole width, so the
+    vertical transforms of every column run across the width at once,
+    then every block's horizontal transforms run across its 8 rows out
+    of the same tile turned column-major. The inverse undoes them in
+    the opposite order
+*/
+static inline __attribute__((always_inline))
+void intRow(intRun* run, int taskIndex, int workerIndex, int direction) {
+    int W          = run->plan->width;
+    int y0         = taskIndex*8;
+    int32_t* rows  = run->tiles + (size_t)workerIndex*16*W;
+    int32_t* cols  = rows + (size_t)8*W;
+
+    for (int x = 0; x < W; x++)
+        for (int k = 0; k < 8; k++)
+            rows[k*W + x] = intGet(run->inPlane, x, y0 + k);
+
+    if (direction == PLAN_FORWARD)
+        liftForward(rows, W, W);
+
+    // cols[x][k], so each block's columns are 8 apart
+    for (int x = 0; x < W; x++)
+        for (int k = 0; k < 8; k++)
+            cols[x*8 + k] = rows[k*W + x];
+
+    for (int bx = 0; bx < W; bx += 8) {
+        if (direction == PLAN_FORWARD)
+            liftForward(&cols[bx*8], 8, 8);
+
+        else
+            liftInverse(&cols[bx*8], 8, 8);
+    }
+
+    if (direction == PLAN_FORWARD) {
+        for (int x = 0; x < W; x++)
+            for (int k = 0; k < 8; k++)
+                intSet(run->outPlane, x, y0 + k, cols[x*8 + k]);
+        return;
+    }
+
+    for (int x = 0; x < W; x++)
+        for (int k = 0; k < 8; k++)
+            rows[k*W + x] = cols[x*8 + k];
+
+    liftInverse(rows, W, W);
+    for (int x = 0; x < W; x++)
+        for (int k = 0; k < 8; k++)
+            intSet(run->outPlane, x, y0 + k, rows[k*W + x]);
+}
+
+
+static void intForwardGeneric(void* arg, int taskIndex, int workerIndex) {
+    intRow((intRun*)arg, taskIndex, workerIndex, PLAN_FORWARD);
+}
+
+static void intInverseGeneric(void* arg, int taskIndex, int workerIndex) {
+    intRow((intRun*)arg, taskIndex, workerIndex, PLAN_INVERSE);
+}
+
+#ifdef INT_HAVE_AVX2
+__attribute__((target("avx2")))
+static void intForwardAVX2(void* arg, int taskIndex, int workerIndex) {
+    intRow((intRun*)arg, taskIndex, workerIndex, PLAN_FORWARD);
+}
+
+__attribute__((target("avx2")))
+static void intInverseAVX2(void* arg, int taskIndex, int workerIndex) {
+    intRow((intRun*)arg, taskIndex, workerIndex, PLAN_INVERSE);
+}
+#endif
+
+
+/*
+    Run the integer transform of 'inPlane' into 'outPlane' over the
+    plan's workers, one row of blocks per task
+*/
+static int intRunPlanes(dctPlan* plan, intPlane* inPlane, intPlane* outPlane,
+                        int direction) {
+    if (plan->blockSize != 8 || inPlane->width != plan->width ||
+        outPlane->width != plan->width || inPlane->height < plan->paddedHeight ||
+        outPlane->height < plan->paddedHeight)
+        return -1;
+
+    intRun run;
+    run.plan     = plan;
+    run.inPlane  = inPlane;
+    run.outPlane = outPlane;
+    run.tiles    = (int32_t*)aligned_alloc(CACHE_LINE,
+                       (size_t)plan->totalThreads*16*plan->width*sizeof(int32_t));
+    if (run.tiles == NULL)
+        return -1;
+
+    poolTask task = (direction == PLAN_FORWARD? intForwardGeneric:intInverseGeneric);
+#ifdef INT_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2"))
+        task = (direction == PLAN_FORWARD? intForwardAVX2:intInverseAVX2);
+#endif
+
+    poolRun(plan->pool, task, &run, plan->paddedHeight/8, POOL_DYNAMIC);
+    free(run.tiles);
+    return 0;
+}
+
+
+/*
+    Transform 'srcPlane' into 'dctPlane' with the reversible integer
+    8x8 transform, with no floating point at all;
+
+    The coefficients approximate a scaled DCT and planInverseInt()
+    gives back the source exactly. Coefficients of 8-bit pixels fit
+    in INT_PLANE_16 planes. The plan must have 8x8 blocks, and both
+    planes its width and (padded) height. Returns 0 on success and -1
+    on failure
+*/
+int planForwardInt(dctPlan* plan, intPlane* srcPlane, intPlane* dctPlane) {
+    return intRunPlanes(plan, srcPlane, dctPlane, PLAN_FORWARD);
+}
+
+
+/*
+    Exactly undo planForwardInt(), reconstructing 'outPlane' from the
+    coefficients in 'dctPlane'
+*/
+int planInverseInt(dctPlan* plan, intPlane* dctPlane, intPlane* outPlane) {
+    return intRunPlanes(plan, dctPlane, outPlane, PLAN_INVERSE);
+}
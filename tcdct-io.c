@@ -0,0 +1,504 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tcdct.h"
+
+// Rows of the image each task of imwriteParallel() formats
+#define IO_BAND_ROWS 16
+
+// Bytes of the file each task of imreadParallel() parses
+#define IO_CHUNK_BYTES (1 << 18)
+
+// Most characters a formatted value (and its separator) takes, up
+// to 1e18, then for any double (DBL_MAX has 309 digits)
+#define IO_VALUE_CHARS 24
+#define IO_HUGE_CHARS  320
+
+// Text image job structure definition
+// --------------------------
+//
+// im        : Image written out or read into
+// bands     : Formatted text of each band (written) 
+// sizes     : Bytes of text in each band (written)
+// offsets   : Offset of each band in the file (written)
+// fd        : Descriptor of the file being written
+// data      : Mapping of the file being read
+// size      : Bytes in the file being read
+// bounds    : Start of each chunk, and the end of the last (read)
+// counts    : Values starting in each chunk, then the index of its
+//             first value once summed up (read)
+// failed    : Set if any band couldn't be written, or any value read
+//
+typedef struct {
+    image* im;
+    char** bands;
+    size_t* sizes;
+    size_t* offsets;
+    int fd;
+    const char* data;
+    size_t size;
+    size_t* bounds;
+    size_t* counts;
+    int failed;
+} ioJob;
+
+
+/*
+    Read a file into an image structure;
+
+    If the file is still positioned at a PGM/PPM header (e.g. "P2"),
+    the header is skipped, otherwise the caller is expected to have
+    already read it and only the pixel values are read
+*/
+void imread(image* im, FILE *inFile) {
+    int value, c;
+
+    // Skip over the header if it hasn't been read yet
+    while ((c = fgetc(inFile)) == ' ' || c == '\n' || c == '\r' || c == '\t');
+    if (c == 'P') 
+        fscanf(inFile, "%*i %i %i %i", &value, &value, &value);
+
+    else if (c != EOF)
+        ungetc(c, inFile);
+
+    // If input image is a grayscale image
+    if (im->channels == 1) {
+        for (int y = 0; y < im->height; y++) {
+            for (int x = 0; x < im->width; x++) {
+               fscanf(inFile, "\n%i", &value);
+               im->m[x][y].i = (valueType)value;
+            }
+        }
+    }
+
+    // Else the input is a RGB image
+    else {
+        int rv, gv, bv;
+        for (int y = 0; y < im->height; y++) {
+            for (int x = 0; x < im->width; x++) {
+               fscanf(inFile, "\n%i %i %i", 
+                             &rv, &gv, &bv);
+
+                im->m[x][y].r = (valueType)rv;
+                im->m[x][y].g = (valueType)gv;
+                im->m[x][y].b = (valueType)bv;
+            }
+        }
+    }
+}
+
+
+/*
+    Write an image structure out to a file (as an ASCII PGM), where
+    negative values are clamped to 0
+*/
+void imwrite(image* im, char* fileName) {
+    FILE *inFile = fopen(fileName, "w+");
+    if (inFile == NULL)
+        return;
+
+    fprintf(inFile, "P2\n%i %i\n255\n", im->width, im->height);
+
+    for (int y = 0; y < im->height; y++) {
+        for (int x = 0; x < im->width; x++) {
+            if (im->m[x][y].i >= (valueType)0.0)
+                fprintf(inFile, "%.0f%s", im->m[x][y].i, 
+                          (x+1 == im->width? "\n":" "));
+
+            else
+                fprintf(inFile, "0%s", (x+1 == im->width? "\n":" "));
+        }
+    }
+    fclose(inFile);
+}
+
+
+/*
+    Run 'totalTasks' tasks on a pool, or one after another on the 
+    calling thread if there is no pool
+*/
+static void ioRunTasks(threadPool* pool, poolTask task, void* arg, int totalTasks) {
+    if (pool != NULL) {
+        poolRun(pool, task, arg, totalTasks, POOL_DYNAMIC);
+        return;
+    }
+
+    for (int i = 0; i < totalTasks; i++)
+        task(arg, i, 0);
+}
+
+
+// Every two digit number, for formatting values two digits at a time
+static const char ioDigitPairs[] = 
+    "00010203040506070809101112131415161718192021222324252627282930313233"
+    "34353637383940414243444546474849505152535455565758596061626364656667"
+    "6869707172737475767778798081828384858687888990919293949596979899";
+
+/*
+    Format a value at 'p' the way imwrite() does ("%.0f", with negative
+    values as 0) and return the end of it
+*/
+static inline char* ioFormat(char* p, valueType v) {
+    if (!(v >= (valueType)0.0)) {
+        *p++ = '0';
+        return p;
+    }
+
+    // Too large to round to an integer (and -0, which "%.0f" keeps)
+    if (v >= (valueType)1e18 || signbit(v)) {
+        char text[IO_HUGE_CHARS];
+        int length = snprintf(text, sizeof(text), "%.0f", (double)v);
+        memcpy(p, text, length);
+        return p + length;
+    }
+
+    // Rounds half to even, as printf() does
+    uint64_t n = (uint64_t)llrint(v);
+    char digits[20];
+    char* d = digits + sizeof(digits);
+    while (n >= 100) {
+        d -= 2;
+        memcpy(d, &ioDigitPairs[2*(n % 100)], 2);
+        n /= 100;
+    }
+
+    if (n >= 10) {
+        d -= 2;
+        memcpy(d, &ioDigitPairs[2*n], 2);
+    }
+
+    else
+        *--d = (char)('0' + n);
+
+    size_t length = digits + sizeof(digits) - d;
+    memcpy(p, d, length);
+    return p + length;
+}
+
+
+/*
+    Format the rows of one band into its own buffer;
+
+    The buffer is sized for values below 1e18, with room for one pixel
+    of huge values on top, and grows whenever a pixel of huge values
+    could no longer fit
+*/
+static void ioFormatTask(void* arg, int taskIndex, int workerIndex) {
+    ioJob* job      = (ioJob*)arg;
+    image* im       = job->im;
+    int first       = taskIndex*IO_BAND_ROWS;
+    int last        = (first + IO_BAND_ROWS < im->height? first + IO_BAND_ROWS:im->height);
+    int values      = (im->channels == 1? 1:3);
+    size_t reserve  = (size_t)values*IO_HUGE_CHARS;
+    size_t capacity = (size_t)(last - first)*im->width*values*IO_VALUE_CHARS + reserve;
+    char* band      = (char*)malloc(capacity);
+    char* p         = band;
+
+    if (band == NULL) {
+        job->failed = 1;
+        return;
+    }
+
+    for (int y = first; y < last; y++) {
+        for (int x = 0; x < im->width; x++) {
+            if ((size_t)(band + capacity - p) < reserve) {
+                size_t used = p - band;
+                char* grown = (char*)realloc(band, 2*capacity);
+                if (grown == NULL) {
+                    free(band);
+                    job->failed = 1;
+                    return;
+                }
+
+                band      = grown;
+                p         = band + used;
+                capacity *= 2;
+            }
+
+            if (values == 1)
+                p = ioFormat(p, im->m[x][y].i);
+
+            else {
+                p    = ioFormat(p, im->m[x][y].r);
+                *p++ = ' ';
+                p    = ioFormat(p, im->m[x][y].g);
+                *p++ = ' ';
+                p    = ioFormat(p, im->m[x][y].b);
+            }
+            *p++ = ' ';
+        }
+        p[-1] = '\n';
+    }
+
+    job->bands[taskIndex] = band;
+    job->sizes[taskIndex] = p - band;
+}
+
+
+/*
+    Write one formatted band at its offset in the file
+*/
+static void ioWriteTask(void* arg, int taskIndex, int workerIndex) {
+    ioJob* job       = (ioJob*)arg;
+    const char* data = job->bands[taskIndex];
+    size_t left      = job->sizes[taskIndex];
+    off_t offset     = (off_t)job->offsets[taskIndex];
+
+    while (left > 0) {
+        ssize_t written = pwrite(job->fd, data, left, offset);
+        if (written <= 0) {
+            job->failed = 1;
+            return;
+        }
+
+        data   += written;
+        offset += written;
+        left   -= written;
+    }
+}
+
+
+/*
+    Write an image out to an ASCII PGM (P2) file like imwrite() does,
+    or to an ASCII PPM (P3) file if it has 3 channels, in parallel;
+
+    Bands of rows are formatted into their own buffers without going
+    through printf() on 'pool' (or on the calling thread if it is NULL),
+    and then written at their offsets in the file. Returns 0 on success
+    and -1 on failure
+*/
+int imwriteParallel(image* im, const char* fileName, threadPool* pool) {
+    int bandCount = (im->height + IO_BAND_ROWS - 1)/IO_BAND_ROWS;
+    char header[64];
+    int headerSize = snprintf(header, sizeof(header), "P%i\n%i %i\n255\n",
+                              (im->channels == 1? 2:3), im->width, im->height);
+
+    ioJob job;
+    memset(&job, 0, sizeof(job));
+    job.im      = im;
+    job.bands   = (char**)calloc(bandCount, sizeof(char*));
+    job.sizes   = (size_t*)calloc(bandCount, sizeof(size_t));
+    job.offsets = (size_t*)calloc(bandCount, sizeof(size_t));
+
+    ioRunTasks(pool, ioFormatTask, &job, bandCount);
+
+    // Place the bands one after another once their sizes are known
+    size_t offset = headerSize;
+    for (int b = 0; b < bandCount; b++) {
+        job.offsets[b] = offset;
+        offset        += job.sizes[b];
+    }
+
+    job.fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (job.fd < 0)
+        job.failed = 1;
+
+    else {
+        if (pwrite(job.fd, header, headerSize, 0) != headerSize)
+            job.failed = 1;
+
+        if (!job.failed)
+            ioRunTasks(pool, ioWriteTask, &job, bandCount);
+
+        if (close(job.fd) != 0)
+            job.failed = 1;
+    }
+
+    for (int b = 0; b < bandCount; b++)
+        free(job.bands[b]);
+
+    free(job.bands);
+    free(job.sizes);
+    free(job.offsets);
+    return (job.failed? -1:0);
+}
+
+
+static inline int ioSpace(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+
+/*
+    Read the next header field of a PGM/PPM file at 'pos', skipping 
+    whitespace and comments; returns -1 if there is none
+*/
+static int ioHeaderField(const char* data, size_t size, size_t* pos) {
+    size_t p = *pos;
+    while (p < size && (ioSpace(data[p]) || data[p] == '#')) {
+        if (data[p] == '#')
+            while (p < size && data[p] != '\n')
+                p++;
+        else
+            p++;
+    }
+
+    if (p == size || data[p] < '0' || data[p] > '9')
+        return -1;
+
+    long value = 0;
+    while (p < size && data[p] >= '0' && data[p] <= '9' && value < (1L << 30))
+        value = value*10 + (data[p++] - '0');
+
+    *pos = p;
+    return (value < (1L << 30)? (int)value:-1);
+}
+
+
+/*
+    Count the values starting in one chunk of the file
+*/
+static void ioCountTask(void* arg, int taskIndex, int workerIndex) {
+    ioJob* job       = (ioJob*)arg;
+    const char* data = job->data;
+    size_t end       = job->bounds[taskIndex + 1];
+    size_t count     = 0;
+    int space        = 1;
+
+    for (size_t p = job->bounds[taskIndex]; p < end; p++) {
+        int s  = ioSpace(data[p]);
+        count += (space & !s);
+        space  = s;
+    }
+    job->counts[taskIndex] = count;
+}
+
+
+/*
+    Parse the values starting in one chunk of the file into the image,
+    from the index of its first value on
+*/
+static void ioParseTask(void* arg, int taskIndex, int workerIndex) {
+    ioJob* job       = (ioJob*)arg;
+    image* im        = job->im;
+    const char* data = job->data;
+    size_t p         = job->bounds[taskIndex];
+    size_t end       = job->bounds[taskIndex + 1];
+    size_t index     = job->counts[taskIndex];
+    int values       = (im->channels == 1? 1:3);
+
+    while (1) {
+        while (p < end && ioSpace(data[p]))
+            p++;
+
+        if (p >= end)
+            return;
+
+        // A value may run on past the chunk, up to the end of the file
+        int negative = (data[p] == '-');
+        p           += negative;
+
+        size_t start = p;
+        long value   = 0;
+        while (p < job->size && (unsigned)(data[p] - '0') < 10 && p - start < 18)
+            value = value*10 + (data[p++] - '0');
+
+        if (p == start || (p < job->size && !ioSpace(data[p]))) {
+            job->failed = 1;
+            return;
+        }
+
+        valueType v = (valueType)(negative? -value:value);
+        size_t n    = index/values;
+        int x       = (int)(n % im->width);
+        int y       = (int)(n / im->width);
+        if (values == 1)
+            im->m[x][y].i = v;
+
+        else if (index % 3 == 0)
+            im->m[x][y].r = v;
+
+        else if (index % 3 == 1)
+            im->m[x][y].g = v;
+
+        else
+            im->m[x][y].b = v;
+
+        index++;
+    }
+}
+
+
+/*
+    Read an ASCII PGM (P2) or PPM (P3) file into a new image (with 1
+    or 3 channels) in parallel, without going through scanf();
+
+    The file is mapped and split into chunks at whitespace, whose 
+    values are counted on 'pool' (or the calling thread if it is NULL)
+    to know where each chunk's first value goes, then parsed. Returns
+    NULL if the file can't be read or isn't a valid P2/P3 file
+*/
+image* imreadParallel(const char* fileName, threadPool* pool) {
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 2) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = (size_t)st.st_size;
+    const char* data = (const char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return NULL;
+
+    // The header, up to the whitespace after the maximum value
+    size_t pos   = 2;
+    int channels = (data[0] == 'P' && data[1] == '2'? 1:
+                    data[0] == 'P' && data[1] == '3'? 3:0);
+    int width    = (channels? ioHeaderField(data, size, &pos):-1);
+    int height   = (width > 0? ioHeaderField(data, size, &pos):-1);
+    int maximum  = (height > 0? ioHeaderField(data, size, &pos):-1);
+    if (maximum < 0 || pos == size || !ioSpace(data[pos])) {
+        munmap((void*)data, size);
+        return NULL;
+    }
+
+    // Chunks start at whitespace, so no value is split between two
+    int chunkCount = (int)((size - pos + IO_CHUNK_BYTES - 1)/IO_CHUNK_BYTES);
+    ioJob job;
+    memset(&job, 0, sizeof(job));
+    job.data   = data;
+    job.size   = size;
+    job.bounds = (size_t*)malloc((chunkCount + 1)*sizeof(size_t));
+    job.counts = (size_t*)malloc(chunkCount*sizeof(size_t));
+    for (int c = 0; c < chunkCount; c++) {
+        size_t bound = pos + (size_t)c*IO_CHUNK_BYTES;
+        while (bound < size && !ioSpace(data[bound]))
+            bound++;
+        job.bounds[c] = bound;
+    }
+    job.bounds[chunkCount] = size;
+
+    ioRunTasks(pool, ioCountTask, &job, chunkCount);
+
+    size_t total = 0;
+    for (int c = 0; c < chunkCount; c++) {
+        size_t count  = job.counts[c];
+        job.counts[c] = total;
+        total        += count;
+    }
+
+    image* im = NULL;
+    if (total == (size_t)width*height*channels) {
+        job.im = im = allocateImage(width, height, channels);
+        ioRunTasks(pool, ioParseTask, &job, chunkCount);
+        if (job.failed) {
+            imFree(im);
+            im = NULL;
+        }
+    }
+
+    free(job.bounds);
+    free(job.counts);
+    munmap((void*)data, size);
+    return im;
+}
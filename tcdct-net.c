@@ -0,0 +1,417 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "tcdct.h"
+
+// Plans a worker keeps around for the tile sizes it has seen
+#define NET_PLAN_CACHE 4
+
+
+/*
+    Send or receive exactly 'bytes' bytes over a socket;
+
+    Returns 0 on success and -1 if the connection failed or closed
+*/
+static int netSendAll(int fd, const void* data, size_t bytes) {
+    const char* p = (const char*)data;
+    while (bytes > 0) {
+        ssize_t sent = send(fd, p, bytes, MSG_NOSIGNAL);
+        if (sent <= 0)
+            return -1;
+
+        p     += sent;
+        bytes -= sent;
+    }
+    return 0;
+}
+
+
+static int netRecvAll(int fd, void* data, size_t bytes) {
+    char* p = (char*)data;
+    while (bytes > 0) {
+        ssize_t received = recv(fd, p, bytes, 0);
+        if (received <= 0)
+            return -1;
+
+        p     += received;
+        bytes -= received;
+    }
+    return 0;
+}
+
+
+/*
+    Send a message header followed by its payload
+*/
+static int netSend(int fd, netMessage* msg, const void* payload) {
+    memcpy(msg->magic, NET_MAGIC, sizeof(msg->magic));
+    if (netSendAll(fd, msg, sizeof(netMessage)) != 0)
+        return -1;
+
+    return (msg->payload? netSendAll(fd, payload, msg->payload):0);
+}
+
+
+/*
+    Receive a message header (checking its magic), leaving the 
+    payload to be received by the caller
+*/
+static int netRecv(int fd, netMessage* msg) {
+    if (netRecvAll(fd, msg, sizeof(netMessage)) != 0 ||
+        memcmp(msg->magic, NET_MAGIC, sizeof(msg->magic)) != 0)
+        return -1;
+
+    return 0;
+}
+
+
+/*
+    Split an address of the form "unix:<path>" or "tcp:<host>:<port>"
+    into a socket address;
+
+    Returns the socket's domain, or -1 if the address isn't valid
+*/
+static int netAddress(const char* address, struct sockaddr_storage* sa, 
+                      socklen_t* length) {
+    memset(sa, 0, sizeof(*sa));
+
+    if (strncmp(address, "unix:", 5) == 0) {
+        struct sockaddr_un* un = (struct sockaddr_un*)sa;
+        if (strlen(address + 5) >= sizeof(un->sun_path))
+            return -1;
+
+        un->sun_family = AF_UNIX;
+        strcpy(un->sun_path, address + 5);
+        *length = sizeof(struct sockaddr_un);
+        return AF_UNIX;
+    }
+
+    if (strncmp(address, "tcp:", 4) == 0) {
+        char host[256];
+        const char* colon = strrchr(address + 4, ':');
+        if (colon == NULL || colon - (address + 4) >= (long)sizeof(host))
+            return -1;
+
+        memcpy(host, address + 4, colon - (address + 4));
+        host[colon - (address + 4)] = '\0';
+
+        struct addrinfo hints, *info;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family   = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host, colon + 1, &hints, &info) != 0)
+            return -1;
+
+        memcpy(sa, info->ai_addr, info->ai_addrlen);
+        *length = info->ai_addrlen;
+        freeaddrinfo(info);
+        return AF_INET;
+    }
+    return -1;
+}
+
+
+/*
+    Listen for workers on an address (see netAddress()), replacing any
+    stale Unix socket file;
+
+    Returns the listening socket, or -1 on failure
+*/
+int netListen(const char* address) {
+    struct sockaddr_storage sa;
+    socklen_t length;
+    int domain = netAddress(address, &sa, &length);
+    if (domain < 0)
+        return -1;
+
+    int fd = socket(domain, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    int on = 1;
+    if (domain == AF_UNIX)
+        unlink(((struct sockaddr_un*)&sa)->sun_path);
+
+    else
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    if (bind(fd, (struct sockaddr*)&sa, length) != 0 || 
+        listen(fd, NET_MAX_WORKERS) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+/*
+    Connect to a coordinator listening on an address;
+
+    Returns the connected socket, or -1 on failure
+*/
+int netConnect(const char* address) {
+    struct sockaddr_storage sa;
+    socklen_t length;
+    int domain = netAddress(address, &sa, &length);
+    if (domain < 0)
+        return -1;
+
+    int fd = socket(domain, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, (struct sockaddr*)&sa, length) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    int on = 1;
+    if (domain == AF_INET)
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    return fd;
+}
+
+
+/*
+    Accept 'workerCount' workers on a listening socket into 'fds';
+
+    Returns 0 on success and -1 on failure
+*/
+int netAccept(int listenFD, int* fds, int workerCount) {
+    int on = 1;
+    for (int w = 0; w < workerCount; w++) {
+        fds[w] = accept(listenFD, NULL, NULL);
+        if (fds[w] < 0)
+            return -1;
+
+        setsockopt(fds[w], IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    return 0;
+}
+
+
+/*
+    Return a plan for tiles of a given size, creating one (and 
+    replacing the oldest) if none of the cached ones fit
+*/
+static dctPlan* netPlanFor(dctPlan** cache, int* nextSlot, int width, 
+                           int height, int blockSize, int totalThreads) {
+    for (int p = 0; p < NET_PLAN_CACHE; p++)
+        if (cache[p] != NULL && cache[p]->width == width && 
+            cache[p]->height == height && cache[p]->blockSize == blockSize)
+            return cache[p];
+
+    int slot = *nextSlot;
+    *nextSlot = (slot + 1) % NET_PLAN_CACHE;
+
+    planDestroy(cache[slot]);
+    cache[slot] = planCreate(width, height, blockSize, PLAN_DOUBLE, totalThreads, 0);
+    return cache[slot];
+}
+
+
+/*
+    Serve tiles sent by a coordinator over a connected socket until it
+    says to quit (or hangs up), transforming each on a plan with 
+    'totalThreads' threads and sending back its coefficients followed
+    by its reconstruction (for PLAN_INVERSE);
+
+    Returns the amount of tiles served, or -1 on failure
+*/
+int netServe(int fd, int totalThreads) {
+    dctPlan* cache[NET_PLAN_CACHE] = {NULL};
+    int nextSlot = 0, served = 0, status = 0;
+    netMessage msg;
+
+    while (netRecv(fd, &msg) == 0 && msg.type == NET_TILE) {
+        int w = msg.width, h = msg.height;
+        dctPlan* plan = netPlanFor(cache, &nextSlot, w, h, msg.blockSize, totalThreads);
+        if (plan == NULL || msg.payload != (uint64_t)w*h*sizeof(double)) {
+            status = -1;
+            break;
+        }
+
+        double* tile = (double*)malloc(2*msg.payload);
+        if (netRecvAll(fd, tile, msg.payload) != 0) {
+            free(tile);
+            status = -1;
+            break;
+        }
+
+        image* srcIMG  = planAllocateImage(plan, 0);
+        image* dctIMG  = planAllocateImage(plan, 0);
+        image* idctIMG = planAllocateImage(plan, 0);
+        for (int x = 0; x < w; x++)
+            for (int y = 0; y < h; y++)
+                srcIMG->m[x][y].i = tile[x*h + y];
+
+        if (msg.direction & PLAN_INVERSE)
+            planExecute(plan, srcIMG, dctIMG, idctIMG);
+
+        else
+            planForward(plan, srcIMG, dctIMG);
+
+        // Coefficients first, then the reconstruction if asked for
+        int images = (msg.direction & PLAN_INVERSE? 2:1);
+        for (int x = 0; x < w; x++) {
+            for (int y = 0; y < h; y++) {
+                tile[x*h + y] = dctIMG->m[x][y].i;
+                if (images == 2)
+                    tile[(size_t)w*h + x*h + y] = idctIMG->m[x][y].i;
+            }
+        }
+
+        msg.type    = NET_RESULT;
+        msg.payload = images*(uint64_t)w*h*sizeof(double);
+        int sent    = netSend(fd, &msg, tile);
+        imDelete(srcIMG, dctIMG, idctIMG);
+        free(tile);
+
+        if (sent != 0) {
+            status = -1;
+            break;
+        }
+        served++;
+    }
+
+    for (int p = 0; p < NET_PLAN_CACHE; p++)
+        planDestroy(cache[p]);
+
+    close(fd);
+    return (status == 0? served:-1);
+}
+
+
+/*
+    Send tile 'index' of an image to a worker
+*/
+static int netSendTile(int fd, image* srcIMG, int index, int tileSize, 
+                       int blockSize, int direction, double* buffer) {
+    int tilesX = (srcIMG->width + tileSize - 1)/tileSize;
+    netMessage msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type      = NET_TILE;
+    msg.x         = (index % tilesX)*tileSize;
+    msg.y         = (index / tilesX)*tileSize;
+    msg.width     = (msg.x + tileSize < (uint32_t)srcIMG->width? (uint32_t)tileSize:srcIMG->width - msg.x);
+    msg.height    = (msg.y + tileSize < (uint32_t)srcIMG->height? (uint32_t)tileSize:srcIMG->height - msg.y);
+    msg.blockSize = blockSize;
+    msg.direction = direction;
+    msg.payload   = (uint64_t)msg.width*msg.height*sizeof(double);
+
+    for (uint32_t x = 0; x < msg.width; x++) {
+        pixel* column = &srcIMG->m[msg.x + x][msg.y];
+        for (uint32_t y = 0; y < msg.height; y++)
+            buffer[x*msg.height + y] = column[y].i;
+    }
+    return netSend(fd, &msg, buffer);
+}
+
+
+/*
+    Receive the result of a tile from a worker and stitch it into the
+    coefficient (and reconstructed) image
+*/
+static int netRecvTile(int fd, image* dctIMG, image* idctIMG, double* buffer) {
+    netMessage msg;
+    if (netRecv(fd, &msg) != 0 || msg.type != NET_RESULT ||
+        msg.x + msg.width > (uint32_t)dctIMG->width || 
+        msg.y + msg.height > (uint32_t)dctIMG->height ||
+        msg.payload > 2*(uint64_t)msg.width*msg.height*sizeof(double) ||
+        netRecvAll(fd, buffer, msg.payload) != 0)
+        return -1;
+
+    size_t plane = (size_t)msg.width*msg.height;
+    for (uint32_t x = 0; x < msg.width; x++) {
+        for (uint32_t y = 0; y < msg.height; y++) {
+            dctIMG->m[msg.x + x][msg.y + y].i = buffer[x*msg.height + y];
+            if (idctIMG != NULL && msg.payload == 2*plane*sizeof(double))
+                idctIMG->m[msg.x + x][msg.y + y].i = buffer[plane + x*msg.height + y];
+        }
+    }
+    return 0;
+}
+
+
+/*
+    Transform an image across connected workers; the image is split 
+    into (tileSize x tileSize) tiles (a multiple of the block size), 
+    each idle worker is sent the next tile, and the coefficients (and
+    reconstruction, for PLAN_INVERSE) sent back are stitched into 
+    'dctIMG' (and 'idctIMG');
+
+    The image's width and height must be multiples of the block size.
+    Returns 0 on success and -1 on failure
+*/
+int netDistribute(const int* fds, int workerCount, image* srcIMG, image* dctIMG,
+                  image* idctIMG, int blockSize, int tileSize, int direction) {
+    if (workerCount < 1 || workerCount > NET_MAX_WORKERS || blockSize < 1 ||
+        srcIMG->width % blockSize || srcIMG->height % blockSize)
+        return -1;
+
+    tileSize      = (tileSize < blockSize? blockSize:tileSize/blockSize*blockSize);
+    int tilesX    = (srcIMG->width + tileSize - 1)/tileSize;
+    int tilesY    = (srcIMG->height + tileSize - 1)/tileSize;
+    int total     = tilesX*tilesY, next = 0, done = 0, status = 0;
+    double* buffer = (double*)malloc(2*(size_t)tileSize*tileSize*sizeof(double));
+
+    struct pollfd pfds[NET_MAX_WORKERS];
+    for (int w = 0; w < workerCount; w++) {
+        pfds[w].fd     = fds[w];
+        pfds[w].events = POLLIN;
+        if (next < total && 
+            netSendTile(fds[w], srcIMG, next++, tileSize, blockSize, direction, buffer) != 0)
+            status = -1;
+    }
+
+    // Hand out one tile at a time, so that a worker is never blocked
+    // on sending back a result while being sent the next tile
+    while (status == 0 && done < total) {
+        if (poll(pfds, workerCount, -1) < 0) {
+            status = -1;
+            break;
+        }
+
+        for (int w = 0; w < workerCount && status == 0; w++) {
+            if (!(pfds[w].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+
+            if (netRecvTile(fds[w], dctIMG, (direction & PLAN_INVERSE? idctIMG:NULL), 
+                            buffer) != 0) {
+                status = -1;
+                break;
+            }
+            done++;
+
+            if (next < total && 
+                netSendTile(fds[w], srcIMG, next++, tileSize, blockSize, direction, buffer) != 0)
+                status = -1;
+        }
+    }
+
+    free(buffer);
+    return status;
+}
+
+
+/*
+    Tell every worker to quit and close the connections to them
+*/
+void netShutdown(const int* fds, int workerCount) {
+    netMessage msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = NET_QUIT;
+
+    for (int w = 0; w < workerCount; w++) {
+        netSend(fds[w], &msg, NULL);
+        close(fds[w]);
+    }
+}
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+#include "tcdct.h"
+
+#define CACHE_EVENT(cache, op, result) \
+    ((cache) | ((op) << 8) | ((result) << 16))
+
+const perfEvent perfSharingEvents[] = {
+    { "L1D read misses", PERF_TYPE_HW_CACHE,
+      CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                  PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    { "LLC misses",      PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { "snoop HITM",      PERF_TYPE_RAW,      0x04d2 },
+    { "task clock (ns)", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+};
+const int perfSharingEventCount = sizeof(perfSharingEvents)/sizeof(perfEvent);
+
+const perfEvent perfCacheEvents[] = {
+    { "L1D read misses",  PERF_TYPE_HW_CACHE,
+      CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                  PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    { "LLC read misses",  PERF_TYPE_HW_CACHE,
+      CACHE_EVENT(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ,
+                  PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    { "dTLB read misses", PERF_TYPE_HW_CACHE,
+      CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ,
+                  PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    { "task clock (ns)",  PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+};
+const int perfCacheEventCount = sizeof(perfCacheEvents)/sizeof(perfEvent);
+
+const perfEvent perfCoreEvents[] = {
+    { "cycles",           PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions",     PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "L1D read misses",  PERF_TYPE_HW_CACHE,
+      CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                  PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    { "LLC misses",       PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { "dTLB read misses", PERF_TYPE_HW_CACHE,
+      CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ,
+                  PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    { "branch misses",    PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+const int perfCoreEventCount = sizeof(perfCoreEvents)/sizeof(perfEvent);
+
+
+/*
+    Check whether the raw events above (encoded for Intel's Haswell to
+    Comet Lake cores, where 0x04d2 is the L3 hit snooping a modified
+    line in another core) mean the same on this CPU
+*/
+static int perfRawSupported(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    static const unsigned char models[] = { 
+        0x3C, 0x3F, 0x45, 0x46,             // Haswell
+        0x3D, 0x47, 0x4F, 0x56,             // Broadwell
+        0x4E, 0x5E, 0x55,                   // Skylake
+        0x8E, 0x9E, 0xA5, 0xA6              // Kaby, Coffee, Comet Lake
+    };
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx) ||
+        ebx != 0x756e6547 || edx != 0x49656e69 || ecx != 0x6c65746e)
+        return 0;
+
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+    unsigned int family = (eax >> 8) & 0xF;
+    unsigned int model  = ((eax >> 4) & 0xF) | ((eax >> 12) & 0xF0);
+    if (family != 6)
+        return 0;
+
+    for (size_t m = 0; m < sizeof(models); m++)
+        if (models[m] == model)
+            return 1;
+#endif
+    return 0;
+}
+
+
+/*
+    Open a (disabled) counter for each event on the calling thread;
+
+    Events the kernel or CPU doesn't support are left with an 'fd'
+    of -1 and read back as 0, as are raw events on CPUs they weren't
+    encoded for. Returns the amount of events opened
+*/
+int perfOpen(perfCounters* pc, const perfEvent* events, int count) {
+    struct perf_event_attr attr;
+    int opened = 0;
+
+    int raw   = perfRawSupported();
+    pc->count = (count > PERF_MAX_EVENTS? PERF_MAX_EVENTS:count);
+    for (int e = 0; e < pc->count; e++) {
+        if (events[e].type == PERF_TYPE_RAW && !raw) {
+            pc->fd[e]     = -1;
+            pc->values[e] = 0;
+            continue;
+        }
+
+        memset(&attr, 0, sizeof(struct perf_event_attr));
+        attr.size           = sizeof(struct perf_event_attr);
+        attr.type           = events[e].type;
+        attr.config         = events[e].config;
+        attr.disabled       = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                              PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        pc->fd[e]     = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        pc->values[e] = 0;
+        if (pc->fd[e] >= 0)
+            opened++;
+    }
+    return opened;
+}
+
+
+void perfStart(perfCounters* pc) {
+    for (int e = 0; e < pc->count; e++) {
+        if (pc->fd[e] < 0)
+            continue;
+
+        ioctl(pc->fd[e], PERF_EVENT_IOC_RESET, 0);
+        ioctl(pc->fd[e], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+
+/*
+    Stop every counter and read its value, scaling it up for the 
+    time the kernel had it multiplexed out
+*/
+void perfStop(perfCounters* pc) {
+    uint64_t data[3];
+    for (int e = 0; e < pc->count; e++) {
+        if (pc->fd[e] < 0)
+            continue;
+
+        ioctl(pc->fd[e], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(pc->fd[e], data, sizeof(data)) != sizeof(data))
+            continue;
+
+        if (data[2] > 0 && data[2] < data[1])
+            pc->values[e] = (uint64_t)((double)data[0]*data[1]/data[2]);
+
+        else
+            pc->values[e] = data[0];
+    }
+}
+
+
+void perfClose(perfCounters* pc) {
+    for (int e = 0; e < pc->count; e++) {
+        if (pc->fd[e] >= 0)
+            close(pc->fd[e]);
+
+        pc->fd[e] = -1;
+    }
+}
@@ -0,0 +1,1939 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "tcdct.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define PLAN_HAVE_AVX2 1
+#endif
+
+// Amount of timed executions per candidate kernel in PLAN_MEASURE
+#define MEASURE_RUNS 3
+
+// Dirty blocks per task of planUpdate(), and the most blocks it
+// transforms on the calling thread rather than waking the workers
+#define UPDATE_CHUNK  32
+#define UPDATE_INLINE 16
+
+// Blocks per task of planExecuteImages() (a multiple of every batch)
+#define IMAGES_CHUNK 64
+
+// Plan execution structure definition
+// --------------------------
+//
+// plan      : Plan being executed
+// srcIMG    : Image read by the forward transform
+// dctIMG    : Image of coefficients (written, or read if inverse only)
+// idctIMG   : Image written by the inverse transform
+// direction : PLAN_FORWARD and/or PLAN_INVERSE
+// blocks    : Amount of blocks in plan->dirtyList (planUpdate())
+//
+typedef struct {
+    dctPlan* plan;
+    image* srcIMG;
+    image* dctIMG;
+    image* idctIMG;
+    int direction;
+    int blocks;
+} planRun;
+
+
+// Coefficient cache structure definition
+// --------------------------
+//
+// stats  : Counters of the blocks the worker transformed forward
+// window : Blocks looked up since the cache was last judged
+// useful : Blocks of 'window' that were flat or found in the cache
+// bypass : Blocks left to transform without looking them up
+// tags   : Hash of the pixels of the block in each entry
+// state  : CACHE_EMPTY, CACHE_COEFFICIENTS or CACHE_RECONSTRUCTED
+// data   : Pixels, coefficients and reconstruction of every entry,
+//          blockSize^2 doubles each
+//
+struct planCache {
+    dctCacheStats stats;
+    int window;
+    int useful;
+    int bypass;
+    uint64_t tags[PLAN_CACHE_ENTRIES];
+    unsigned char state[PLAN_CACHE_ENTRIES];
+    double data[] __attribute__((aligned(CACHE_LINE)));
+};
+
+// Blocks a cache is judged over, and how many blocks bypass it 
+// when fewer than one in CACHE_USEFUL of those were shortcut
+#define CACHE_WINDOW 256
+#define CACHE_BYPASS 2048
+#define CACHE_USEFUL 16
+
+#define CACHE_EMPTY         0
+#define CACHE_COEFFICIENTS  1
+#define CACHE_RECONSTRUCTED 2
+
+
+static const char* kernelNames[KERNEL_COUNT] = { "naive", "separable", "avx2", "batch" };
+static const char* traversalNames[] = { "row", "strip", "morton" };
+
+
+///////////////////////////////////////////
+//               KERNELS                 //
+///////////////////////////////////////////
+
+/*
+    Same sums as imBlockDCT(), over a gathered block
+*/
+static void naiveForward(const dctPlan* plan, const double* in, double* out) {
+    double OOSQT = 1.0/sqrt(2.0);
+    double sum   = 0.0;
+    double HPW   = (double)16.0;
+
+    for (int u = 0; u < 8; u++) {
+        for (int v = 0; v < 8; v++) {
+
+            sum = 0.0;
+            for (int x = 0; x < 8; x++) {
+                for (int y = 0; y < 8; y++) {
+                    sum += in[x*8 + y] *
+                           cos(((2.0*(double)(x)+1.0) * (double)u * M_PI)/HPW) *
+                           cos(((2.0*(double)(y)+1.0) * (double)v * M_PI)/HPW);
+                }
+            }
+            out[u*8 + v] = 0.25 * (u == 0? OOSQT:1.0) * (v == 0? OOSQT:1.0) * sum;
+        }
+    }
+}
+
+
+/*
+    Same sums as imBlockIDCT(), over a gathered block
+*/
+static void naiveInverse(const dctPlan* plan, const double* in, double* out) {
+    double OOSQT = 1.0/sqrt(2.0);
+    double sum   = 0.0;
+    double MPOL  = M_PI/(double)16.0;
+
+    for (int x = 0; x < 8; x++) {
+        for (int y = 0; y < 8; y++) {
+
+            sum = 0.0;
+            for (int u = 0; u < 8; u++) {
+                for (int v = 0; v < 8; v++) {
+                    sum += in[u*8 + v] *
+                           (u == 0? OOSQT:1.0) *
+                           (v == 0? OOSQT:1.0) *
+                           cos((2.0*(double)(x)+1.0) * (double)u * MPOL) *
+                           cos((2.0*(double)(y)+1.0) * (double)v * MPOL);
+                }
+            }
+            out[x*8 + y] = sum * 0.25;
+        }
+    }
+}
+
+
+/*
+    Forward transform as two 1-D passes over the cached basis;
+
+    tmp[u][y] = sum_x C[u][x] * in[x][y]
+    out[u][v] = sum_y tmp[u][y] * C[v][y]
+*/
+static void separableForward(const dctPlan* plan, const double* in, double* out) {
+    int B = plan->blockSize;
+    const double* C  = plan->basis;
+    const double* CT = plan->basisT;
+    double tmp[PLAN_MAX_BLOCK*PLAN_MAX_BLOCK];
+
+    for (int u = 0; u < B; u++) {
+        double* row = &tmp[u*B];
+        for (int y = 0; y < B; y++)
+            row[y] = 0.0;
+
+        for (int x = 0; x < B; x++) {
+            double c = C[u*B + x];
+            for (int y = 0; y < B; y++)
+                row[y] += c * in[x*B + y];
+        }
+    }
+
+    for (int u = 0; u < B; u++) {
+        double* row = &out[u*B];
+        for (int v = 0; v < B; v++)
+            row[v] = 0.0;
+
+        for (int y = 0; y < B; y++) {
+            double t = tmp[u*B + y];
+            for (int v = 0; v < B; v++)
+                row[v] += t * CT[y*B + v];
+        }
+    }
+}
+
+
+/*
+    Inverse transform as two 1-D passes over the cached basis;
+
+    tmp[x][v] = sum_u C[u][x] * in[u][v]
+    out[x][y] = sum_v tmp[x][v] * C[v][y]
+*/
+static void separableInverse(const dctPlan* plan, const double* in, double* out) {
+    int B = plan->blockSize;
+    const double* C  = plan->basis;
+    const double* CT = plan->basisT;
+    double tmp[PLAN_MAX_BLOCK*PLAN_MAX_BLOCK];
+
+    for (int x = 0; x < B; x++) {
+        double* row = &tmp[x*B];
+        for (int v = 0; v < B; v++)
+            row[v] = 0.0;
+
+        for (int u = 0; u < B; u++) {
+            double c = CT[x*B + u];
+            for (int v = 0; v < B; v++)
+                row[v] += c * in[u*B + v];
+        }
+    }
+
+    for (int x = 0; x < B; x++) {
+        double* row = &out[x*B];
+        for (int y = 0; y < B; y++)
+            row[y] = 0.0;
+
+        for (int v = 0; v < B; v++) {
+            double t = tmp[x*B + v];
+            for (int y = 0; y < B; y++)
+                row[y] += t * C[v*B + y];
+        }
+    }
+}
+
+
+/*
+    separableForward() computed in single precision
+*/
+static void separableForwardF(const dctPlan* plan, const double* in, double* out) {
+    int B = plan->blockSize;
+    const float* C  = plan->basisF;
+    const float* CT = plan->basisTF;
+    float src[PLAN_MAX_BLOCK*PLAN_MAX_BLOCK];
+    float tmp[PLAN_MAX_BLOCK*PLAN_MAX_BLOCK];
+
+    for (int k = 0; k < B*B; k++) {
+        src[k] = (float)in[k];
+        tmp[k] = 0.0f;
+    }
+
+    for (int u = 0; u < B; u++)
+        for (int x = 0; x < B; x++) {
+            float c = C[u*B + x];
+            for (int y = 0; y < B; y++)
+                tmp[u*B + y] += c * src[x*B + y];
+        }
+
+    for (int u = 0; u < B; u++) {
+        float row[PLAN_MAX_BLOCK] = {0};
+        for (int y = 0; y < B; y++) {
+            float t = tmp[u*B + y];
+            for (int v = 0; v < B; v++)
+                row[v] += t * CT[y*B + v];
+        }
+
+        for (int v = 0; v < B; v++)
+            out[u*B + v] = (double)row[v];
+    }
+}
+
+
+/*
+    separableInverse() computed in single precision
+*/
+static void separableInverseF(const dctPlan* plan, const double* in, double* out) {
+    int B = plan->blockSize;
+    const float* C  = plan->basisF;
+    const float* CT = plan->basisTF;
+    float src[PLAN_MAX_BLOCK*PLAN_MAX_BLOCK];
+    float tmp[PLAN_MAX_BLOCK*PLAN_MAX_BLOCK];
+
+    for (int k = 0; k < B*B; k++) {
+        src[k] = (float)in[k];
+        tmp[k] = 0.0f;
+    }
+
+    for (int x = 0; x < B; x++)
+        for (int u = 0; u < B; u++) {
+            float c = CT[x*B + u];
+            for (int v = 0; v < B; v++)
+                tmp[x*B + v] += c * src[u*B + v];
+        }
+
+    for (int x = 0; x < B; x++) {
+        float row[PLAN_MAX_BLOCK] = {0};
+        for (int v = 0; v < B; v++) {
+            float t = tmp[x*B + v];
+            for (int y = 0; y < B; y++)
+                row[y] += t * C[v*B + y];
+        }
+
+        for (int y = 0; y < B; y++)
+            out[x*B + y] = (double)row[y];
+    }
+}
+
+
+#ifdef PLAN_HAVE_AVX2
+/*
+    separableForward() for 8x8 blocks, with each row of 8 doubles
+    held in two AVX2 registers and the sums done with FMAs
+*/
+__attribute__((target("avx2,fma")))
+static void avx2Forward(const dctPlan* plan, const double* in, double* out) {
+    const double* C  = plan->basis;
+    const double* CT = plan->basisT;
+    double tmp[64] __attribute__((aligned(32)));
+    __m256d lo[8], hi[8];
+
+    for (int x = 0; x < 8; x++) {
+        lo[x] = _mm256_loadu_pd(&in[x*8]);
+        hi[x] = _mm256_loadu_pd(&in[x*8 + 4]);
+    }
+
+    for (int u = 0; u < 8; u++) {
+        __m256d accLo = _mm256_setzero_pd(), accHi = _mm256_setzero_pd();
+        for (int x = 0; x < 8; x++) {
+            __m256d c = _mm256_broadcast_sd(&C[u*8 + x]);
+            accLo = _mm256_fmadd_pd(c, lo[x], accLo);
+            accHi = _mm256_fmadd_pd(c, hi[x], accHi);
+        }
+        _mm256_store_pd(&tmp[u*8], accLo);
+        _mm256_store_pd(&tmp[u*8 + 4], accHi);
+    }
+
+    for (int y = 0; y < 8; y++) {
+        lo[y] = _mm256_loadu_pd(&CT[y*8]);
+        hi[y] = _mm256_loadu_pd(&CT[y*8 + 4]);
+    }
+
+    for (int u = 0; u < 8; u++) {
+        __m256d accLo = _mm256_setzero_pd(), accHi = _mm256_setzero_pd();
+        for (int y = 0; y < 8; y++) {
+            __m256d t = _mm256_broadcast_sd(&tmp[u*8 + y]);
+            accLo = _mm256_fmadd_pd(t, lo[y], accLo);
+            accHi = _mm256_fmadd_pd(t, hi[y], accHi);
+        }
+        _mm256_storeu_pd(&out[u*8], accLo);
+        _mm256_storeu_pd(&out[u*8 + 4], accHi);
+    }
+}
+
+
+/*
+    separableInverse() for 8x8 blocks with AVX2/FMA (see above)
+*/
+__attribute__((target("avx2,fma")))
+static void avx2Inverse(const dctPlan* plan, const double* in, double* out) {
+    const double* C  = plan->basis;
+    const double* CT = plan->basisT;
+    double tmp[64] __attribute__((aligned(32)));
+    __m256d lo[8], hi[8];
+
+    for (int u = 0; u < 8; u++) {
+        lo[u] = _mm256_loadu_pd(&in[u*8]);
+        hi[u] = _mm256_loadu_pd(&in[u*8 + 4]);
+    }
+
+    for (int x = 0; x < 8; x++) {
+        __m256d accLo = _mm256_setzero_pd(), accHi = _mm256_setzero_pd();
+        for (int u = 0; u < 8; u++) {
+            __m256d c = _mm256_broadcast_sd(&CT[x*8 + u]);
+            accLo = _mm256_fmadd_pd(c, lo[u], accLo);
+            accHi = _mm256_fmadd_pd(c, hi[u], accHi);
+        }
+        _mm256_store_pd(&tmp[x*8], accLo);
+        _mm256_store_pd(&tmp[x*8 + 4], accHi);
+    }
+
+    for (int v = 0; v < 8; v++) {
+        lo[v] = _mm256_loadu_pd(&C[v*8]);
+        hi[v] = _mm256_loadu_pd(&C[v*8 + 4]);
+    }
+
+    for (int x = 0; x < 8; x++) {
+        __m256d accLo = _mm256_setzero_pd(), accHi = _mm256_setzero_pd();
+        for (int v = 0; v < 8; v++) {
+            __m256d t = _mm256_broadcast_sd(&tmp[x*8 + v]);
+            accLo = _mm256_fmadd_pd(t, lo[v], accLo);
+            accHi = _mm256_fmadd_pd(t, hi[v], accHi);
+        }
+        _mm256_storeu_pd(&out[x*8], accLo);
+        _mm256_storeu_pd(&out[x*8 + 4], accHi);
+    }
+}
+#endif
+
+
+
+///////////////////////////////////////////
+//           BATCHED KERNELS             //
+///////////////////////////////////////////
+
+// Vectors of 4 doubles or 8 floats; a batch of N blocks is laid out
+// as [x*B + y][N] (structure of arrays), so one vector holds the same
+// pixel of 4 or 8 different blocks
+typedef double batchD __attribute__((vector_size(32), may_alias));
+typedef float  batchF __attribute__((vector_size(32), may_alias));
+
+// Block of one of the images a batch is gathered from
+typedef struct {
+    image* srcIMG;
+    image* dctIMG;
+    image* idctIMG;
+    int x;
+    int y;
+} planBlock;
+
+
+/*
+    Forward transform of G vectors of blocks in place, as even/odd 
+    butterflies over the cached basis;
+
+    Even rows of the basis are symmetric and odd rows antisymmetric,
+    C[u][B-1-x] = +/-C[u][x], so every 1-D pass only needs the sums
+    (even u) or differences (odd u) of mirrored pixels, halving the
+    multiplies; 'tmp' holds B*B*G vectors
+*/
+static inline __attribute__((always_inline))
+void batchForwardD(const double* C, int B, batchD* in, batchD* tmp, const int G) {
+    int h = B/2;
+    batchD s[PLAN_MAX_BLOCK/2][PLAN_BATCH_LANES/4];
+    batchD d[PLAN_MAX_BLOCK/2][PLAN_BATCH_LANES/4];
+
+    // tmp[u][y] = sum_x C[u][x] * in[x][y]
+    for (int y = 0; y < B; y++) {
+        for (int x = 0; x < h; x++)
+            for (int g = 0; g < G; g++) {
+                batchD a = in[(x*B + y)*G + g], b = in[((B - 1 - x)*B + y)*G + g];
+                s[x][g] = a + b;
+                d[x][g] = a - b;
+            }
+
+        for (int u = 0; u < B; u++) {
+            batchD (*half)[PLAN_BATCH_LANES/4] = (u & 1? d:s);
+            for (int g = 0; g < G; g++) {
+                batchD acc = half[0][g] * C[u*B];
+                for (int x = 1; x < h; x++)
+                    acc += half[x][g] * C[u*B + x];
+                tmp[(u*B + y)*G + g] = acc;
+            }
+        }
+    }
+
+    // out[u][v] = sum_y tmp[u][y] * C[v][y], back into 'in'
+    for (int u = 0; u < B; u++) {
+        for (int y = 0; y < h; y++)
+            for (int g = 0; g < G; g++) {
+                batchD a = tmp[(u*B + y)*G + g], b = tmp[(u*B + B - 1 - y)*G + g];
+                s[y][g] = a + b;
+                d[y][g] = a - b;
+            }
+
+        for (int v = 0; v < B; v++) {
+            batchD (*half)[PLAN_BATCH_LANES/4] = (v & 1? d:s);
+            for (int g = 0; g < G; g++) {
+                batchD acc = half[0][g] * C[v*B];
+                for (int y = 1; y < h; y++)
+                    acc += half[y][g] * C[v*B + y];
+                in[(u*B + v)*G + g] = acc;
+            }
+        }
+    }
+}
+
+
+/*
+    Inverse transform of G vectors of blocks in place, splitting every
+    1-D pass into the even (E) and odd (O) frequencies, where pixel x
+    is E + O and its mirror B-1-x is E - O
+*/
+static inline __attribute__((always_inline))
+void batchInverseD(const double* C, int B, batchD* in, batchD* tmp, const int G) {
+    int h = B/2;
+
+    // tmp[x][v] = sum_u C[u][x] * in[u][v]
+    for (int v = 0; v < B; v++)
+        for (int x = 0; x < h; x++)
+            for (int g = 0; g < G; g++) {
+                batchD e = in[v*G + g] * C[x];
+                batchD o = in[(B + v)*G + g] * C[B + x];
+                for (int u = 2; u < B; u += 2) {
+                    e += in[(u*B + v)*G + g] * C[u*B + x];
+                    o += in[((u + 1)*B + v)*G + g] * C[(u + 1)*B + x];
+                }
+                tmp[(x*B + v)*G + g]           = e + o;
+                tmp[((B - 1 - x)*B + v)*G + g] = e - o;
+            }
+
+    // out[x][y] = sum_v tmp[x][v] * C[v][y], back into 'in'
+    for (int x = 0; x < B; x++)
+        for (int y = 0; y < h; y++)
+            for (int g = 0; g < G; g++) {
+                batchD e = tmp[(x*B)*G + g] * C[y];
+                batchD o = tmp[(x*B + 1)*G + g] * C[B + y];
+                for (int v = 2; v < B; v += 2) {
+                    e += tmp[(x*B + v)*G + g] * C[v*B + y];
+                    o += tmp[(x*B + v + 1)*G + g] * C[(v + 1)*B + y];
+                }
+                in[(x*B + y)*G + g]         = e + o;
+                in[(x*B + B - 1 - y)*G + g] = e - o;
+            }
+}
+
+
+/*
+    batchForwardD() computed in single precision
+*/
+static inline __attribute__((always_inline))
+void batchForwardF(const float* C, int B, batchF* in, batchF* tmp, const int G) {
+    int h = B/2;
+    batchF s[PLAN_MAX_BLOCK/2][PLAN_BATCH_LANES/8];
+    batchF d[PLAN_MAX_BLOCK/2][PLAN_BATCH_LANES/8];
+
+    for (int y = 0; y < B; y++) {
+        for (int x = 0; x < h; x++)
+            for (int g = 0; g < G; g++) {
+                batchF a = in[(x*B + y)*G + g], b = in[((B - 1 - x)*B + y)*G + g];
+                s[x][g] = a + b;
+                d[x][g] = a - b;
+            }
+
+        for (int u = 0; u < B; u++) {
+            batchF (*half)[PLAN_BATCH_LANES/8] = (u & 1? d:s);
+            for (int g = 0; g < G; g++) {
+                batchF acc = half[0][g] * C[u*B];
+                for (int x = 1; x < h; x++)
+                    acc += half[x][g] * C[u*B + x];
+                tmp[(u*B + y)*G + g] = acc;
+            }
+        }
+    }
+
+    for (int u = 0; u < B; u++) {
+        for (int y = 0; y < h; y++)
+            for (int g = 0; g < G; g++) {
+                batchF a = tmp[(u*B + y)*G + g], b = tmp[(u*B + B - 1 - y)*G + g];
+                s[y][g] = a + b;
+                d[y][g] = a - b;
+            }
+
+        for (int v = 0; v < B; v++) {
+            batchF (*half)[PLAN_BATCH_LANES/8] = (v & 1? d:s);
+            for (int g = 0; g < G; g++) {
+                batchF acc = half[0][g] * C[v*B];
+                for (int y = 1; y < h; y++)
+                    acc += half[y][g] * C[v*B + y];
+                in[(u*B + v)*G + g] = acc;
+            }
+        }
+    }
+}
+
+
+/*
+    batchInverseD() computed in single precision
+*/
+static inline __attribute__((always_inline))
+void batchInverseF(const float* C, int B, batchF* in, batchF* tmp, const int G) {
+    int h = B/2;
+
+    for (int v = 0; v < B; v++)
+        for (int x = 0; x < h; x++)
+            for (int g = 0; g < G; g++) {
+                batchF e = in[v*G + g] * C[x];
+                batchF o = in[(B + v)*G + g] * C[B + x];
+                for (int u = 2; u < B; u += 2) {
+                    e += in[(u*B + v)*G + g] * C[u*B + x];
+                    o += in[((u + 1)*B + v)*G + g] * C[(u + 1)*B + x];
+                }
+                tmp[(x*B + v)*G + g]           = e + o;
+                tmp[((B - 1 - x)*B + v)*G + g] = e - o;
+            }
+
+    for (int x = 0; x < B; x++)
+        for (int y = 0; y < h; y++)
+            for (int g = 0; g < G; g++) {
+                batchF e = tmp[(x*B)*G + g] * C[y];
+                batchF o = tmp[(x*B + 1)*G + g] * C[B + y];
+                for (int v = 2; v < B; v += 2) {
+                    e += tmp[(x*B + v)*G + g] * C[v*B + y];
+                    o += tmp[(x*B + v + 1)*G + g] * C[(v + 1)*B + y];
+                }
+                in[(x*B + y)*G + g]         = e + o;
+                in[(x*B + B - 1 - y)*G + g] = e - o;
+            }
+}
+
+
+/*
+    Run the forward or inverse (PLAN_FORWARD or PLAN_INVERSE) batched 
+    transform over a batch of the plan's lanes in 'soa', with the
+    amount of vectors known at compile time for each width of batch
+*/
+static inline __attribute__((always_inline))
+void batchTransform(const dctPlan* plan, void* soa, void* tmp, int direction) {
+    int B = plan->blockSize;
+    if (plan->precision == PLAN_FLOAT) {
+        batchF* in = (batchF*)soa;
+        batchF* t  = (batchF*)tmp;
+        if (direction == PLAN_FORWARD) {
+            if (plan->batchLanes == 8) batchForwardF(plan->basisF, B, in, t, 1);
+            else                       batchForwardF(plan->basisF, B, in, t, 2);
+        }
+        else {
+            if (plan->batchLanes == 8) batchInverseF(plan->basisF, B, in, t, 1);
+            else                       batchInverseF(plan->basisF, B, in, t, 2);
+        }
+        return;
+    }
+
+    batchD* in = (batchD*)soa;
+    batchD* t  = (batchD*)tmp;
+    if (direction == PLAN_FORWARD) {
+        if      (plan->batchLanes == 4) batchForwardD(plan->basis, B, in, t, 1);
+        else if (plan->batchLanes == 8) batchForwardD(plan->basis, B, in, t, 2);
+        else                            batchForwardD(plan->basis, B, in, t, 4);
+    }
+    else {
+        if      (plan->batchLanes == 4) batchInverseD(plan->basis, B, in, t, 1);
+        else if (plan->batchLanes == 8) batchInverseD(plan->basis, B, in, t, 2);
+        else                            batchInverseD(plan->basis, B, in, t, 4);
+    }
+}
+
+
+static void batchTransformGeneric(const dctPlan* plan, void* soa, void* tmp, int direction) {
+    batchTransform(plan, soa, tmp, direction);
+}
+
+#ifdef PLAN_HAVE_AVX2
+__attribute__((target("avx2,fma")))
+static void batchTransformAVX2(const dctPlan* plan, void* soa, void* tmp, int direction) {
+    batchTransform(plan, soa, tmp, direction);
+}
+#endif
+
+
+/*
+    Transform up to plan->batchLanes blocks at once with KERNEL_BATCH,
+    gathering them into the lanes of 'scratch' and scattering the
+    coefficients and/or reconstruction of each back out; unused lanes
+    are zeroed and never scattered
+*/
+static void planBatch(const dctPlan* plan, const planBlock* blocks, int count,
+                      int direction, double* scratch) {
+    int B     = plan->blockSize;
+    int N     = plan->batchLanes;
+    int isF   = (plan->precision == PLAN_FLOAT);
+    double* d = scratch;
+    float* f  = (float*)scratch;
+    void* tmp = scratch + B*B*N;
+
+    // Gather the pixels (or coefficients, inverse only) of each lane
+    for (int l = 0; l < N; l++) {
+        image* im = (l >= count? NULL:(direction & PLAN_FORWARD? blocks[l].srcIMG
+                                                                : blocks[l].dctIMG));
+        for (int x = 0; x < B; x++) {
+            pixel* column = (im == NULL? NULL:&im->m[blocks[l].x + x][blocks[l].y]);
+            for (int y = 0; y < B; y++) {
+                double value = (column == NULL? 0.0:column[y].i);
+                if (isF) f[(x*B + y)*N + l] = (float)value;
+                else     d[(x*B + y)*N + l] = value;
+            }
+        }
+    }
+
+    for (int pass = PLAN_FORWARD; pass <= PLAN_INVERSE; pass <<= 1) {
+        if (!(direction & pass))
+            continue;
+
+#ifdef PLAN_HAVE_AVX2
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            batchTransformAVX2(plan, scratch, tmp, pass);
+        else
+#endif
+            batchTransformGeneric(plan, scratch, tmp, pass);
+
+        for (int l = 0; l < count; l++) {
+            image* im = (pass == PLAN_FORWARD? blocks[l].dctIMG:blocks[l].idctIMG);
+            for (int x = 0; x < B; x++) {
+                pixel* column = &im->m[blocks[l].x + x][blocks[l].y];
+                for (int y = 0; y < B; y++)
+                    column[y].i = (isF? (double)f[(x*B + y)*N + l]:d[(x*B + y)*N + l]);
+            }
+        }
+    }
+}
+
+
+
+///////////////////////////////////////////
+//              PLANNING                 //
+///////////////////////////////////////////
+
+const char* planKernelName(int kernel) {
+    return (kernel >= 0 && kernel < KERNEL_COUNT? kernelNames[kernel]:"unknown");
+}
+
+
+/*
+    Return the KERNEL_* matching a name, or -1 if there is none
+*/
+int planKernelFromName(const char* name) {
+    for (int k = 0; k < KERNEL_COUNT; k++)
+        if (strcmp(name, kernelNames[k]) == 0)
+            return k;
+
+    return -1;
+}
+
+
+/*
+    Return whether a kernel can run blocks of a given size and
+    precision on this host
+*/
+int planKernelSupported(int kernel, int blockSize, int precision) {
+    switch (kernel) {
+        case KERNEL_NAIVE:
+            return (blockSize == 8 && precision == PLAN_DOUBLE);
+
+        case KERNEL_SEPARABLE:
+            return 1;
+
+        case KERNEL_AVX2:
+#ifdef PLAN_HAVE_AVX2
+            return (blockSize == 8 && precision == PLAN_DOUBLE &&
+                    __builtin_cpu_supports("avx2") &&
+                    __builtin_cpu_supports("fma"));
+#else
+            return 0;
+#endif
+
+        case KERNEL_BATCH:
+            return (blockSize % 2 == 0);
+    }
+    return 0;
+}
+
+
+/*
+    Switch the kernel a plan runs;
+
+    Returns 0 on success and -1 if the kernel isn't supported
+*/
+int planSetKernel(dctPlan* plan, int kernel) {
+    if (!planKernelSupported(kernel, plan->blockSize, plan->precision))
+        return -1;
+
+    // Cached coefficients are only reused by the kernel that made them
+    if (plan->cache != NULL && kernel != plan->kernel)
+        for (int i = 0; i < plan->totalThreads; i++)
+            memset(plan->cache[i]->state, CACHE_EMPTY, PLAN_CACHE_ENTRIES);
+
+    plan->kernel = kernel;
+    switch (kernel) {
+        case KERNEL_NAIVE:
+            plan->forward = naiveForward;
+            plan->inverse = naiveInverse;
+            break;
+
+        case KERNEL_SEPARABLE:
+            plan->forward = (plan->precision == PLAN_FLOAT? separableForwardF
+                                                          : separableForward);
+            plan->inverse = (plan->precision == PLAN_FLOAT? separableInverseF
+                                                          : separableInverse);
+            break;
+
+#ifdef PLAN_HAVE_AVX2
+        case KERNEL_AVX2:
+            plan->forward = avx2Forward;
+            plan->inverse = avx2Inverse;
+            break;
+#endif
+
+        // Single blocks (e.g. of planUpdate()) still go one at a time
+        case KERNEL_BATCH:
+            plan->forward = (plan->precision == PLAN_FLOAT? separableForwardF
+                                                          : separableForward);
+            plan->inverse = (plan->precision == PLAN_FLOAT? separableInverseF
+                                                          : separableInverse);
+            break;
+    }
+    return 0;
+}
+
+
+/*
+    Set how many blocks KERNEL_BATCH transforms at once; 4, 8 or 16
+    in double precision, and 8 or 16 in single precision (a vector 
+    holds 8 floats)
+
+    Returns 0 on success and -1 for any other amount
+*/
+int planSetBatch(dctPlan* plan, int lanes) {
+    if ((lanes != 4 && lanes != 8 && lanes != 16) ||
+        (lanes == 4 && plan->precision == PLAN_FLOAT))
+        return -1;
+
+    plan->batchLanes = lanes;
+    return 0;
+}
+
+
+const char* planTraversalName(int traversal) {
+    return (traversal >= TRAVERSE_ROW && traversal <= TRAVERSE_MORTON? 
+            traversalNames[traversal]:"unknown");
+}
+
+
+/*
+    Switch the order the blocks of each band are visited in, and 
+    whether the source of the next block is prefetched;
+
+    The order of every block is worked out here once, so executions
+    only follow the list. Returns 0 on success and -1 if the order
+    doesn't exist
+*/
+int planSetTraversal(dctPlan* plan, int traversal, int prefetch) {
+    if (traversal < TRAVERSE_ROW || traversal > TRAVERSE_MORTON)
+        return -1;
+
+    int B       = plan->blockSize;
+    int blocksX = plan->width/B;
+    int S       = plan->stripBlocks;
+
+    for (int i = 0; i < plan->totalThreads; i++) {
+        int by0    = plan->th[i].start/B;
+        int rows   = (plan->th[i].end - plan->th[i].start)/B;
+        int* order = &plan->order[by0*blocksX];
+        int k      = 0;
+
+        if (traversal == TRAVERSE_ROW) {
+            for (int by = 0; by < rows; by++)
+                for (int bx = 0; bx < blocksX; bx++)
+                    order[k++] = (by0 + by)*blocksX + bx;
+        }
+
+        else if (traversal == TRAVERSE_STRIP) {
+            for (int sx = 0; sx < blocksX; sx += S)
+                for (int by = 0; by < rows; by++)
+                    for (int bx = sx; bx < sx + S && bx < blocksX; bx++)
+                        order[k++] = (by0 + by)*blocksX + bx;
+        }
+
+        // Walk the codes of the smallest power of two square covering
+        // the band, skipping those that fall outside of it
+        else {
+            uint32_t side = 1;
+            while (side < (uint32_t)blocksX || side < (uint32_t)rows)
+                side <<= 1;
+
+            uint64_t codes = (uint64_t)side*side;
+            for (uint64_t code = 0; code < codes && k < rows*blocksX; code++) {
+                uint32_t bx = 0, by = 0;
+                for (int b = 0; b < 32; b++) {
+                    bx |= (uint32_t)((code >> (2*b))     & 1) << b;
+                    by |= (uint32_t)((code >> (2*b + 1)) & 1) << b;
+                }
+
+                if (bx < (uint32_t)blocksX && by < (uint32_t)rows)
+                    order[k++] = (by0 + by)*blocksX + bx;
+            }
+        }
+    }
+
+    plan->traversal = traversal;
+    plan->prefetch  = prefetch;
+    return 0;
+}
+
+
+/*
+    Time every supported kernel on a random image of the plan's size
+    and switch the plan to the fastest one
+*/
+static void planMeasure(dctPlan* plan) {
+    image* srcIMG  = planAllocateImage(plan, 0);
+    image* dctIMG  = planAllocateImage(plan, 0);
+    image* idctIMG = planAllocateImage(plan, 0);
+    imRandomize(srcIMG, plan->height);
+
+    int best = -1;
+    for (int k = 0; k < KERNEL_COUNT; k++) {
+        if (planSetKernel(plan, k) != 0)
+            continue;
+
+        // One untimed execution to warm up the caches and the workers
+        planExecute(plan, srcIMG, dctIMG, idctIMG);
+
+        double fastest = 0.0;
+        for (int r = 0; r < MEASURE_RUNS; r++) {
+            struct timespec start, end;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            planExecute(plan, srcIMG, dctIMG, idctIMG);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+
+            double seconds = (end.tv_sec - start.tv_sec) +
+                             (end.tv_nsec - start.tv_nsec) / 1e9;
+            if (r == 0 || seconds < fastest)
+                fastest = seconds;
+        }
+
+        plan->kernelTime[k] = fastest;
+        if (best == -1 || fastest < plan->kernelTime[best])
+            best = k;
+    }
+
+    planSetKernel(plan, best);
+    imDelete(srcIMG, dctIMG, idctIMG);
+}
+
+
+/*
+    Create a plan for transforming (width x height) images in square
+    blocks of 'blockSize' over 'totalThreads' threads;
+
+    The basis tables, the split of the block rows into one band per
+    thread, per-worker scratch blocks and the workers are all set up
+    here once, so executing the plan has no setup cost. The width
+    must be a multiple of the block size, while the height is padded
+    up to one (see planAllocateImage()). Returns NULL on failure
+*/
+dctPlan* planCreate(int width, int height, int blockSize, int precision,
+                    int totalThreads, int flags) {
+    if (width < 1 || height < 1 || totalThreads < 1 ||
+        blockSize < 2 || blockSize > PLAN_MAX_BLOCK || width % blockSize ||
+        (precision != PLAN_DOUBLE && precision != PLAN_FLOAT))
+        return NULL;
+
+    dctPlan* plan     = (dctPlan*)calloc(1, sizeof(dctPlan));
+    int B             = blockSize;
+    int blockRows     = (height + B - 1)/B;
+    plan->width        = width;
+    plan->height       = height;
+    plan->paddedHeight = blockRows*B;
+    plan->blockSize    = B;
+    plan->precision    = precision;
+    plan->totalThreads = totalThreads;
+
+    // Basis C[u][x] = s(u) * cos((2x + 1) * u * PI / 2B), where the
+    // scaling s(u) is sqrt(1/B) for u = 0 and sqrt(2/B) otherwise
+    plan->basis   = (double*)malloc(B*B*sizeof(double));
+    plan->basisT  = (double*)malloc(B*B*sizeof(double));
+    plan->basisF  = (float*)malloc(B*B*sizeof(float));
+    plan->basisTF = (float*)malloc(B*B*sizeof(float));
+    for (int u = 0; u < B; u++) {
+        double s = (u == 0? sqrt(1.0/B):sqrt(2.0/B));
+        for (int x = 0; x < B; x++) {
+            double c = s * cos((2.0*x + 1.0) * u * M_PI/(2.0*B));
+            plan->basis[u*B + x]   = plan->basisT[x*B + u]  = c;
+            plan->basisF[u*B + x]  = plan->basisTF[x*B + u] = (float)c;
+        }
+    }
+
+    // Split the block rows evenly over the threads, so that every
+    // band starts on a block boundary, which is also a cache line
+    // boundary for even block sizes (two 32-byte pixels per line)
+    plan->th = (threadInfo*)aligned_alloc(CACHE_LINE,
+                                          totalThreads*sizeof(threadInfo));
+    memset(plan->th, 0, totalThreads*sizeof(threadInfo));
+    for (int i = 0; i < totalThreads; i++) {
+        plan->th[i].threadIndex = i;
+        plan->th[i].start       = (i*blockRows/totalThreads)*B;
+        plan->th[i].end         = ((i + 1)*blockRows/totalThreads)*B;
+        plan->th[i].padIndex    = height;
+        plan->th[i].cpu         = -1;
+    }
+
+    // Two scratch blocks per worker, each on its own cache lines
+    plan->scratchSize = (2*B*B*sizeof(double) + CACHE_LINE - 1)
+                        / CACHE_LINE * CACHE_LINE / sizeof(double);
+    plan->scratch     = (double*)aligned_alloc(CACHE_LINE, totalThreads*
+                                  plan->scratchSize*sizeof(double));
+
+    // And a batch of blocks plus as much again for the passes
+    plan->batchLanes   = 8;
+    plan->batchScratch = (double*)aligned_alloc(CACHE_LINE, totalThreads*
+                          2*B*B*PLAN_BATCH_LANES*sizeof(double));
+
+    plan->pool     = poolCreate(totalThreads, (flags & PLAN_PINNED) != 0);
+    plan->ownsPool = 1;
+    if (plan->pool == NULL) {
+        planDestroy(plan);
+        return NULL;
+    }
+
+    // One flag per block for marking the blocks of dirty rectangles
+    int blocks      = (width/B)*blockRows;
+    plan->dirty     = (unsigned char*)calloc(blocks, 1);
+    plan->dirtyList = (int*)malloc(blocks*sizeof(int));
+
+    // Strips as wide as the blocks of all three images fitting in L1
+    long l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    plan->stripBlocks = (int)((l1 > 0? l1:32768)/(3*B*B*sizeof(pixel)));
+    if (plan->stripBlocks < 1)
+        plan->stripBlocks = 1;
+
+    plan->order = (int*)malloc(blocks*sizeof(int));
+    planSetTraversal(plan, TRAVERSE_STRIP, 1);
+
+    if (planSetKernel(plan, KERNEL_AVX2) != 0 && 
+        planSetKernel(plan, KERNEL_BATCH) != 0)
+        planSetKernel(plan, KERNEL_SEPARABLE);
+
+    if (flags & PLAN_MEASURE)
+        planMeasure(plan);
+
+    if ((flags & PLAN_DEDUP) && planSetDedup(plan, 1) != 0) {
+        planDestroy(plan);
+        return NULL;
+    }
+
+    return plan;
+}
+
+
+/*
+    Allocate an image (with the given IM_ALLOC_* flags) that a plan
+    can be executed on, i.e. of the plan's padded height;
+
+    Only the padded rows are zeroed, so that the rows of each band
+    are still first touched by whoever writes them next
+*/
+image* planAllocateImage(dctPlan* plan, int flags) {
+    image* im = allocateImageFlags(plan->width, plan->paddedHeight, 1, flags);
+    for (int x = 0; x < plan->width; x++)
+        for (int y = plan->height; y < plan->paddedHeight; y++)
+            memset(&im->m[x][y], 0, sizeof(pixel));
+
+    return im;
+}
+
+
+/*
+    Switch whether a plan shortcuts flat and repeated blocks;
+
+    A flat block (every pixel the same value v) transforms to a lone
+    DC term of blockSize*v, and other blocks are looked up by the hash
+    of their pixels in a small cache of each worker, reusing the
+    coefficients (and reconstruction) of the last block with the exact
+    same pixels. Returns 0 on success and -1 if the caches can't be 
+    allocated
+*/
+int planSetDedup(dctPlan* plan, int enabled) {
+    int B = plan->blockSize;
+    if (enabled && plan->cache == NULL) {
+        size_t size = sizeof(struct planCache) + 
+                      (size_t)3*PLAN_CACHE_ENTRIES*B*B*sizeof(double);
+        size = (size + CACHE_LINE - 1)/CACHE_LINE*CACHE_LINE;
+
+        plan->cache = (struct planCache**)calloc(plan->totalThreads, 
+                                                 sizeof(struct planCache*));
+        for (int i = 0; i < plan->totalThreads; i++) {
+            plan->cache[i] = (struct planCache*)aligned_alloc(CACHE_LINE, size);
+            if (plan->cache[i] == NULL) {
+                while (i-- > 0)
+                    free(plan->cache[i]);
+
+                free(plan->cache);
+                plan->cache = NULL;
+                return -1;
+            }
+
+            memset(plan->cache[i], 0, sizeof(struct planCache));
+        }
+    }
+
+    plan->dedup = enabled;
+    return 0;
+}
+
+
+/*
+    Sum the cache statistics of every worker into 'stats', and start
+    counting from zero again if 'reset' is set
+*/
+void planCacheStats(dctPlan* plan, dctCacheStats* stats, int reset) {
+    memset(stats, 0, sizeof(dctCacheStats));
+    if (plan->cache == NULL)
+        return;
+
+    for (int i = 0; i < plan->totalThreads; i++) {
+        stats->blocks += plan->cache[i]->stats.blocks;
+        stats->flat   += plan->cache[i]->stats.flat;
+        stats->hits   += plan->cache[i]->stats.hits;
+        if (reset)
+            memset(&plan->cache[i]->stats, 0, sizeof(dctCacheStats));
+    }
+}
+
+
+/*
+    Empty the cache of every worker, so that the next execution only
+    reuses blocks repeated within the images it transforms (the
+    statistics are kept)
+*/
+void planCacheClear(dctPlan* plan) {
+    if (plan->cache == NULL)
+        return;
+
+    for (int i = 0; i < plan->totalThreads; i++) {
+        struct planCache* cache = plan->cache[i];
+        memset(cache->state, CACHE_EMPTY, sizeof(cache->state));
+        cache->window = 0;
+        cache->useful = 0;
+        cache->bypass = 0;
+    }
+}
+
+
+/*
+    Hash the pixels of a gathered block, setting 'flat' to whether 
+    they are all the same value;
+
+    Four independent lanes of multiply-xorshift over the bits of the
+    values, so the hash doesn't wait on one long chain of multiplies
+*/
+static inline uint64_t planHashBlock(const double* in, int n, int* flat) {
+    uint64_t h[4] = { 0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full,
+                      0x165667B19E3779F9ull, 0x27D4EB2F165667C5ull };
+    int same = 1;
+    for (int i = 0; i < n; i++) {
+        uint64_t w;
+        memcpy(&w, &in[i], sizeof(uint64_t));
+        h[i & 3]  = (h[i & 3] ^ w) * 0xFF51AFD7ED558CCDull;
+        h[i & 3] ^= h[i & 3] >> 29;
+        same     &= (in[i] == in[0]);
+    }
+
+    *flat = same;
+    return (h[0] ^ (h[1] << 1)) + (h[2] ^ (h[3] >> 1)) * 0xC4CEB9FE1A85EC53ull;
+}
+
+
+/*
+    Return whether every pixel of a gathered block is the same value
+*/
+static inline int planIsFlat(const double* in, int n) {
+    int same = 1;
+    for (int i = 1; i < n; i++)
+        same &= (in[i] == in[0]);
+
+    return same;
+}
+
+
+/*
+    Forward transform of a gathered block through a worker's cache;
+
+    Content where (almost) nothing is flat or repeated, like noise, 
+    would only pay for the hashing and copying, so a cache that
+    shortcuts too few blocks is bypassed (still transforming flat 
+    blocks to their DC term) for a while before being tried again.
+    Returns 1 if 'in' was also replaced by the block's reconstruction
+    (only when 'inverse' is set), and 0 if the inverse still has to
+    be run on 'out'
+*/
+static int planForwardCached(const dctPlan* plan, struct planCache* cache,
+                             double* in, double* out, int inverse) {
+    int n = plan->blockSize*plan->blockSize;
+    int flat;
+    uint64_t hash = 0;
+    cache->stats.blocks++;
+
+    if (cache->bypass > 0) {
+        cache->bypass--;
+        flat = planIsFlat(in, n);
+    }
+
+    else {
+        hash = planHashBlock(in, n, &flat);
+        if (++cache->window == CACHE_WINDOW) {
+            if (cache->useful*CACHE_USEFUL < CACHE_WINDOW)
+                cache->bypass = CACHE_BYPASS;
+
+            cache->window = cache->useful = 0;
+        }
+    }
+
+    // A flat block reconstructs to exactly the pixels it already has
+    if (flat) {
+        cache->stats.flat++;
+        cache->useful++;
+        memset(out, 0, n*sizeof(double));
+        out[0] = plan->blockSize*in[0];
+        return inverse;
+    }
+
+    if (cache->bypass > 0) {
+        plan->forward(plan, in, out);
+        return 0;
+    }
+
+    int e          = (int)(hash & (PLAN_CACHE_ENTRIES - 1));
+    double* pixels = cache->data + (size_t)3*e*n;
+    double* coefs  = pixels + n;
+    double* recon  = coefs + n;
+
+    if (cache->state[e] != CACHE_EMPTY && cache->tags[e] == hash &&
+        memcmp(pixels, in, n*sizeof(double)) == 0) {
+        cache->stats.hits++;
+        cache->useful++;
+        memcpy(out, coefs, n*sizeof(double));
+        if (!inverse || cache->state[e] != CACHE_RECONSTRUCTED)
+            return 0;
+
+        memcpy(in, recon, n*sizeof(double));
+        return 1;
+    }
+
+    memcpy(pixels, in, n*sizeof(double));
+    plan->forward(plan, in, out);
+    memcpy(coefs, out, n*sizeof(double));
+    cache->tags[e]  = hash;
+    cache->state[e] = CACHE_COEFFICIENTS;
+    if (!inverse)
+        return 0;
+
+    plan->inverse(plan, out, in);
+    memcpy(recon, in, n*sizeof(double));
+    cache->state[e] = CACHE_RECONSTRUCTED;
+    return 1;
+}
+
+
+/*
+    Inverse transform of a gathered block with only a DC term, which
+    is the DC term over blockSize in every pixel;
+
+    Returns 0 (leaving 'out' alone) if any other coefficient is set
+*/
+static int planInverseFlat(const dctPlan* plan, const double* in, double* out) {
+    int n = plan->blockSize*plan->blockSize;
+    for (int i = 1; i < n; i++)
+        if (in[i] != 0.0)
+            return 0;
+
+    double value = in[0]/plan->blockSize;
+    for (int i = 0; i < n; i++)
+        out[i] = value;
+
+    return 1;
+}
+
+
+/*
+    Check that an image can be used with a plan
+*/
+static int planFits(dctPlan* plan, image* im) {
+    return (im != NULL && im->width == plan->width &&
+            im->height >= plan->paddedHeight);
+}
+
+
+/*
+    Prefetch every cache line of the (B x B) block at (i, j) of an 
+    image, to be read shortly
+*/
+static inline void planPrefetch(image* im, int i, int j, int B) {
+    for (int x = 0; x < B; x++) {
+        const char* column = (const char*)&im->m[i + x][j];
+        for (size_t b = 0; b < B*sizeof(pixel); b += CACHE_LINE)
+            __builtin_prefetch(column + b, 0, 3);
+    }
+}
+
+
+/*
+    Run the blocks of one band through KERNEL_BATCH, a batch of the
+    plan's lanes at a time in the order of the traversal, traced as a
+    strip whenever a row's worth of blocks has been done
+*/
+static void planBatchBand(planRun* run, int threadIndex, const int* order, 
+                          int count, int workerIndex) {
+    dctPlan* plan = run->plan;
+    int B         = plan->blockSize;
+    int blocksX   = plan->width/B;
+    int N         = plan->batchLanes;
+    double* soa   = plan->batchScratch + (size_t)workerIndex*2*B*B*PLAN_BATCH_LANES;
+    planBlock blocks[PLAN_BATCH_LANES];
+
+    uint64_t stripStart = traceStripBegin();
+    int done = 0;
+    for (int k = 0; k < count; k += N) {
+        int n = (count - k < N? count - k:N);
+        for (int l = 0; l < n; l++) {
+            planBlock block = { run->srcIMG, run->dctIMG, run->idctIMG, 
+                                (order[k + l] % blocksX)*B, (order[k + l] / blocksX)*B };
+            blocks[l] = block;
+        }
+
+        planBatch(plan, blocks, n, run->direction, soa);
+
+        if ((done += n) >= blocksX) {
+            traceStripEnd(threadIndex, blocks[n - 1].y, blocksX, stripStart);
+            stripStart = traceStripBegin();
+            done      -= blocksX;
+        }
+    }
+}
+
+
+/*
+    Run 'count' blocks of the plan's traversal order through its 
+    kernels, traced (as 'threadIndex') as strips of as many blocks as
+    there are in a row of blocks
+*/
+static void planRunBlocks(planRun* run, int threadIndex, const int* order,
+                          int count, int workerIndex) {
+    dctPlan* plan  = run->plan;
+    int B          = plan->blockSize;
+    double* in     = plan->scratch + (size_t)workerIndex*plan->scratchSize;
+    double* out    = in + B*B;
+    struct planCache* cache = (plan->dedup? plan->cache[workerIndex]:NULL);
+
+    int blocksX  = plan->width/B;
+    image* input = (run->direction & PLAN_FORWARD? run->srcIMG:run->dctIMG);
+    uint64_t stripStart = 0;
+
+    // Whole batches of blocks at once
+    if (plan->kernel == KERNEL_BATCH)
+        planBatchBand(run, threadIndex, order, count, workerIndex);
+
+    else {
+        for (int k = 0; k < count; k++) {
+            int x = (order[k] % blocksX)*B;
+            int y = (order[k] / blocksX)*B;
+
+            if (k % blocksX == 0)
+                stripStart = traceStripBegin();
+
+            if (plan->prefetch && k + 1 < count)
+                planPrefetch(input, (order[k + 1] % blocksX)*B, 
+                                    (order[k + 1] / blocksX)*B, B);
+
+            if (run->direction & PLAN_FORWARD) {
+                int reconstructed = 0;
+                planGather(run->srcIMG, in, x, y, B);
+                if (cache != NULL)
+                    reconstructed = planForwardCached(plan, cache, in, out,
+                                                      run->direction & PLAN_INVERSE);
+                else
+                    plan->forward(plan, in, out);
+
+                planScatter(run->dctIMG, out, x, y, B);
+
+                // The coefficients are still in 'out' for the inverse
+                if (run->direction & PLAN_INVERSE) {
+                    if (!reconstructed)
+                        plan->inverse(plan, out, in);
+                    planScatter(run->idctIMG, in, x, y, B);
+                }
+            }
+
+            else {
+                planGather(run->dctIMG, in, x, y, B);
+                if (cache == NULL || !planInverseFlat(plan, in, out))
+                    plan->inverse(plan, in, out);
+                planScatter(run->idctIMG, out, x, y, B);
+            }
+
+            if (k % blocksX == blocksX - 1)
+                traceStripEnd(threadIndex, y, blocksX, stripStart);
+        }
+    }
+}
+
+
+/*
+    Run the blocks of one band through the plan's kernels
+*/
+static void planBandTask(void* arg, int taskIndex, int workerIndex) {
+    planRun* run   = (planRun*)arg;
+    dctPlan* plan  = run->plan;
+    threadInfo* th = &plan->th[taskIndex];
+    int blocksX    = plan->width/plan->blockSize;
+
+    // Count this band's events over the whole band
+    if (th->perfEventCount) {
+        perfOpen(&th->perf, th->perfEvents, th->perfEventCount);
+        perfStart(&th->perf);
+    }
+
+    // The band's blocks in the order of the plan's traversal
+    traceThreadBegin(th->threadIndex);
+    planRunBlocks(run, th->threadIndex, &plan->order[(th->start/plan->blockSize)*blocksX],
+                  (th->end - th->start)/plan->blockSize*blocksX, workerIndex);
+    traceThreadEnd(th->threadIndex);
+
+    if (th->perfEventCount) {
+        perfStop(&th->perf);
+        perfClose(&th->perf);
+    }
+}
+
+
+/*
+    Run every band of a plan on its workers
+*/
+static int planRunBands(dctPlan* plan, image* srcIMG, image* dctIMG,
+                        image* idctIMG, int direction) {
+    planRun run = { plan, srcIMG, dctIMG, idctIMG, direction, 0 };
+    poolRun(plan->pool, planBandTask, &run, plan->totalThreads, POOL_STATIC);
+    return 0;
+}
+
+
+/*
+    Perform a DCT -> IDCT over every block of 'srcIMG', writing the
+    coefficients to 'dctIMG' and the reconstruction to 'idctIMG'
+    (the same work imProcess() does);
+
+    Returns 0 on success and -1 if an image doesn't fit the plan
+*/
+int planExecute(dctPlan* plan, image* srcIMG, image* dctIMG, image* idctIMG) {
+    if (!planFits(plan, srcIMG) || !planFits(plan, dctIMG) || !planFits(plan, idctIMG))
+        return -1;
+
+    return planRunBands(plan, srcIMG, dctIMG, idctIMG, PLAN_FORWARD | PLAN_INVERSE);
+}
+
+
+/*
+    Perform only the forward DCT of 'srcIMG' into 'dctIMG'
+*/
+int planForward(dctPlan* plan, image* srcIMG, image* dctIMG) {
+    if (!planFits(plan, srcIMG) || !planFits(plan, dctIMG))
+        return -1;
+
+    return planRunBands(plan, srcIMG, dctIMG, NULL, PLAN_FORWARD);
+}
+
+
+/*
+    Perform only the inverse DCT of 'dctIMG' into 'outIMG'
+*/
+int planInverse(dctPlan* plan, image* dctIMG, image* outIMG) {
+    if (!planFits(plan, dctIMG) || !planFits(plan, outIMG))
+        return -1;
+
+    return planRunBands(plan, NULL, dctIMG, outIMG, PLAN_INVERSE);
+}
+
+
+// Execution over several images structure definition
+// --------------------------
+//
+// plan    : Plan being executed
+// count   : Amount of images
+// srcIMG  : Source of each image
+// dctIMG  : Coefficients of each image
+// idctIMG : Reconstruction of each image
+// blocks  : Amount of blocks over all of the images
+//
+typedef struct {
+    dctPlan* plan;
+    int count;
+    image** srcIMG;
+    image** dctIMG;
+    image** idctIMG;
+    int blocks;
+} planImagesRun;
+
+
+/*
+    Transform one chunk of the blocks of all images on a worker, with
+    the blocks of consecutive images packed into the same batches
+*/
+static void planImagesTask(void* arg, int taskIndex, int workerIndex) {
+    planImagesRun* run = (planImagesRun*)arg;
+    dctPlan* plan      = run->plan;
+    int B              = plan->blockSize;
+    int blocksX        = plan->width/B;
+    int perImage       = blocksX*(plan->paddedHeight/B);
+    int first          = taskIndex*IMAGES_CHUNK;
+    int last           = (first + IMAGES_CHUNK < run->blocks? first + IMAGES_CHUNK
+                                                            : run->blocks);
+    planBlock blocks[PLAN_BATCH_LANES];
+
+    for (int k = first; k < last; ) {
+        int n = (plan->kernel == KERNEL_BATCH? plan->batchLanes:1);
+        if (n > last - k)
+            n = last - k;
+
+        for (int l = 0; l < n; l++, k++) {
+            int i = k/perImage, b = k%perImage;
+            planBlock block = { run->srcIMG[i], run->dctIMG[i], run->idctIMG[i],
+                                (b % blocksX)*B, (b / blocksX)*B };
+            blocks[l] = block;
+        }
+
+        if (plan->kernel == KERNEL_BATCH) {
+            planBatch(plan, blocks, n, PLAN_FORWARD | PLAN_INVERSE, plan->batchScratch +
+                      (size_t)workerIndex*2*B*B*PLAN_BATCH_LANES);
+            continue;
+        }
+
+        double* in  = plan->scratch + (size_t)workerIndex*plan->scratchSize;
+        double* out = in + B*B;
+        planGather(blocks[0].srcIMG, in, blocks[0].x, blocks[0].y, B);
+        plan->forward(plan, in, out);
+        planScatter(blocks[0].dctIMG, out, blocks[0].x, blocks[0].y, B);
+        plan->inverse(plan, out, in);
+        planScatter(blocks[0].idctIMG, in, blocks[0].x, blocks[0].y, B);
+    }
+}
+
+
+/*
+    Perform a DCT -> IDCT over every block of 'count' images of the
+    plan's size at once, e.g. of a batch of thumbnails;
+
+    The blocks of all images are split over the workers together, and
+    with KERNEL_BATCH the blocks of one image and the next share the
+    same batches, so the lanes stay full however few blocks each image
+    has. Returns 0 on success and -1 if an image doesn't fit the plan
+*/
+int planExecuteImages(dctPlan* plan, int count, image** srcIMG,
+                      image** dctIMG, image** idctIMG) {
+    for (int i = 0; i < count; i++)
+        if (!planFits(plan, srcIMG[i]) || !planFits(plan, dctIMG[i]) || 
+            !planFits(plan, idctIMG[i]))
+            return -1;
+
+    int B      = plan->blockSize;
+    int blocks = count*(plan->width/B)*(plan->paddedHeight/B);
+    planImagesRun run = { plan, count, srcIMG, dctIMG, idctIMG, blocks };
+    poolRun(plan->pool, planImagesTask, &run, 
+            (blocks + IMAGES_CHUNK - 1)/IMAGES_CHUNK, POOL_DYNAMIC);
+    return 0;
+}
+
+
+/*
+    Transform the blocks of dirty rectangles with a given index into
+    plan->dirtyList, using 'in' and 'out' as scratch
+*/
+static void planUpdateBlocks(planRun* run, int first, int last, 
+                             double* in, double* out) {
+    dctPlan* plan = run->plan;
+    int B         = plan->blockSize;
+    int blocksX   = plan->width/B;
+
+    for (int k = first; k < last; k++) {
+        int x = (plan->dirtyList[k] % blocksX)*B;
+        int y = (plan->dirtyList[k] / blocksX)*B;
+
+        planGather(run->srcIMG, in, x, y, B);
+        plan->forward(plan, in, out);
+        planScatter(run->dctIMG, out, x, y, B);
+        plan->inverse(plan, out, in);
+        planScatter(run->idctIMG, in, x, y, B);
+    }
+}
+
+
+/*
+    Transform one chunk of the dirty blocks on a worker
+*/
+static void planUpdateTask(void* arg, int taskIndex, int workerIndex) {
+    planRun* run  = (planRun*)arg;
+    dctPlan* plan = run->plan;
+    double* in    = plan->scratch + (size_t)workerIndex*plan->scratchSize;
+    int first     = taskIndex*UPDATE_CHUNK;
+    int last      = first + UPDATE_CHUNK;
+
+    planUpdateBlocks(run, first, (last < run->blocks? last:run->blocks),
+                     in, in + plan->blockSize*plan->blockSize);
+}
+
+
+/*
+    Re-transform (DCT -> IDCT) only the blocks overlapping any of the 
+    given rectangles of 'srcIMG', updating those blocks of 'dctIMG' 
+    and 'idctIMG' in place;
+
+    Every block is transformed once however many rectangles overlap
+    it, so the work is proportional to the edited area rather than to
+    the image. Rectangles are clipped to the image. Returns the amount
+    of blocks transformed, or -1 if an image doesn't fit the plan
+*/
+int planUpdate(dctPlan* plan, image* srcIMG, image* dctIMG, image* idctIMG,
+               const dctRect* rects, int rectCount) {
+    if (!planFits(plan, srcIMG) || !planFits(plan, dctIMG) || !planFits(plan, idctIMG))
+        return -1;
+
+    int B       = plan->blockSize;
+    int blocksX = plan->width/B;
+    int count   = 0;
+
+    // Collect every block overlapped by a rectangle exactly once
+    for (int r = 0; r < rectCount; r++) {
+        int x0 = (rects[r].x < 0? 0:rects[r].x);
+        int y0 = (rects[r].y < 0? 0:rects[r].y);
+        int x1 = rects[r].x + rects[r].width;
+        int y1 = rects[r].y + rects[r].height;
+        if (x1 > plan->width)        x1 = plan->width;
+        if (y1 > plan->paddedHeight) y1 = plan->paddedHeight;
+
+        for (int by = y0/B; by*B < y1; by++) {
+            for (int bx = x0/B; bx*B < x1; bx++) {
+                int index = by*blocksX + bx;
+                if (!plan->dirty[index]) {
+                    plan->dirty[index]       = 1;
+                    plan->dirtyList[count++] = index;
+                }
+            }
+        }
+    }
+
+    planRun run = { plan, srcIMG, dctIMG, idctIMG, PLAN_FORWARD | PLAN_INVERSE, count };
+    if (count <= UPDATE_INLINE) {
+        double scratch[2*PLAN_MAX_BLOCK*PLAN_MAX_BLOCK];
+        planUpdateBlocks(&run, 0, count, scratch, scratch + B*B);
+    }
+
+    else
+        poolRun(plan->pool, planUpdateTask, &run, 
+                (count + UPDATE_CHUNK - 1)/UPDATE_CHUNK, POOL_DYNAMIC);
+
+    for (int k = 0; k < count; k++)
+        plan->dirty[plan->dirtyList[k]] = 0;
+
+    return count;
+}
+
+
+/*
+    Zero one band of rows in each of the run's (non-NULL) images
+*/
+static void planTouchTask(void* arg, int taskIndex, int workerIndex) {
+    planRun* run   = (planRun*)arg;
+    threadInfo* th = &run->plan->th[taskIndex];
+    image* images[3] = { run->srcIMG, run->dctIMG, run->idctIMG };
+
+    size_t bytes = (th->end - th->start)*sizeof(pixel);
+    for (int i = 0; i < 3; i++) {
+        if (images[i] == NULL || bytes == 0)
+            continue;
+
+        for (int x = 0; x < images[i]->width; x++)
+            memset(&images[i]->m[x][th->start], 0, bytes);
+    }
+}
+
+
+/*
+    Have the worker of each band be the first to write to that band
+    in every given image (see imFirstTouch()); only meaningful for
+    plans created with PLAN_PINNED
+*/
+void planFirstTouch(dctPlan* plan, image* srcIMG, image* dctIMG, image* idctIMG) {
+    planRun run = { plan, srcIMG, dctIMG, idctIMG, 0, 0 };
+    poolRun(plan->pool, planTouchTask, &run, plan->totalThreads, POOL_STATIC);
+}
+
+
+void planDestroy(dctPlan* plan) {
+    if (plan == NULL)
+        return;
+
+    if (plan->ownsPool)
+        poolDestroy(plan->pool);
+
+    free(plan->basis);
+    free(plan->basisT);
+    free(plan->basisF);
+    free(plan->basisTF);
+    free(plan->th);
+    free(plan->scratch);
+    free(plan->batchScratch);
+    free(plan->dirty);
+    free(plan->dirtyList);
+    free(plan->order);
+    if (plan->cache != NULL)
+        for (int i = 0; i < plan->totalThreads; i++)
+            free(plan->cache[i]);
+
+    free(plan->cache);
+    free(plan);
+}
+
+
+/*
+    Have a plan run on the workers of another plan (with as many of
+    them), e.g. so that previews and bulk transforms of different sizes
+    are scheduled against each other, destroying its own;
+
+    'owner' has to outlive the plan. Returns -1 if the amounts of
+    workers differ and 0 otherwise
+*/
+int planSharePool(dctPlan* plan, dctPlan* owner) {
+    if (plan->totalThreads != owner->totalThreads)
+        return -1;
+
+    if (plan->ownsPool)
+        poolDestroy(plan->pool);
+
+    plan->pool     = owner->pool;
+    plan->ownsPool = 0;
+    return 0;
+}
+
+
+// Plan job structure definition
+// --------------------------
+//
+// run         : What the job computes
+// plan        : Plan the job runs on
+// job         : Pool job running the rows
+// callback    : Function run when the job finishes (or NULL)
+// callbackArg : Argument passed along to 'callback'
+// rowsDone    : Rows of blocks transformed so far (atomic)
+// cancelled   : Set once the rows left should be skipped (atomic)
+//
+struct dctJob {
+    planRun run;
+    dctPlan* plan;
+    poolJob* job;
+    dctJobCallback callback;
+    void* callbackArg;
+    int rowsDone;
+    int cancelled;
+};
+
+
+/*
+    Run a row's worth of blocks of the plan's traversal order (the 
+    blocks of one row of blocks, or a row's share of a band's blocks
+    in the plan's traversal), as a task other jobs can preempt between;
+
+    Rows of a cancelled job are skipped
+*/
+static void planRowTask(void* arg, int taskIndex, int workerIndex) {
+    dctJob* dj    = (dctJob*)arg;
+    dctPlan* plan = dj->plan;
+    int blocksX   = plan->width/plan->blockSize;
+
+    if (__atomic_load_n(&dj->cancelled, __ATOMIC_ACQUIRE))
+        return;
+
+    planRunBlocks(&dj->run, workerIndex, &plan->order[taskIndex*blocksX], blocksX, 
+                  workerIndex);
+    __atomic_fetch_add(&dj->rowsDone, 1, __ATOMIC_RELEASE);
+}
+
+
+/*
+    Pass the completion of a pool job on to its plan job's callback
+*/
+static void planJobDone(poolJob* job, void* arg) {
+    dctJob* dj = (dctJob*)arg;
+    dj->callback(dj, dj->callbackArg);
+}
+
+
+/*
+    Queue a transform of 'direction' (PLAN_FORWARD and/or PLAN_INVERSE,
+    with the same images as planForward(), planInverse() or 
+    planExecute()) on the plan's workers and return right away;
+
+    Several jobs can be in flight on a plan at once, from any thread,
+    as long as they don't write to the same images. 'callback' (if not
+    NULL) runs on a worker once the job has finished. Returns NULL if
+    an image doesn't fit the plan, and otherwise a handle that must be
+    given back with planJobRelease()
+*/
+dctJob* planSubmit(dctPlan* plan, image* srcIMG, image* dctIMG, image* idctIMG,
+                   int direction, dctJobCallback callback, void* callbackArg) {
+    return planSubmitPriority(plan, srcIMG, dctIMG, idctIMG, direction, POOL_NORMAL,
+                              0.0, callback, callbackArg);
+}
+
+
+/*
+    Queue a transform like planSubmit() does, in a POOL_* priority 
+    class and with a deadline 'deadline' seconds from now (or 0 for
+    none), see poolSubmitPriority();
+
+    The job runs as one task per row of blocks, so a job of a higher
+    class (or with an earlier deadline) submitted to the plan, or to
+    a plan sharing its pool, takes over the workers within a row
+*/
+dctJob* planSubmitPriority(dctPlan* plan, image* srcIMG, image* dctIMG, image* idctIMG,
+                           int direction, int priority, double deadline,
+                           dctJobCallback callback, void* callbackArg) {
+    if (((direction & PLAN_FORWARD) && (!planFits(plan, srcIMG) || !planFits(plan, dctIMG))) ||
+        ((direction & PLAN_INVERSE) && (!planFits(plan, dctIMG) || !planFits(plan, idctIMG))) ||
+        !(direction & (PLAN_FORWARD | PLAN_INVERSE)))
+        return NULL;
+
+    dctJob* dj      = (dctJob*)calloc(1, sizeof(dctJob));
+    planRun run     = { plan, srcIMG, dctIMG, idctIMG, direction, 0 };
+    dj->run         = run;
+    dj->plan        = plan;
+    dj->callback    = callback;
+    dj->callbackArg = callbackArg;
+    dj->job         = poolSubmitPriority(plan->pool, planRowTask, dj,
+                                         plan->paddedHeight/plan->blockSize,
+                                         POOL_DYNAMIC, priority, deadline,
+                                         (callback? planJobDone:NULL), dj);
+    return dj;
+}
+
+
+/*
+    Return the blocks of a job transformed so far (without locking),
+    setting 'total' (if not NULL) to the blocks of the whole job
+*/
+long planJobProgress(dctJob* dj, long* total) {
+    long blocksX = dj->plan->width/dj->plan->blockSize;
+    if (total != NULL)
+        *total = blocksX*(dj->plan->paddedHeight/dj->plan->blockSize);
+
+    return blocksX*__atomic_load_n(&dj->rowsDone, __ATOMIC_ACQUIRE);
+}
+
+
+/*
+    Have a job skip the rows of blocks no worker has started yet, so
+    it finishes once the rows being transformed are done; the handle
+    still has to be waited on or released as usual
+*/
+void planJobCancel(dctJob* dj) {
+    __atomic_store_n(&dj->cancelled, 1, __ATOMIC_RELEASE);
+}
+
+
+int planJobPoll(dctJob* dj) {
+    return poolPoll(dj->plan->pool, dj->job);
+}
+
+
+void planJobWait(dctJob* dj) {
+    poolWait(dj->plan->pool, dj->job);
+}
+
+
+/*
+    Wait for a job to finish and free its handle
+*/
+void planJobRelease(dctJob* dj) {
+    poolRelease(dj->plan->pool, dj->job);
+    free(dj);
+}
+
+
+// Plan budget structure definition
+// --------------------------
+//
+// run   : What the transform computes
+// dcIMG : Preview written with the mean of every block
+//
+typedef struct {
+    planRun run;
+    image* dcIMG;
+} planBudget;
+
+
+/*
+    Write the mean of every block of one row of blocks into its pixel
+    of the preview, from the source (or the DC coefficients if only
+    inverting)
+*/
+static void planPreviewTask(void* arg, int taskIndex, int workerIndex) {
+    planBudget* pb = (planBudget*)arg;
+    planRun* run   = &pb->run;
+    int B          = run->plan->blockSize;
+    int y          = taskIndex*B;
+
+    // The DC basis function is constant, so the DC coefficient is the
+    // block's sum scaled by its square, and reconstructs to a flat
+    // block of the DC scaled by it again
+    double scale = run->plan->basis[0]*run->plan->basis[0];
+
+    for (int x = 0; x < run->plan->width; x += B) {
+        double mean;
+        if (run->direction & PLAN_FORWARD) {
+            double sum = 0.0;
+            for (int i = 0; i < B; i++) {
+                pixel* column = &run->srcIMG->m[x + i][y];
+                for (int j = 0; j < B; j++)
+                    sum += column[j].i;
+            }
+            mean = sum/(B*B);
+        }
+
+        else
+            mean = run->dctIMG->m[x][y].i*scale;
+
+        pb->dcIMG->m[x/B][taskIndex].i = mean;
+    }
+}
+
+
+/*
+    Transform like planExecute(), planForward() or planInverse() do
+    (by 'direction'), but return once 'budget' seconds have passed with
+    whatever result is ready by then;
+
+    A coarse preview comes first: every pixel of 'dcIMG' (if not NULL,
+    at least width/blockSize x paddedHeight/blockSize) is set to the
+    mean of its block, what the block's DC coefficient alone gives
+    back. The full transform then runs as a POOL_INTERACTIVE job with
+    the rest of the budget as its deadline, and is cancelled once the
+    budget is spent, finishing the rows of blocks already started. 
+    Blocks it didn't reach are left as they were in the images, so
+    the caller falls back to the preview. Returns 0 if every block was
+    transformed, 1 if the result is partial, and -1 if an image
+    doesn't fit the plan
+*/
+int planExecuteBudget(dctPlan* plan, image* srcIMG, image* dctIMG, image* idctIMG,
+                      int direction, double budget, image* dcIMG, 
+                      dctBudgetResult* result) {
+    int blocksX   = plan->width/plan->blockSize;
+    int blockRows = plan->paddedHeight/plan->blockSize;
+    if (((direction & PLAN_FORWARD) && (!planFits(plan, srcIMG) || !planFits(plan, dctIMG))) ||
+        ((direction & PLAN_INVERSE) && (!planFits(plan, dctIMG) || !planFits(plan, idctIMG))) ||
+        !(direction & (PLAN_FORWARD | PLAN_INVERSE)) ||
+        (dcIMG != NULL && (dcIMG->width < blocksX || dcIMG->height < blockRows)))
+        return -1;
+
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (dcIMG != NULL) {
+        planBudget pb = { { plan, srcIMG, dctIMG, idctIMG, direction, 0 }, dcIMG };
+        poolRun(plan->pool, planPreviewTask, &pb, blockRows, POOL_DYNAMIC);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double left = budget - ((now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec)/1e9);
+
+    result->blocks   = (long)blocksX*blockRows;
+    result->complete = 0;
+    if (left > 0.0) {
+        dctJob* dj = planSubmitPriority(plan, srcIMG, dctIMG, idctIMG, direction,
+                                        POOL_INTERACTIVE, left, NULL, NULL);
+        if (!poolWaitTimed(plan->pool, dj->job, left))
+            planJobCancel(dj);
+
+        planJobWait(dj);
+        result->complete = planJobProgress(dj, NULL);
+        planJobRelease(dj);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    result->elapsed = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec)/1e9;
+    return (result->complete == result->blocks? 0:1);
+}
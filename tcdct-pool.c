@@ -0,0 +1,433 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "tcdct.h"
+
+// Worker argument structure definition
+// --------------------------
+//
+// pool        : Pool the worker belongs to
+// workerIndex : What 'i-th' worker this is in the pool
+//
+typedef struct {
+    threadPool* pool;
+    int workerIndex;
+} poolWorkerArg;
+
+
+static uint64_t poolNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec*1000000000ull + now.tv_nsec;
+}
+
+
+/*
+    Return whether job 'a' goes before job 'b', which is further back
+    in the queue: by class, then by deadline (jobs without one last)
+*/
+static int poolBefore(const poolJob* a, const poolJob* b) {
+    if (a->priority != b->priority)
+        return a->priority < b->priority;
+
+    uint64_t deadlineA = (a->deadline? a->deadline:UINT64_MAX);
+    uint64_t deadlineB = (b->deadline? b->deadline:UINT64_MAX);
+    return deadlineA <= deadlineB;
+}
+
+
+/*
+    Take the next task available to a worker from the queue, setting
+    'job' and 'taskIndex' to it; must be called holding the lock.
+
+    The task comes from the first job (see poolBefore()) with a task
+    left for this worker. Returns 1 if a task was found and 0 otherwise
+*/
+static int poolNextTask(threadPool* pool, int workerIndex,
+                        poolJob** job, int* taskIndex) {
+    poolJob* best = NULL;
+    for (poolJob* j = pool->head; j != NULL; j = j->next) {
+        int available = (j->schedule == POOL_STATIC? 
+                         j->workerNext[workerIndex] < j->totalTasks:
+                         j->nextTask < j->totalTasks);
+
+        if (available && (best == NULL || !poolBefore(best, j)))
+            best = j;
+    }
+
+    if (best == NULL)
+        return 0;
+
+    if (best->schedule == POOL_STATIC) {
+        *taskIndex = best->workerNext[workerIndex];
+        best->workerNext[workerIndex] += pool->totalThreads;
+    }
+
+    else
+        *taskIndex = best->nextTask++;
+
+    *job = best;
+    return 1;
+}
+
+
+/*
+    Account for a finished job in the statistics of its class; must 
+    be called holding the lock
+*/
+static void poolRecord(threadPool* pool, poolJob* job) {
+    poolClass* c = &pool->classes[job->priority];
+    uint64_t now = poolNow();
+
+    c->latencies[c->completed % POOL_LATENCY_SAMPLES] = (now - job->submitted)/1e6;
+    c->completed++;
+    c->missed += (job->deadline != 0 && now > job->deadline);
+    c->queued--;
+}
+
+
+/*
+    Unlink a finished job from the queue; must be called holding
+    the lock
+*/
+static void poolRemove(threadPool* pool, poolJob* job) {
+    poolJob* prev = NULL;
+    for (poolJob* j = pool->head; j != NULL; prev = j, j = j->next) {
+        if (j != job)
+            continue;
+
+        if (prev == NULL)
+            pool->head = j->next;
+
+        else
+            prev->next = j->next;
+
+        if (pool->tail == j)
+            pool->tail = prev;
+
+        break;
+    }
+}
+
+
+static void* poolWorker(void* arg) {
+    threadPool* pool = ((poolWorkerArg*)arg)->pool;
+    int workerIndex  = ((poolWorkerArg*)arg)->workerIndex;
+    poolJob* job;
+    int taskIndex;
+
+    if (pool->cpus != NULL)
+        affinityPinCPU(pool->cpus[workerIndex]);
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        if (poolNextTask(pool, workerIndex, &job, &taskIndex)) {
+            pthread_mutex_unlock(&pool->lock);
+            job->task(job->arg, taskIndex, workerIndex);
+            pthread_mutex_lock(&pool->lock);
+
+            // The last task to finish retires the job, running its
+            // callback (without the lock) before marking it finished
+            if (++job->doneTasks == job->totalTasks) {
+                poolRemove(pool, job);
+                poolRecord(pool, job);
+                if (job->callback != NULL) {
+                    pthread_mutex_unlock(&pool->lock);
+                    job->callback(job, job->callbackArg);
+                    pthread_mutex_lock(&pool->lock);
+                }
+
+                job->finished = 1;
+                pthread_cond_broadcast(&pool->done);
+            }
+            continue;
+        }
+
+        if (pool->shutdown)
+            break;
+
+        pthread_cond_wait(&pool->wake, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+
+/*
+    Create a pool of 'totalThreads' worker threads, pinning each of 
+    them to a CPU (see affinityCPUForThread()) if 'pinned' is set;
+
+    Returns NULL if the pool couldn't be created
+*/
+threadPool* poolCreate(int totalThreads, int pinned) {
+    if (totalThreads < 1)
+        return NULL;
+
+    threadPool* pool = (threadPool*)calloc(1, sizeof(threadPool));
+    poolWorkerArg* args = (poolWorkerArg*)malloc(totalThreads*sizeof(poolWorkerArg));
+    pool->tid          = (pthread_t*)malloc(totalThreads*sizeof(pthread_t));
+    pool->workerArgs   = args;
+    pool->totalThreads = totalThreads;
+
+    if (pinned) {
+        pool->cpus = (int*)malloc(totalThreads*sizeof(int));
+        for (int i = 0; i < totalThreads; i++)
+            pool->cpus[i] = affinityCPUForThread(i, totalThreads);
+    }
+
+    // Finished jobs are waited on with timeouts on the monotonic clock,
+    // which setting the time of day doesn't move
+    pthread_condattr_t doneAttr;
+    pthread_condattr_init(&doneAttr);
+    pthread_condattr_setclock(&doneAttr, CLOCK_MONOTONIC);
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, &doneAttr);
+    pthread_condattr_destroy(&doneAttr);
+
+    for (int i = 0; i < totalThreads; i++) {
+        args[i].pool        = pool;
+        args[i].workerIndex = i;
+        if (pthread_create(&pool->tid[i], NULL, poolWorker, &args[i]) != 0) {
+            pool->totalThreads = i;
+            poolDestroy(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+
+/*
+    Fill in a job and add it to the end of the queue; must be called
+    holding the lock
+*/
+static void poolEnqueue(threadPool* pool, poolJob* job, poolTask task, 
+                        void* arg, int totalTasks, int schedule,
+                        int priority, double deadline) {
+    job->task       = task;
+    job->arg        = arg;
+    job->totalTasks = totalTasks;
+    job->schedule   = schedule;
+    job->priority   = (priority < 0 || priority >= POOL_CLASSES? POOL_NORMAL:priority);
+    job->submitted  = poolNow();
+    job->deadline   = (deadline > 0.0? job->submitted + (uint64_t)(deadline*1e9):0);
+    pool->classes[job->priority].queued++;
+
+    if (schedule == POOL_STATIC) {
+        job->workerNext = (int*)malloc(pool->totalThreads*sizeof(int));
+        for (int i = 0; i < pool->totalThreads; i++)
+            job->workerNext[i] = i;
+    }
+
+    if (pool->tail == NULL)
+        pool->head = pool->tail = job;
+
+    else
+        pool->tail = pool->tail->next = job;
+
+    pthread_cond_broadcast(&pool->wake);
+}
+
+
+/*
+    Run 'totalTasks' tasks of a function across the workers of a 
+    pool and wait for all of them to finish
+*/
+void poolRun(threadPool* pool, poolTask task, void* arg, 
+             int totalTasks, int schedule) {
+    if (totalTasks < 1)
+        return;
+
+    poolJob job;
+    memset(&job, 0, sizeof(poolJob));
+
+    pthread_mutex_lock(&pool->lock);
+    poolEnqueue(pool, &job, task, arg, totalTasks, schedule, POOL_NORMAL, 0.0);
+    while (!job.finished)
+        pthread_cond_wait(&pool->done, &pool->lock);
+
+    pthread_mutex_unlock(&pool->lock);
+    free(job.workerNext);
+}
+
+
+/*
+    Queue 'totalTasks' tasks of a function on the workers of a pool
+    and return right away, with a handle to poll or wait on;
+
+    Any number of jobs can be in flight at once (the workers take
+    tasks from the oldest POOL_NORMAL job first). 'callback' (if not NULL) runs
+    once every task has finished, and must not release the job itself.
+    The handle must be given back with poolRelease()
+*/
+poolJob* poolSubmit(threadPool* pool, poolTask task, void* arg, int totalTasks,
+                    int schedule, poolCallback callback, void* callbackArg) {
+    return poolSubmitPriority(pool, task, arg, totalTasks, schedule, POOL_NORMAL,
+                              0.0, callback, callbackArg);
+}
+
+
+/*
+    Queue a job like poolSubmit() does, in a POOL_* priority class and
+    with a deadline 'deadline' seconds from now (or none if 0);
+
+    Workers take tasks from jobs of higher classes first, and within
+    a class from the job with the earliest deadline, but never stop a
+    task once it's started. Jobs finishing past their deadline are
+    counted as missed in poolStats()
+*/
+poolJob* poolSubmitPriority(threadPool* pool, poolTask task, void* arg, int totalTasks,
+                            int schedule, int priority, double deadline,
+                            poolCallback callback, void* callbackArg) {
+    poolJob* job     = (poolJob*)calloc(1, sizeof(poolJob));
+    job->callback    = callback;
+    job->callbackArg = callbackArg;
+
+    // There's nothing for a worker to finish, so finish it here
+    if (totalTasks < 1) {
+        if (callback != NULL)
+            callback(job, callbackArg);
+
+        job->finished = 1;
+        return job;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    poolEnqueue(pool, job, task, arg, totalTasks, schedule, priority, deadline);
+    pthread_mutex_unlock(&pool->lock);
+    return job;
+}
+
+
+/*
+    Return whether a submitted job has finished, without blocking
+*/
+int poolPoll(threadPool* pool, poolJob* job) {
+    pthread_mutex_lock(&pool->lock);
+    int finished = job->finished;
+    pthread_mutex_unlock(&pool->lock);
+    return finished;
+}
+
+
+/*
+    Block until a submitted job has finished
+*/
+void poolWait(threadPool* pool, poolJob* job) {
+    pthread_mutex_lock(&pool->lock);
+    while (!job->finished)
+        pthread_cond_wait(&pool->done, &pool->lock);
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+
+/*
+    Block until a submitted job has finished or 'seconds' have passed,
+    returning 1 if it has finished and 0 otherwise (timed on the
+    monotonic clock)
+*/
+int poolWaitTimed(threadPool* pool, poolJob* job, double seconds) {
+    struct timespec until;
+    clock_gettime(CLOCK_MONOTONIC, &until);
+    if (seconds > 0.0) {
+        long nanoseconds = until.tv_nsec + (long)((seconds - (long)seconds)*1e9);
+        until.tv_sec    += (long)seconds + nanoseconds/1000000000;
+        until.tv_nsec    = nanoseconds % 1000000000;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    while (!job->finished)
+        if (pthread_cond_timedwait(&pool->done, &pool->lock, &until) != 0)
+            break;
+
+    int finished = job->finished;
+    pthread_mutex_unlock(&pool->lock);
+    return finished;
+}
+
+
+/*
+    Wait for a submitted job to finish and free its handle
+*/
+void poolRelease(threadPool* pool, poolJob* job) {
+    poolWait(pool, job);
+    free(job->workerNext);
+    free(job);
+}
+
+
+/*
+    Stop every worker once the queue is drained and free the pool
+*/
+void poolDestroy(threadPool* pool) {
+    if (pool == NULL)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->totalThreads; i++)
+        pthread_join(pool->tid[i], NULL);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->done);
+    free(pool->workerArgs);
+    free(pool->cpus);
+    free(pool->tid);
+    free(pool);
+}
+
+
+static int poolCompareLatencies(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+
+/*
+    Fill in the queue depth, deadline misses and latency percentiles
+    (over the latest POOL_LATENCY_SAMPLES jobs) of a POOL_* class;
+
+    Returns -1 if there is no such class and 0 otherwise
+*/
+int poolStats(threadPool* pool, int priority, poolClassStats* stats) {
+    if (priority < 0 || priority >= POOL_CLASSES)
+        return -1;
+
+    memset(stats, 0, sizeof(poolClassStats));
+    double* latencies = (double*)malloc(POOL_LATENCY_SAMPLES*sizeof(double));
+    poolClass* c      = &pool->classes[priority];
+
+    pthread_mutex_lock(&pool->lock);
+    for (poolJob* j = pool->head; j != NULL; j = j->next)
+        if (j->priority == priority)
+            stats->pendingTasks += j->totalTasks - j->doneTasks;
+
+    stats->queued    = c->queued;
+    stats->completed = c->completed;
+    stats->missed    = c->missed;
+
+    int samples = (c->completed < POOL_LATENCY_SAMPLES? (int)c->completed:
+                                                         POOL_LATENCY_SAMPLES);
+    memcpy(latencies, c->latencies, samples*sizeof(double));
+    pthread_mutex_unlock(&pool->lock);
+
+    if (samples > 0) {
+        qsort(latencies, samples, sizeof(double), poolCompareLatencies);
+        stats->p50 = latencies[samples*50/100];
+        stats->p90 = latencies[samples*90/100];
+        stats->p99 = latencies[samples*99/100];
+        stats->max = latencies[samples - 1];
+    }
+
+    free(latencies);
+    return 0;
+}
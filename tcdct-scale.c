@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "tcdct.h"
+
+// Scaled inverse structure definition
+// --------------------------
+//
+// plan    : Plan whose coefficients are reconstructed
+// dctIMG  : Image of coefficients
+// outIMG  : Image written at 1/scale of each side
+// size    : Side of each reconstructed block (blockSize/scale)
+// basis   : Basis of a 'size'-point DCT, C[u][x] (scaling included)
+// factor  : Scaling of 'size'-point coefficients taken from the
+//           plan's blockSize-point ones (size/blockSize)
+// bx0/bx1 : Range of block columns to reconstruct
+// by0     : First block row to reconstruct (one task per block row)
+//
+typedef struct {
+    dctPlan* plan;
+    image* dctIMG;
+    image* outIMG;
+    int size;
+    double basis[PLAN_MAX_BLOCK*PLAN_MAX_BLOCK];
+    double factor;
+    int bx0;
+    int bx1;
+    int by0;
+} scaledRun;
+
+
+/*
+    Reconstruct one row of blocks, each from only its top-left 
+    (size x size) coefficients with a 'size'-point IDCT
+*/
+static void scaledRowTask(void* arg, int taskIndex, int workerIndex) {
+    scaledRun* run = (scaledRun*)arg;
+    int B          = run->plan->blockSize;
+    int N          = run->size;
+    const double* C = run->basis;
+    int by         = run->by0 + taskIndex;
+
+    double in[PLAN_MAX_BLOCK*PLAN_MAX_BLOCK];
+    double tmp[PLAN_MAX_BLOCK*PLAN_MAX_BLOCK];
+
+    for (int bx = run->bx0; bx < run->bx1; bx++) {
+        for (int u = 0; u < N; u++) {
+            pixel* column = &run->dctIMG->m[bx*B + u][by*B];
+            for (int v = 0; v < N; v++)
+                in[u*N + v] = column[v].i * run->factor;
+        }
+
+        // tmp[x][v] = sum_u C[u][x] * in[u][v]
+        for (int x = 0; x < N; x++)
+            for (int v = 0; v < N; v++) {
+                double sum = 0.0;
+                for (int u = 0; u < N; u++)
+                    sum += C[u*N + x] * in[u*N + v];
+                tmp[x*N + v] = sum;
+            }
+
+        // out[x][y] = sum_v tmp[x][v] * C[v][y]
+        for (int x = 0; x < N; x++) {
+            pixel* column = &run->outIMG->m[bx*N + x][by*N];
+            for (int y = 0; y < N; y++) {
+                double sum = 0.0;
+                for (int v = 0; v < N; v++)
+                    sum += tmp[x*N + v] * C[v*N + y];
+                column[y].i = sum;
+            }
+        }
+    }
+}
+
+
+/*
+    Reconstruct 'dctIMG' at 1/scale of each side directly from its 
+    coefficients (as libjpeg's scaled IDCTs do), optionally only for
+    the blocks overlapping a region of interest;
+
+    Each (blockSize x blockSize) block becomes a (blockSize/scale)^2
+    block of 'outIMG', computed with an IDCT of that size over only 
+    the lowest frequencies of the block, so that e.g. SCALE_EIGHTH of
+    8x8 blocks is the DC term alone (the block's average). 'outIMG' 
+    must be at least (width/scale x paddedHeight/scale) and is left
+    untouched outside of 'roi' (in full resolution pixels, or NULL
+    for the whole image). Returns 0 on success and -1 on failure
+*/
+int planInverseScaled(dctPlan* plan, image* dctIMG, image* outIMG, 
+                      int scale, const dctRect* roi) {
+    int B = plan->blockSize;
+    if (scale < 1 || B % scale || dctIMG->width != plan->width || 
+        dctIMG->height < plan->paddedHeight ||
+        outIMG->width < plan->width/scale || 
+        outIMG->height < plan->paddedHeight/scale)
+        return -1;
+
+    scaledRun run;
+    run.plan   = plan;
+    run.dctIMG = dctIMG;
+    run.outIMG = outIMG;
+    run.size   = B/scale;
+    run.factor = (double)run.size/B;
+
+    int N = run.size;
+    for (int u = 0; u < N; u++) {
+        double s = (u == 0? sqrt(1.0/N):sqrt(2.0/N));
+        for (int x = 0; x < N; x++)
+            run.basis[u*N + x] = s * cos((2.0*x + 1.0) * u * M_PI/(2.0*N));
+    }
+
+    // Clip the region of interest to whole blocks of the image
+    int x0 = 0, y0 = 0, x1 = plan->width, y1 = plan->paddedHeight;
+    if (roi != NULL) {
+        x0 = (roi->x > 0? roi->x:0);
+        y0 = (roi->y > 0? roi->y:0);
+        if (roi->x + roi->width < x1)   x1 = roi->x + roi->width;
+        if (roi->y + roi->height < y1)  y1 = roi->y + roi->height;
+    }
+
+    run.bx0 = x0/B;
+    run.bx1 = (x1 + B - 1)/B;
+    run.by0 = y0/B;
+    int rows = (y1 + B - 1)/B - run.by0;
+    if (rows <= 0 || run.bx1 <= run.bx0)
+        return 0;
+
+    poolRun(plan->pool, scaledRowTask, &run, rows, POOL_DYNAMIC);
+    return 0;
+}
@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "tcdct.h"
+
+
+/*
+    Create a sequence of frames transformed with 'plan', where every
+    block of a frame that differs from the same block of the previous
+    frame by no more than 'threshold' reuses its coefficients;
+
+    The plan stays owned by the caller and must outlive the sequence
+*/
+dctSequence* seqCreate(dctPlan* plan, double threshold) {
+    dctSequence* seq = (dctSequence*)calloc(1, sizeof(dctSequence));
+    seq->plan        = plan;
+    seq->threshold   = threshold;
+    seq->prevIMG     = planAllocateImage(plan, 0);
+    seq->dctIMG      = planAllocateImage(plan, 0);
+    seq->idctIMG     = planAllocateImage(plan, 0);
+    seq->bands       = (seqBand*)aligned_alloc(CACHE_LINE,
+                                  plan->totalThreads*sizeof(seqBand));
+
+    seqReset(seq);
+    return seq;
+}
+
+
+/*
+    Forget the previous frame, so that the next one is fully computed
+*/
+void seqReset(dctSequence* seq) {
+    seq->frames = 0;
+    memset(seq->bands, 0, seq->plan->totalThreads*sizeof(seqBand));
+}
+
+
+/*
+    Check whether the block at (i, j) of a frame is within the
+    threshold of the same block of the previous frame
+*/
+static int seqUnchanged(dctSequence* seq, int i, int j, int B) {
+    for (int x = 0; x < B; x++) {
+        pixel* cur  = &seq->frameIMG->m[i + x][j];
+        pixel* prev = &seq->prevIMG->m[i + x][j];
+        for (int y = 0; y < B; y++)
+            if (fabs(cur[y].i - prev[y].i) > seq->threshold)
+                return 0;
+    }
+    return 1;
+}
+
+
+/*
+    Transform every changed block of one band of the current frame
+*/
+static void seqBandTask(void* arg, int taskIndex, int workerIndex) {
+    dctSequence* seq = (dctSequence*)arg;
+    dctPlan* plan    = seq->plan;
+    threadInfo* th   = &plan->th[taskIndex];
+    seqBand* band    = &seq->bands[taskIndex];
+    int B            = plan->blockSize;
+    double* in       = plan->scratch + (size_t)workerIndex*plan->scratchSize;
+    double* out      = in + B*B;
+    uint64_t skipped = 0;
+
+    traceThreadBegin(th->threadIndex);
+    for (int y = th->start; y < th->end; y += B) {
+        uint64_t stripStart = traceStripBegin();
+
+        for (int x = 0; x < plan->width; x += B) {
+            if (seq->frames > 0 && seqUnchanged(seq, x, y, B)) {
+                skipped++;
+                continue;
+            }
+
+            // Keep the pixels the cached coefficients now belong to
+            planGather(seq->frameIMG, in, x, y, B);
+            planScatter(seq->prevIMG, in, x, y, B);
+
+            plan->forward(plan, in, out);
+            planScatter(seq->dctIMG, out, x, y, B);
+            plan->inverse(plan, out, in);
+            planScatter(seq->idctIMG, in, x, y, B);
+        }
+        traceStripEnd(th->threadIndex, y, plan->width/B, stripStart);
+    }
+    traceThreadEnd(th->threadIndex);
+
+    uint64_t blocks     = (uint64_t)(th->end - th->start)/B*(plan->width/B);
+    band->computed     += blocks - skipped;
+    band->skipped      += skipped;
+    band->frameSkipped  = skipped;
+}
+
+
+/*
+    Transform the next frame of the sequence, leaving its coefficients
+    in seq->dctIMG and its reconstruction in seq->idctIMG;
+
+    Returns the amount of blocks reused from the previous frame, or -1
+    if the frame doesn't fit the plan
+*/
+int seqProcess(dctSequence* seq, image* frameIMG) {
+    dctPlan* plan = seq->plan;
+    if (frameIMG->width != plan->width || frameIMG->height < plan->paddedHeight)
+        return -1;
+
+    seq->frameIMG = frameIMG;
+    poolRun(plan->pool, seqBandTask, seq, plan->totalThreads, POOL_STATIC);
+    seq->frameIMG = NULL;
+    seq->frames++;
+
+    int skipped = 0;
+    for (int i = 0; i < plan->totalThreads; i++)
+        skipped += (int)seq->bands[i].frameSkipped;
+
+    return skipped;
+}
+
+
+/*
+    Sum the blocks computed and skipped over every frame so far
+*/
+void seqCounts(dctSequence* seq, uint64_t* computed, uint64_t* skipped) {
+    *computed = *skipped = 0;
+    for (int i = 0; i < seq->plan->totalThreads; i++) {
+        *computed += seq->bands[i].computed;
+        *skipped  += seq->bands[i].skipped;
+    }
+}
+
+
+void seqDestroy(dctSequence* seq) {
+    imDelete(seq->prevIMG, seq->dctIMG, seq->idctIMG);
+    free(seq->bands);
+    free(seq);
+}
@@ -0,0 +1,323 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "tcdct.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TRACE_USE_TSC 1
+#endif
+
+int traceEnabled = 0;
+
+// Per-thread counters (one cache line aligned entry per thread)
+static traceThread* traceThreads = NULL;
+static int traceTotalThreads     = 0;
+
+// Span of every run begun/ended, kept for the trace file
+static uint64_t* traceRuns    = NULL;
+static int traceRunCount      = 0;
+static int traceRunCapacity   = 0;
+
+// Calibration points for converting ticks into microseconds
+static uint64_t traceTicks0   = 0;
+static struct timespec traceClock0;
+
+
+uint64_t traceNow(void) {
+#ifdef TRACE_USE_TSC
+    return (uint64_t)__rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec*1000000000ull + (uint64_t)now.tv_nsec;
+#endif
+}
+
+
+/*
+    Return the amount of ticks per microsecond by comparing the tick
+    counter against CLOCK_MONOTONIC since the call to traceInit()
+*/
+static double traceTicksPerUS(void) {
+    struct timespec now;
+    uint64_t ticks = traceNow();
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    double elapsedUS = (now.tv_sec - traceClock0.tv_sec)*1e6 +
+                       (now.tv_nsec - traceClock0.tv_nsec)/1e3;
+
+    if (elapsedUS <= 0.0 || ticks <= traceTicks0)
+        return 1000.0;
+
+    return (double)(ticks - traceTicks0)/elapsedUS;
+}
+
+
+/*
+    Allocate the per-thread counters and event buffers for up to
+    'totalThreads' threads and enable tracing;
+
+    Returns 0 on success and -1 if allocation fails
+*/
+int traceInit(int totalThreads) {
+    if (totalThreads < 1 || totalThreads > TRACE_MAX_THREADS)
+        return -1;
+
+    traceFree();
+    if (posix_memalign((void**)&traceThreads, 64,
+                       totalThreads*sizeof(traceThread)) != 0) {
+        traceThreads = NULL;
+        return -1;
+    }
+
+    memset(traceThreads, 0, totalThreads*sizeof(traceThread));
+    for (int i = 0; i < totalThreads; i++) {
+        traceThreads[i].events = (traceEvent*)malloc(TRACE_MAX_EVENTS*
+                                                     sizeof(traceEvent));
+        if (traceThreads[i].events == NULL) {
+            traceTotalThreads = i;
+            traceFree();
+            return -1;
+        }
+    }
+
+    traceTotalThreads = totalThreads;
+    clock_gettime(CLOCK_MONOTONIC, &traceClock0);
+    traceTicks0  = traceNow();
+    traceEnabled = 1;
+    return 0;
+}
+
+
+/*
+    Mark the beginning of a run (a full pass of imProcess() over all
+    threads) and reset the per-run thread counters
+*/
+void traceRunBegin(void) {
+    if (!TRACE_ACTIVE)
+        return;
+
+    if (traceRunCount + 2 > traceRunCapacity) {
+        int capacity = (traceRunCapacity? 2*traceRunCapacity:64);
+        uint64_t* runs = (uint64_t*)realloc(traceRuns,
+                                            capacity*sizeof(uint64_t));
+        if (runs == NULL)
+            return;
+
+        traceRuns        = runs;
+        traceRunCapacity = capacity;
+    }
+
+    for (int i = 0; i < traceTotalThreads; i++) {
+        traceThreads[i].blocks = 0;
+        traceThreads[i].strips = 0;
+        traceThreads[i].busy   = 0;
+        traceThreads[i].start  = 0;
+        traceThreads[i].end    = 0;
+    }
+
+    traceRuns[traceRunCount] = traceRuns[traceRunCount + 1] = traceNow();
+    traceRunCount += 2;
+}
+
+
+/*
+    Mark the end of the run started by traceRunBegin()
+*/
+void traceRunEnd(void) {
+    if (TRACE_ACTIVE && traceRunCount > 0)
+        traceRuns[traceRunCount - 1] = traceNow();
+}
+
+
+void traceThreadBegin(int threadIndex) {
+    if (TRACE_ACTIVE && threadIndex < traceTotalThreads)
+        traceThreads[threadIndex].start = traceNow();
+}
+
+
+/*
+    Mark a thread as having finished its band; the band itself is
+    recorded as an event with a 'y' of -1 spanning the whole thread
+*/
+void traceThreadEnd(int threadIndex) {
+    if (!TRACE_ACTIVE || threadIndex >= traceTotalThreads)
+        return;
+
+    traceThread* th = &traceThreads[threadIndex];
+    th->end = traceNow();
+
+    if (th->count < TRACE_MAX_EVENTS) {
+        th->events[th->count].y      = -1;
+        th->events[th->count].blocks = (int)th->blocks;
+        th->events[th->count].start  = th->start;
+        th->events[th->count].end    = th->end;
+        th->count++;
+    }
+    else
+        th->dropped++;
+}
+
+
+/*
+    Record a strip of 'blocks' macroblocks starting at row 'y' that
+    was started at 'start' and is finished now
+*/
+void traceStripRecord(int threadIndex, int y, int blocks, uint64_t start) {
+    if (threadIndex >= traceTotalThreads)
+        return;
+
+    traceThread* th = &traceThreads[threadIndex];
+    uint64_t end = traceNow();
+
+    th->blocks += blocks;
+    th->strips += 1;
+    th->busy   += end - start;
+
+    if (th->count < TRACE_MAX_EVENTS) {
+        th->events[th->count].y      = y;
+        th->events[th->count].blocks = blocks;
+        th->events[th->count].start  = start;
+        th->events[th->count].end    = end;
+        th->count++;
+    }
+    else
+        th->dropped++;
+}
+
+
+/*
+    Print the per-thread counters of the most recent run, along
+    with the idle time of each thread and the load imbalance
+*/
+void traceSummary(FILE* outFile) {
+    if (!TRACE_ACTIVE || traceRunCount == 0)
+        return;
+
+    double TPUS      = traceTicksPerUS();
+    uint64_t runBeg  = traceRuns[traceRunCount - 2];
+    uint64_t runEnd  = traceRuns[traceRunCount - 1];
+    double wallUS    = (double)(runEnd - runBeg)/TPUS;
+    double busyMax   = 0.0, busySum = 0.0;
+    int straggler    = -1, active = 0;
+
+    fprintf(outFile, "Trace Summary (wall: %.3f ms)\n", wallUS/1e3);
+    fprintf(outFile, "%6s %10s %8s %12s %12s %12s %12s\n", "thread",
+                     "blocks", "strips", "start (ms)", "finish (ms)",
+                     "busy (ms)", "idle (ms)");
+
+    for (int i = 0; i < traceTotalThreads; i++) {
+        traceThread* th = &traceThreads[i];
+        if (th->start == 0)
+            continue;
+
+        double busyUS   = (double)th->busy/TPUS;
+        double startUS  = (double)(th->start - runBeg)/TPUS;
+        double finishUS = (double)(th->end - runBeg)/TPUS;
+
+        fprintf(outFile, "%6i %10llu %8llu %12.3f %12.3f %12.3f %12.3f\n",
+                i, (unsigned long long)th->blocks,
+                (unsigned long long)th->strips,
+                startUS/1e3, finishUS/1e3, busyUS/1e3,
+                (wallUS - busyUS)/1e3);
+
+        active++;
+        busySum += busyUS;
+        if (busyUS > busyMax)
+            busyMax = busyUS;
+
+        if (straggler < 0 || th->end > traceThreads[straggler].end)
+            straggler = i;
+    }
+
+    // Imbalance is the slowest thread against the average thread that
+    // recorded a band, where 1.0 means that every thread had the same
+    // amount of work
+    fprintf(outFile, "Load imbalance (max/mean busy): %.3f\n",
+            (busySum > 0.0? busyMax/(busySum/active):0.0));
+    fprintf(outFile, "Straggler: thread %i\n\n", (straggler < 0? 0:straggler));
+}
+
+
+/*
+    Write every recorded run, thread band, and strip out to a
+    file in the Chrome trace-event JSON format;
+
+    Returns 0 on success and -1 if the file can't be opened
+*/
+int traceWrite(const char* fileName) {
+    if (traceThreads == NULL)
+        return -1;
+
+    FILE* outFile = fopen(fileName, "w");
+    if (outFile == NULL)
+        return -1;
+
+    double TPUS = traceTicksPerUS();
+    int first   = 1;
+    fprintf(outFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    // Name each track after the thread index it represents
+    for (int i = 0; i < traceTotalThreads; i++) {
+        fprintf(outFile, "%s{\"name\":\"thread_name\",\"ph\":\"M\","
+                         "\"pid\":1,\"tid\":%i,\"args\":{\"name\":"
+                         "\"worker %i\"}}", (first? "":",\n"), i, i);
+        first = 0;
+    }
+
+    for (int r = 0; r + 1 < traceRunCount; r += 2) {
+        fprintf(outFile, ",\n{\"name\":\"run %i\",\"cat\":\"run\","
+                         "\"ph\":\"X\",\"pid\":1,\"tid\":-1,"
+                         "\"ts\":%.3f,\"dur\":%.3f}", r/2,
+                (double)(traceRuns[r] - traceTicks0)/TPUS,
+                (double)(traceRuns[r + 1] - traceRuns[r])/TPUS);
+    }
+
+    for (int i = 0; i < traceTotalThreads; i++) {
+        traceThread* th = &traceThreads[i];
+        for (int e = 0; e < th->count; e++) {
+            fprintf(outFile, ",\n{\"name\":\"%s\",\"cat\":\"dct\","
+                             "\"ph\":\"X\",\"pid\":1,\"tid\":%i,"
+                             "\"ts\":%.3f,\"dur\":%.3f,\"args\":"
+                             "{\"y\":%i,\"blocks\":%i}}",
+                    (th->events[e].y < 0? "band":"strip"), i,
+                    (double)(th->events[e].start - traceTicks0)/TPUS,
+                    (double)(th->events[e].end - th->events[e].start)/TPUS,
+                    th->events[e].y, th->events[e].blocks);
+        }
+
+        if (th->dropped) {
+            fprintf(outFile, ",\n{\"name\":\"dropped\",\"ph\":\"C\","
+                             "\"pid\":1,\"tid\":%i,\"ts\":0,\"args\":"
+                             "{\"events\":%llu}}", i,
+                             (unsigned long long)th->dropped);
+        }
+    }
+
+    fprintf(outFile, "\n]}\n");
+    fclose(outFile);
+    return 0;
+}
+
+
+/*
+    Release everything allocated by traceInit() and disable tracing
+*/
+void traceFree(void) {
+    if (traceThreads != NULL) {
+        for (int i = 0; i < traceTotalThreads; i++)
+            free(traceThreads[i].events);
+
+        free(traceThreads);
+    }
+
+    free(traceRuns);
+    traceThreads      = NULL;
+    traceRuns         = NULL;
+    traceTotalThreads = 0;
+    traceRunCount     = 0;
+    traceRunCapacity  = 0;
+    traceEnabled      = 0;
+}
@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "tcdct.h"
+
+
+/*
+    Perform a DCT -> IDCT over every 8x8 macroblock in the band of
+    rows described by a (threadInfo*), usable as a pthread start
+    routine
+*/
+void* imProcess(void* arg) {
+
+    // Parse the argument into a local (struct info*) structure
+    threadInfo* input = (threadInfo*)arg;
+    if (input->cpu >= 0)
+        affinityPinCPU(input->cpu);
+
+    // Count this thread's events over its whole band
+    if (input->perfEventCount) {
+        perfOpen(&input->perf, input->perfEvents, input->perfEventCount);
+        perfStart(&input->perf);
+    }
+
+    traceThreadBegin(input->threadIndex);
+
+    // Iterate through the rows corrosponding to this thread
+    for (int y = input->start; (y < input->end) && (y < input->padIndex); y += 8) {
+        uint64_t stripStart = traceStripBegin();
+
+        // Iterate through the columns corrosponding to this thread
+        for (int x = 0, width = input->srcIMG->width; x < width; x += 8) {
+
+            // Perform a DCT -> IDCT on a 8x8 macroblock
+            // centered at the point (x, y)
+            imBlockDCT(input->srcIMG, input->dctIMG, x, y);
+            imBlockIDCT(input->dctIMG, input->idctIMG, x, y);
+        }
+
+        // Record the strip (one row of macroblocks) if tracing
+        traceStripEnd(input->threadIndex, y, 
+                      (input->srcIMG->width + 7)/8, stripStart);
+    }
+
+    traceThreadEnd(input->threadIndex);
+    if (input->perfEventCount) {
+        perfStop(&input->perf);
+        perfClose(&input->perf);
+    }
+    return NULL;
+}
+
+
+
+/*
+    Pool task wrapper around imProcess(), where 'arg' is the array of
+    (threadInfo) and each task is one band of it
+*/
+void imProcessTask(void* arg, int taskIndex, int workerIndex) {
+    imProcess(&((threadInfo*)arg)[taskIndex]);
+}
+
+
+/*
+    Split a (possibly padded) image of 'height' real rows into one 
+    band per thread and return the cache line aligned (threadInfo)
+    array describing them; free it with free()
+
+    Each band starts on a multiple of 8 rows as long as the height
+    was padded with imGetPadSize()
+*/
+threadInfo* imSplit(image* srcIMG, image* dctIMG, image* idctIMG,
+                    int height, int totalThreads) {
+    threadInfo* th = (threadInfo*)aligned_alloc(CACHE_LINE, 
+                                                totalThreads*sizeof(threadInfo));
+    if (th == NULL)
+        return NULL;
+
+    memset(th, 0, totalThreads*sizeof(threadInfo));
+    for (int i = 0; i < totalThreads; i++) {
+        th[i].threadIndex  = i;
+        th[i].start        = i*srcIMG->height/totalThreads;
+        th[i].end          = (i + 1)*srcIMG->height/totalThreads;
+        th[i].padIndex     = height;
+        th[i].cpu          = -1;
+        th[i].srcIMG       = srcIMG;
+        th[i].dctIMG       = dctIMG;
+        th[i].idctIMG      = idctIMG;
+    }
+    return th;
+}
+
+
+/*
+    Zero the band of rows of a single thread in all three images
+*/
+static void imTouchTask(void* arg, int taskIndex, int workerIndex) {
+    threadInfo* input = &((threadInfo*)arg)[taskIndex];
+
+    size_t bytes = (input->end - input->start)*sizeof(pixel);
+    for (int x = 0, width = input->srcIMG->width; x < width; x++) {
+        memset(&input->srcIMG->m[x][input->start],  0, bytes);
+        memset(&input->dctIMG->m[x][input->start],  0, bytes);
+        memset(&input->idctIMG->m[x][input->start], 0, bytes);
+    }
+}
+
+
+/*
+    Have each worker of a (pinned) pool be the first to write to the 
+    rows of the band it processes, in all three images;
+
+    With the default first-touch policy each page then lands on the 
+    node of the worker that writes it, rather than on the node of 
+    the main thread. Since the image is stored column-first, pages 
+    straddling two bands of a column go to whichever touches first.
+    The bands must then also be processed with POOL_STATIC
+*/
+void imFirstTouch(threadPool* pool, threadInfo* th, int totalThreads) {
+    poolRun(pool, imTouchTask, th, totalThreads, POOL_STATIC);
+}
+
+
+/*
+    Perform the DCT algorithm over an 8x8 block in the image starting 
+    at the point inIMG[i][j] and ending at inIMG[i+8][j+8]
+*/
+void imBlockDCT(image* inIMG, image* outIMG, int i, int j) {
+    double OOSQT = 1.0/sqrt(2.0);
+    double sum   = 0.0;
+    double HPW   = (double)16.0;
+
+    for (int u = 0; u < 8; u++) {
+        for (int v = 0; v < 8; v++) {
+
+            sum = 0.0;
+            for (int x = 0; x < 8; x++) {
+                for (int y = 0; y < 8; y++) {
+                    sum += (double)inIMG->m[i + x][j + y].i *
+                           cos(((2.0*(double)(x)+1.0) * (double)u * M_PI)/HPW) *
+                           cos(((2.0*(double)(y)+1.0) * (double)v * M_PI)/HPW);
+                }
+            }
+            outIMG->m[i + u][j + v].i = 0.25 
+                                        * (u == 0? OOSQT:1.0)
+                                        * (v == 0? OOSQT:1.0)
+                                        * sum;
+        }
+    }
+}
+
+
+/*
+    Perform the inverse DCT algorithm over an 8x8 block in the image
+    starting at the point inIMG[i][j] and ending at inIMG[i+8][j+8]
+*/
+void imBlockIDCT(image* inIMG, image* outIMG, int i, int j) {
+    double OOSQT = 1.0/sqrt(2.0);
+    double sum   = 0.0;
+    double MPOL  = M_PI/(double)16.0;
+
+    for (int x = 0; x < 8; x++) {
+        for (int y = 0; y < 8; y++) {
+
+            sum = 0.0;
+            for (int u = 0; u < 8; u++) {
+                for (int v = 0; v < 8; v++) {
+                    sum += inIMG->m[i + u][j + v].i * 
+                           (u == 0? OOSQT:1.0) * 
+                           (v == 0? OOSQT:1.0) *
+                           cos((2.0*(double)(x)+1.0) * (double)u * MPOL) *
+                           cos((2.0*(double)(y)+1.0) * (double)v * MPOL);
+                }
+            }
+            outIMG->m[i + x][j + y].i = sum * 0.25;
+        }
+    }
+}
+
+
+/*
+    Perform the DCT algorithm over an entire image; 
+    
+    This loses accuracy over larger and larger image sizes 
+    past an 8x8 
+*/
+void imDCT(image* inIMG, image* outIMG) {
+    double OOSQT = 1.0/sqrt(2.0);
+    double sum   = 0.0;
+    double HPW   = (double)(inIMG->height + inIMG->width);
+
+    for (int u = 0; u < inIMG->width; u++) {
+        for (int v = 0; v < inIMG->height; v++) {
+
+            sum = 0.0;
+            for (int x = 0; x < inIMG->width; x++) {
+                for (int y = 0; y < inIMG->height; y++) {
+                    sum += (double)inIMG->m[x][y].i *
+                           cos(((2.0*(double)x+1.0) * (double)u*M_PI)/HPW) *
+                           cos(((2.0*(double)y+1.0) * (double)v*M_PI)/HPW);
+                }
+            }
+            outIMG->m[u][v].i = 1.0/((double)inIMG->height/2.0) *
+                                (!u? OOSQT:1.0)*(!v? OOSQT:1.0) *
+                                sum;
+        }
+    }
+}
+
+
+/*
+    Perform the inverse DCT algorithm over an entire image; 
+    
+    This loses accuracy over larger and larger image sizes 
+    past an 8x8 
+*/
+void imIDCT(image* inIMG, image* outIMG) {
+    double OOSQT = 1.0/sqrt(2.0);
+    double sum   = 0.0;
+    double HPW  = (double)(inIMG->height + inIMG->width);
+    double MPOL  = M_PI/(double)(HPW);
+
+    for (int x = 0; x < inIMG->width; x++) {
+        for (int y = 0; y < inIMG->height; y++) {
+
+            sum = 0.0;
+            for (int u = 0; u < inIMG->width; u++) {
+                for (int v = 0; v < inIMG->height; v++) {
+                    sum += inIMG->m[u][v].i * 
+                           (!u? OOSQT:1.0) * 
+                           (!v? OOSQT:1.0) *
+                           cos((2.0*(double)x+1.0) * (double)u*MPOL) *
+                           cos((2.0*(double)y+1.0) * (double)v*MPOL);
+                }
+            }
+            outIMG->m[x][y].i = sum/((double)inIMG->height/2.0);
+        }
+    }
+}
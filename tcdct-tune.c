@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "tcdct.h"
+
+// Timed executions per candidate configuration (after one untimed)
+#define TUNE_RUNS 3
+
+// Longest line of a tuning file, and of a CPU model name
+#define TUNE_LINE  512
+#define TUNE_MODEL 128
+
+// Size classes a tuning is kept for, each up to as many pixels as
+// the standard size it is named after
+static const char* sizeClassNames[] = { "qvga", "vga", "hd", "wqhd", "uhd", "huge" };
+static const long sizeClassPixels[] = { 320L*240, 640L*480, 1280L*720,
+                                        2560L*1440, 3840L*2160 };
+
+
+/*
+    Return the name of the size class of (width x height) images
+*/
+const char* planSizeClass(int width, int height) {
+    long pixels = (long)width*height;
+    int c       = 0;
+    while (c < 5 && pixels > sizeClassPixels[c])
+        c++;
+
+    return sizeClassNames[c];
+}
+
+
+/*
+    Copy the CPU's model name (from '/proc/cpuinfo') into 'model',
+    with any tabs turned into spaces, or "unknown" if there is none
+*/
+static void tuneCPUModel(char* model, size_t size) {
+    char line[TUNE_LINE];
+    FILE* cpuinfo = fopen("/proc/cpuinfo", "r");
+    snprintf(model, size, "unknown");
+    if (cpuinfo == NULL)
+        return;
+
+    while (fgets(line, sizeof(line), cpuinfo) != NULL) {
+        char* value = strchr(line, ':');
+        if (value == NULL || (strncmp(line, "model name", 10) != 0 &&
+                              strncmp(line, "Model", 5) != 0))
+            continue;
+
+        value += 1 + strspn(value + 1, " ");
+        value[strcspn(value, "\n")] = '\0';
+        snprintf(model, size, "%s", value);
+        for (char* c = model; *c; c++)
+            if (*c == '\t')
+                *c = ' ';
+        break;
+    }
+    fclose(cpuinfo);
+}
+
+
+/*
+    Write the key of a tuning (CPU model, size class, block size and
+    precision) into 'key', tab separated as in the tuning file
+*/
+static void tuneKey(char* key, size_t size, int width, int height, int blockSize,
+                    int precision) {
+    char model[TUNE_MODEL];
+    tuneCPUModel(model, sizeof(model));
+    snprintf(key, size, "%s\t%s\t%i\t%s", model, planSizeClass(width, height),
+             blockSize, (precision == PLAN_FLOAT? "float":"double"));
+}
+
+
+/*
+    Return the fastest of a few executions of a plan in seconds
+*/
+static double tuneTime(dctPlan* plan, image* srcIMG, image* dctIMG, image* idctIMG) {
+    double fastest = 0.0;
+    planExecute(plan, srcIMG, dctIMG, idctIMG);
+    for (int r = 0; r < TUNE_RUNS; r++) {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        planExecute(plan, srcIMG, dctIMG, idctIMG);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        double seconds = (end.tv_sec - start.tv_sec) +
+                         (end.tv_nsec - start.tv_nsec) / 1e9;
+        if (r == 0 || seconds < fastest)
+            fastest = seconds;
+    }
+    return fastest;
+}
+
+
+/*
+    Return the amount of threads to try after 't': every amount up to
+    4, then half again as many each time, and at last 'maxThreads'
+*/
+static int tuneNextThreads(int t, int maxThreads) {
+    int next = (t < 4? t + 1:t + t/2);
+    return (t < maxThreads && next > maxThreads? maxThreads:next);
+}
+
+
+/*
+    Time the plan's current configuration, keeping it in 'best' if it
+    is faster than what is there, and log it
+*/
+static void tuneCandidate(dctPlan* plan, image** images, dctTuning* best,
+                          FILE* logFile) {
+    double seconds = tuneTime(plan, images[0], images[1], images[2]);
+    double mpixels = (double)plan->width*plan->height/seconds/1e6;
+
+    if (logFile != NULL)
+        fprintf(logFile, "%7i %10s %8s %6i %8i %6i %10.2f\n", plan->totalThreads,
+                planKernelName(plan->kernel), planTraversalName(plan->traversal),
+                plan->stripBlocks, plan->prefetch, plan->batchLanes, mpixels);
+
+    if (mpixels > best->mpixels) {
+        best->totalThreads = plan->totalThreads;
+        best->kernel       = plan->kernel;
+        best->traversal    = plan->traversal;
+        best->stripBlocks  = plan->stripBlocks;
+        best->prefetch     = plan->prefetch;
+        best->batchLanes   = plan->batchLanes;
+        best->mpixels      = mpixels;
+    }
+}
+
+
+/*
+    Replace the line of a key in a tuning file with a new tuning, or
+    add it, writing the file anew and renaming it over the old one so
+    that readers never see half of it
+*/
+static int tuneStore(const char* fileName, const char* key, const dctTuning* t) {
+    char tmpName[4096], line[TUNE_LINE];
+    snprintf(tmpName, sizeof(tmpName), "%s.tmp", fileName);
+    FILE* out = fopen(tmpName, "w");
+    if (out == NULL)
+        return -1;
+
+    fprintf(out, "# cpu\tsize\tblock\tprecision\tthreads\tkernel\ttraversal"
+                 "\tstrip\tprefetch\tlanes\tmpixels\n");
+
+    // Keep every other key's line
+    FILE* in    = fopen(fileName, "r");
+    size_t klen = strlen(key);
+    while (in != NULL && fgets(line, sizeof(line), in) != NULL)
+        if (line[0] != '#' && !(strncmp(line, key, klen) == 0 && line[klen] == '\t'))
+            fputs(line, out);
+
+    if (in != NULL)
+        fclose(in);
+
+    fprintf(out, "%s\t%i\t%s\t%s\t%i\t%i\t%i\t%.2f\n", key, t->totalThreads,
+            planKernelName(t->kernel), planTraversalName(t->traversal),
+            t->stripBlocks, t->prefetch, t->batchLanes, t->mpixels);
+
+    if (fclose(out) != 0 || rename(tmpName, fileName) != 0) {
+        remove(tmpName);
+        return -1;
+    }
+    return 0;
+}
+
+
+/*
+    Find the tuning of (width x height) images in blocks of a size and
+    precision on this CPU in a tuning file (TUNE_FILE_DEFAULT if NULL);
+
+    Returns 0 and fills in 'tuning' if there is one, and -1 otherwise
+*/
+int planTuneLookup(const char* fileName, int width, int height, int blockSize,
+                   int precision, dctTuning* tuning) {
+    char key[TUNE_LINE], line[TUNE_LINE];
+    tuneKey(key, sizeof(key), width, height, blockSize, precision);
+
+    FILE* in = fopen(fileName != NULL? fileName:TUNE_FILE_DEFAULT, "r");
+    if (in == NULL)
+        return -1;
+
+    int found   = -1;
+    size_t klen = strlen(key);
+    while (found != 0 && fgets(line, sizeof(line), in) != NULL) {
+        char kernel[32], traversal[32];
+        if (line[0] == '#' || strncmp(line, key, klen) != 0 || line[klen] != '\t' ||
+            sscanf(line + klen + 1, "%i\t%31[^\t]\t%31[^\t]\t%i\t%i\t%i\t%lf",
+                   &tuning->totalThreads, kernel, traversal, &tuning->stripBlocks,
+                   &tuning->prefetch, &tuning->batchLanes, &tuning->mpixels) != 7)
+            continue;
+
+        tuning->kernel    = planKernelFromName(kernel);
+        tuning->traversal = TRAVERSE_STRIP;
+        for (int t = TRAVERSE_ROW; t <= TRAVERSE_MORTON; t++)
+            if (strcmp(traversal, planTraversalName(t)) == 0)
+                tuning->traversal = t;
+
+        if (tuning->totalThreads >= 1 && tuning->kernel >= 0)
+            found = 0;
+    }
+
+    fclose(in);
+    return found;
+}
+
+
+/*
+    Calibrate the fastest configuration for (width x height) images
+    in blocks of a size and precision on this host, and store it in
+    a tuning file (TUNE_FILE_DEFAULT if NULL) for planCreateTuned();
+
+    Rather than every combination, the search goes in stages: every
+    amount of threads (1, 2, 3, 4, 6, 8, 12, ... up to 'maxThreads',
+    or every CPU if 0) with every supported kernel but the naive one,
+    then the traversals, strip widths and prefetching of the fastest
+    of those, then the batch widths if the batched kernel won. Each
+    candidate is timed a few times on a random image. The candidates
+    are logged to 'logFile' (unless NULL) and the winner is returned
+    in 'tuning'. Returns 0 on success, 1 if the tuning couldn't be
+    stored, and -1 if no plan could be created
+*/
+int planTune(int width, int height, int blockSize, int precision, int maxThreads,
+             const char* fileName, dctTuning* tuning, FILE* logFile) {
+    if (maxThreads < 1)
+        maxThreads = affinityCPUCount();
+
+    image* images[3] = { NULL, NULL, NULL };
+    dctTuning best;
+    memset(&best, 0, sizeof(best));
+
+    if (logFile != NULL)
+        fprintf(logFile, "%7s %10s %8s %6s %8s %6s %10s\n", "threads", "kernel",
+                "order", "strip", "prefetch", "lanes", "MP/s");
+
+    // Threads and kernels
+    for (int t = 1; t <= maxThreads; t = tuneNextThreads(t, maxThreads)) {
+        dctPlan* plan = planCreate(width, height, blockSize, precision, t, PLAN_ESTIMATE);
+        if (plan == NULL)
+            continue;
+
+        if (images[0] == NULL) {
+            for (int i = 0; i < 3; i++)
+                images[i] = planAllocateImage(plan, 0);
+            imRandomize(images[0], height);
+        }
+
+        for (int k = KERNEL_SEPARABLE; k < KERNEL_COUNT; k++)
+            if (planSetKernel(plan, k) == 0)
+                tuneCandidate(plan, images, &best, logFile);
+
+        planDestroy(plan);
+    }
+
+    if (images[0] == NULL)
+        return -1;
+
+    // Traversals, strips and prefetching, then batches, of the fastest
+    dctPlan* plan = planCreate(width, height, blockSize, precision,
+                               best.totalThreads, PLAN_ESTIMATE);
+    planSetKernel(plan, best.kernel);
+
+    int strips[3] = { plan->stripBlocks, plan->stripBlocks/2, plan->stripBlocks*2 };
+    for (int traversal = TRAVERSE_ROW; traversal <= TRAVERSE_MORTON; traversal++)
+        for (int s = 0; s < (traversal == TRAVERSE_STRIP? 3:1); s++)
+            for (int prefetch = 0; prefetch <= 1; prefetch++) {
+                plan->stripBlocks = (strips[s] > 0? strips[s]:1);
+                planSetTraversal(plan, traversal, prefetch);
+                tuneCandidate(plan, images, &best, logFile);
+            }
+
+    if (best.kernel == KERNEL_BATCH) {
+        planApplyTuning(plan, &best);
+        for (int lanes = 4; lanes <= PLAN_BATCH_LANES; lanes *= 2)
+            if (lanes != best.batchLanes && planSetBatch(plan, lanes) == 0)
+                tuneCandidate(plan, images, &best, logFile);
+    }
+
+    planDestroy(plan);
+    for (int i = 0; i < 3; i++)
+        imFree(images[i]);
+
+    char key[TUNE_LINE];
+    tuneKey(key, sizeof(key), width, height, blockSize, precision);
+    if (tuning != NULL)
+        *tuning = best;
+
+    return (tuneStore(fileName != NULL? fileName:TUNE_FILE_DEFAULT, key, &best) == 0? 0:1);
+}
+
+
+/*
+    Switch a plan to a tuned configuration (other than its amount of
+    threads, which is fixed when it's created)
+*/
+void planApplyTuning(dctPlan* plan, const dctTuning* tuning) {
+    planSetKernel(plan, tuning->kernel);
+    if (tuning->stripBlocks >= 1)
+        plan->stripBlocks = tuning->stripBlocks;
+
+    planSetTraversal(plan, tuning->traversal, tuning->prefetch);
+    if (plan->kernel == KERNEL_BATCH)
+        planSetBatch(plan, tuning->batchLanes);
+}
+
+
+/*
+    Create a plan with the tuned configuration of its size class on
+    this CPU from a tuning file (TUNE_FILE_DEFAULT if NULL);
+
+    Without a tuning, the plan is tuned first with PLAN_MEASURE (and
+    the tuning stored for later runs), or else gets a thread per CPU
+    and the default configuration. Returns NULL on failure
+*/
+dctPlan* planCreateTuned(int width, int height, int blockSize, int precision,
+                         int flags, const char* fileName) {
+    dctTuning tuning;
+    if (planTuneLookup(fileName, width, height, blockSize, precision, &tuning) != 0) {
+        if (!(flags & PLAN_MEASURE))
+            return planCreate(width, height, blockSize, precision,
+                              affinityCPUCount(), flags);
+
+        if (planTune(width, height, blockSize, precision, 0, fileName, &tuning, NULL) < 0)
+            return NULL;
+    }
+
+    dctPlan* plan = planCreate(width, height, blockSize, precision,
+                               tuning.totalThreads, flags & ~PLAN_MEASURE);
+    if (plan != NULL)
+        planApplyTuning(plan, &tuning);
+
+    return plan;
+}
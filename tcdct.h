@@ -0,0 +1,1060 @@
+/*
+    libtcdct - Threaded 8x8 macroblock DCT/IDCT
+
+    Image types, allocation, I/O, validation, the block transforms,
+    the worker thread pool, and the instrumentation (tracing, NUMA
+    placement, hardware counters) shared by dct-single and dct-tests
+*/
+#ifndef TCDCT_H
+#define TCDCT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+// Size of a cache line; image columns and per-thread data are 
+// aligned (and padded) to it so threads never share a line
+#define CACHE_LINE 64
+
+
+///////////////////////////////////////////
+//               TRACING                 //
+///////////////////////////////////////////
+
+// Maximum amount of strip events kept per thread before
+// further events are dropped (and counted as dropped)
+#define TRACE_MAX_EVENTS 65536
+
+// Maximum amount of threads the tracer keeps counters for
+#define TRACE_MAX_THREADS 256
+
+// Trace event structure definition
+// --------------------------
+//
+// y      : Starting row of the strip (macroblock row) processed
+// blocks : Amount of 8x8 macroblocks processed in the strip
+// start  : Timestamp (ticks) at which the strip was started
+// end    : Timestamp (ticks) at which the strip was finished
+//
+typedef struct {
+    int y;
+    int blocks;
+    uint64_t start;
+    uint64_t end;
+} traceEvent;
+
+
+// Per-thread trace counters structure definition
+// --------------------------
+//
+// NOTE: Each of these is padded out to its own cache line(s) so
+//       that threads updating their own counters never invalidate
+//       the counters of another thread
+//
+// blocks  : Total amount of macroblocks processed by the thread
+// strips  : Total amount of strips processed by the thread
+// busy    : Total ticks spent inside of strips
+// start   : Timestamp (ticks) of the thread starting its band
+// end     : Timestamp (ticks) of the thread finishing its band
+// dropped : Amount of strip events not recorded (buffer full)
+// count   : Amount of strip events recorded in 'events'
+// events  : Recorded strip events
+//
+typedef struct {
+    uint64_t blocks;
+    uint64_t strips;
+    uint64_t busy;
+    uint64_t start;
+    uint64_t end;
+    uint64_t dropped;
+    int count;
+    traceEvent* events;
+} __attribute__((aligned(CACHE_LINE))) traceThread;
+
+
+// Global switch checked on the hot path; when zero each of
+// the trace calls below reduces to a single predictable branch
+//
+// NOTE: Building with -DTCDCT_NO_TRACE removes even that branch
+//
+extern int traceEnabled;
+
+#ifdef TCDCT_NO_TRACE
+#define TRACE_ACTIVE 0
+#else
+#define TRACE_ACTIVE traceEnabled
+#endif
+
+int  traceInit(int totalThreads);
+void traceRunBegin(void);
+void traceRunEnd(void);
+void traceThreadBegin(int threadIndex);
+void traceThreadEnd(int threadIndex);
+void traceStripRecord(int threadIndex, int y, int blocks, uint64_t start);
+void traceSummary(FILE* outFile);
+int  traceWrite(const char* fileName);
+void traceFree(void);
+
+
+/*
+    Return the current timestamp in ticks; the TSC is used when
+    available and CLOCK_MONOTONIC nanoseconds otherwise
+*/
+uint64_t traceNow(void);
+
+
+/*
+    Return the timestamp marking the start of a strip, or 0 if
+    tracing is disabled so that the caller can skip recording
+*/
+static inline uint64_t traceStripBegin(void) {
+    return (TRACE_ACTIVE? traceNow():0);
+}
+
+
+/*
+    Record a finished strip (see traceStripRecord()) only if
+    tracing is currently enabled
+*/
+static inline void traceStripEnd(int threadIndex, int y,
+                                 int blocks, uint64_t start) {
+    if (TRACE_ACTIVE)
+        traceStripRecord(threadIndex, y, blocks, start);
+}
+
+
+///////////////////////////////////////////
+//          AFFINITY & NUMA              //
+///////////////////////////////////////////
+
+// NOTE: When built with -DHAVE_LIBNUMA (see the Makefile) the node
+//       topology comes from libnuma, otherwise every CPU is treated
+//       as belonging to a single node 0 and only pinning is done
+//
+int    affinityCPUCount(void);
+int    affinityNodeCount(void);
+int    affinityNodeOfCPU(int cpu);
+int    affinityCPUForThread(int threadIndex, int totalThreads);
+int    affinityPinCPU(int cpu);
+double affinityBandwidth(int cpuNode, int memNode, size_t bytes);
+void   affinityReport(FILE* outFile);
+
+
+///////////////////////////////////////////
+//         HARDWARE COUNTERS             //
+///////////////////////////////////////////
+
+// Maximum amount of events counted at once by a thread
+#define PERF_MAX_EVENTS 8
+
+// Counter event structure definition
+// --------------------------
+//
+// name   : Name printed alongside the value of the event
+// type   : perf_event_attr.type (e.g. PERF_TYPE_HARDWARE)
+// config : perf_event_attr.config for that type
+//
+typedef struct {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+} perfEvent;
+
+
+// Per-thread counter set structure definition
+// --------------------------
+//
+// count  : Amount of events in the set
+// fd     : File descriptor of each event, or -1 if unavailable
+// values : Value of each event (scaled for multiplexing) once stopped
+//
+typedef struct {
+    int count;
+    int fd[PERF_MAX_EVENTS];
+    uint64_t values[PERF_MAX_EVENTS];
+} perfCounters;
+
+
+// Events showing cache lines bouncing between cores, where the
+// snoop event is a raw Intel event (HITM), only opened on the cores
+// it was encoded for
+extern const perfEvent perfSharingEvents[];
+extern const int perfSharingEventCount;
+
+// Events showing how well the caches (and TLB) serve a traversal
+extern const perfEvent perfCacheEvents[];
+extern const int perfCacheEventCount;
+
+// Events judging a kernel or layout on more than its time: cycles and
+// instructions (for IPC) first, then cache, dTLB and branch misses
+#define PERF_CORE_CYCLES       0
+#define PERF_CORE_INSTRUCTIONS 1
+extern const perfEvent perfCoreEvents[];
+extern const int perfCoreEventCount;
+
+int  perfOpen(perfCounters* pc, const perfEvent* events, int count);
+void perfStart(perfCounters* pc);
+void perfStop(perfCounters* pc);
+void perfClose(perfCounters* pc);
+
+
+
+///////////////////////////////////////////
+//               IMAGES                  //
+///////////////////////////////////////////
+
+// Controller for the pixel value types (e.g. floats, doubles, etc.)
+typedef double valueType;
+
+// Pixel structure definition
+// --------------------------
+//
+// r : Value of intensity of 'red' of this pixel
+// g : Value of intensity of 'green' of this pixel
+// b : Value of intensity of 'blue' of this pixel
+// i : Value of grayscale intensity of this pixel
+//
+typedef struct {
+    valueType r, g, b;
+    valueType i;
+} pixel;
+
+
+// Image structure definition
+// --------------------------
+//
+// width     : Amount of pixels in the x-direction
+// height    : Amount of pixels in the y-direction
+// m         : The matrix itself containing all pixels, as pointers
+//             to the columns inside of 'plane'
+// plane     : Single allocation holding every column back to back
+//             (NULL if each column was allocated on its own)
+// planeSize : Bytes mapped for the plane, or 0 if it came from the heap
+// pages     : IM_PAGES_* kind of pages backing the plane
+//
+typedef struct {
+    int width;
+    int height;
+    int channels;
+    pixel** m;
+    void* plane;
+    size_t planeSize;
+    int pages;
+} image;
+
+
+// Allocation flags for allocateImageFlags()
+//
+// IM_ALLOC_LEGACY  : Plain unaligned malloc() per column (the layout
+//                    used before columns were cache line aligned)
+// IM_ALLOC_COLUMNS : One cache line aligned allocation per column (the
+//                    layout used before columns shared a single plane)
+// IM_ALLOC_THP     : Map the plane on huge page boundaries and advise
+//                    transparent huge pages for it
+// IM_ALLOC_HUGETLB : Map the plane from the reserved huge page pool,
+//                    falling back to IM_ALLOC_THP when it is empty
+//
+// NOTE: A huge page holds whole columns of every band, so the pages
+//       of a plane can't be placed per band by planFirstTouch()
+//
+#define IM_ALLOC_LEGACY  0x1
+#define IM_ALLOC_COLUMNS 0x2
+#define IM_ALLOC_THP     0x4
+#define IM_ALLOC_HUGETLB 0x8
+
+// Size of the huge pages the plane of an image is mapped with
+#define IM_HUGE_PAGE (2UL << 20)
+
+// Kind of pages an image ended up with (see imPagesName())
+#define IM_PAGES_SMALL   0
+#define IM_PAGES_THP     1
+#define IM_PAGES_HUGETLB 2
+
+// ALLOCATION & INITIALIZATION
+image* allocateImage(int width, int height, int channels);
+image* allocateImageFlags(int width, int height, int channels, int flags);
+image* generateImage(int width, int height, int channels, int padding);
+void imRandomize(image* im, int height);
+int imGetPadSize(int totalThreads, int startingSize);
+void imRemovePadding(image* srcIMG, image* dctIMG, image* idctIMG, int padAmnt);
+void imFree(image* im);
+const char* imPagesName(int pages);
+void imDelete(image* srcIMG, image* dctIMG, image* idctIMG);
+
+// I/O
+void imread(image* im, FILE *inFile);
+void imwrite(image* im, char* fileName);
+
+// VALIDATION
+int imValidate(image* imA, image* imB, double threshold);
+double imERR1(image* imA, image* imB);
+double imERR2(image* imA, image* imB);
+long double imMSE(image* imA, image* imB);
+void imPrint(image* im);
+
+
+///////////////////////////////////////////
+//             THREAD POOL               //
+///////////////////////////////////////////
+
+// Function run for each task of a job; 'taskIndex' is in the
+// range [0, totalTasks) and 'workerIndex' is the worker running it
+typedef void (*poolTask)(void* arg, int taskIndex, int workerIndex);
+
+// Scheduling of the tasks of a job across the workers
+//
+// POOL_DYNAMIC : Any idle worker takes the next task
+// POOL_STATIC  : Task 'i' is only ever run by worker 'i % workers',
+//                which keeps bands on the (pinned) worker that
+//                first-touched them
+//
+#define POOL_DYNAMIC 0
+#define POOL_STATIC  1
+
+// Priority classes of the jobs of a pool, where workers take tasks
+// from the highest class first, then from the job with the earliest
+// deadline, then from the oldest job; a job only gives way between
+// tasks, so latency-sensitive work preempts bulk work at the size of
+// a task (a row of blocks for planSubmit())
+//
+// POOL_INTERACTIVE : Latency-sensitive jobs (e.g. previews)
+// POOL_NORMAL      : Everything else (poolRun(), poolSubmit())
+// POOL_BATCH       : Bulk jobs that run when nothing else is queued
+//
+#define POOL_INTERACTIVE 0
+#define POOL_NORMAL      1
+#define POOL_BATCH       2
+#define POOL_CLASSES     3
+
+// Latencies kept per class for the percentiles of poolStats()
+#define POOL_LATENCY_SAMPLES 4096
+
+struct poolJob;
+
+// Function run once every task of a submitted job has finished, on
+// the worker that finished the last one
+typedef void (*poolCallback)(struct poolJob* job, void* arg);
+
+// Pool job structure definition
+// --------------------------
+//
+// task       : Function to run for each task
+// arg        : Argument passed along to 'task'
+// totalTasks : Amount of tasks in the job
+// schedule   : POOL_DYNAMIC or POOL_STATIC
+// nextTask   : Next task to hand out (POOL_DYNAMIC)
+// workerNext : Next task to hand out per worker (POOL_STATIC)
+// doneTasks  : Amount of tasks that have finished
+// finished   : Set once every task (and the callback) has finished
+// callback   : Function run when the job finishes (or NULL)
+// callbackArg: Argument passed along to 'callback'
+// priority   : POOL_* class of the job
+// submitted  : When the job was queued (CLOCK_MONOTONIC ns)
+// deadline   : When the job should be finished by (CLOCK_MONOTONIC
+//              ns), or 0 for no deadline
+// next       : Next job in the pool's queue
+//
+typedef struct poolJob {
+    poolTask task;
+    void* arg;
+    int totalTasks;
+    int schedule;
+    int nextTask;
+    int* workerNext;
+    int doneTasks;
+    int finished;
+    poolCallback callback;
+    void* callbackArg;
+    int priority;
+    uint64_t submitted;
+    uint64_t deadline;
+    struct poolJob* next;
+} poolJob;
+
+
+// Pool class structure definition (the statistics of a class)
+// --------------------------
+//
+// queued    : Jobs of the class that haven't finished
+// completed : Jobs of the class that have finished
+// missed    : Finished jobs of the class that were past their deadline
+// latencies : Milliseconds from submission to the last task finishing
+//             of the last POOL_LATENCY_SAMPLES jobs, as a ring
+//
+typedef struct {
+    int queued;
+    uint64_t completed;
+    uint64_t missed;
+    double latencies[POOL_LATENCY_SAMPLES];
+} poolClass;
+
+
+// Pool class statistics structure definition (see poolStats())
+// --------------------------
+//
+// queued        : Jobs of the class that haven't finished
+// pendingTasks  : Tasks of those jobs that haven't finished
+// completed     : Jobs of the class that have finished
+// missed        : Finished jobs that were past their deadline
+// p50, p90, p99 : Latency percentiles (ms) of the latest jobs
+// max           : Highest latency (ms) of the latest jobs
+//
+typedef struct {
+    int queued;
+    int pendingTasks;
+    uint64_t completed;
+    uint64_t missed;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+} poolClassStats;
+
+
+// Thread pool structure definition
+// --------------------------
+//
+// totalThreads : Amount of worker threads
+// tid          : Worker thread handles
+// cpus         : CPU each worker is pinned to (NULL if unpinned)
+// lock         : Guards the queue and every job in it
+// wake         : Signalled when work is queued or on shutdown
+// done         : Signalled when a job finishes its last task
+// head, tail   : Queue of jobs that haven't finished yet
+// shutdown     : Set once the workers should exit
+// workerArgs   : Start routine argument of each worker (internal)
+// classes      : Statistics of every priority class
+//
+typedef struct {
+    int totalThreads;
+    pthread_t* tid;
+    int* cpus;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    poolJob* head;
+    poolJob* tail;
+    int shutdown;
+    void* workerArgs;
+    poolClass classes[POOL_CLASSES];
+} threadPool;
+
+threadPool* poolCreate(int totalThreads, int pinned);
+void poolRun(threadPool* pool, poolTask task, void* arg, 
+             int totalTasks, int schedule);
+poolJob* poolSubmit(threadPool* pool, poolTask task, void* arg, int totalTasks,
+                    int schedule, poolCallback callback, void* callbackArg);
+poolJob* poolSubmitPriority(threadPool* pool, poolTask task, void* arg, int totalTasks,
+                            int schedule, int priority, double deadline,
+                            poolCallback callback, void* callbackArg);
+int poolPoll(threadPool* pool, poolJob* job);
+void poolWait(threadPool* pool, poolJob* job);
+int poolWaitTimed(threadPool* pool, poolJob* job, double seconds);
+void poolRelease(threadPool* pool, poolJob* job);
+void poolDestroy(threadPool* pool);
+int poolStats(threadPool* pool, int priority, poolClassStats* stats);
+
+// Parallel counterparts of imwrite() and imread() for ASCII PGM (P2)
+// and PPM (P3) files
+int imwriteParallel(image* im, const char* fileName, threadPool* pool);
+image* imreadParallel(const char* fileName, threadPool* pool);
+
+
+///////////////////////////////////////////
+//              OPERATIONS               //
+///////////////////////////////////////////
+
+// Thread Info structure definition
+// --------------------------
+//
+// threadIndex   : What 'i-th' index a thread (band) is in all used
+// start         : Starting height index for thread to iterate over
+// end           : Ending height index for thread to iterate over
+// padIndex      : Starting index for padding in an image
+// cpu           : CPU to pin the thread to, or -1 to leave it unpinned
+// srcIMG        : Pointer to the source image
+// dctIMG        : Pointer to the DCT image
+// idctIMG       : Pointer to the IDCT image
+// perfEvents    : Hardware counter events to count (NULL for none)
+// perfEventCount: Amount of events in 'perfEvents'
+// perf          : Hardware counters of the thread once finished
+//
+// NOTE: Each is aligned to its own cache line, since the thread 
+//       writes its counters back into it when finishing
+//
+typedef struct {
+    int threadIndex;
+    int start;
+    int end;
+    int padIndex;
+    int cpu;
+    image* srcIMG;
+    image* dctIMG;
+    image* idctIMG;
+    const perfEvent* perfEvents;
+    int perfEventCount;
+    perfCounters perf;
+} __attribute__((aligned(CACHE_LINE))) threadInfo;
+
+void imDCT(image* inIMG, image* outIMG);
+void imIDCT(image* inIMG, image* outIMG);
+void imBlockDCT(image* inIMG, image* outIMG, int i, int j);
+void imBlockIDCT(image* inIMG, image* outIMG, int i, int j);
+void* imProcess(void* arg);
+void imProcessTask(void* arg, int taskIndex, int workerIndex);
+threadInfo* imSplit(image* srcIMG, image* dctIMG, image* idctIMG,
+                    int height, int totalThreads);
+void imFirstTouch(threadPool* pool, threadInfo* th, int totalThreads);
+
+
+
+///////////////////////////////////////////
+//                PLANS                  //
+///////////////////////////////////////////
+
+// Largest block size a plan can be created for
+#define PLAN_MAX_BLOCK 16
+
+// Precision the kernels of a plan compute in
+#define PLAN_DOUBLE 0
+#define PLAN_FLOAT  1
+
+// Flags for planCreate()
+//
+// PLAN_ESTIMATE : Pick the kernel from what the host supports
+// PLAN_MEASURE  : Time every candidate kernel and pick the fastest
+// PLAN_PINNED   : Pin the plan's workers to CPUs (see poolCreate())
+// PLAN_DEDUP    : Shortcut flat and repeated blocks (see planSetDedup())
+//
+#define PLAN_ESTIMATE 0x0
+#define PLAN_MEASURE  0x1
+#define PLAN_PINNED   0x2
+#define PLAN_DEDUP    0x4
+
+// Blocks each worker keeps the coefficients of with PLAN_DEDUP 
+// (a power of two)
+#define PLAN_CACHE_ENTRIES 64
+
+// Block kernels a plan can run
+//
+// KERNEL_NAIVE     : imBlockDCT()'s direct 4-deep sum (8x8, double)
+// KERNEL_SEPARABLE : Row-column passes over the cached basis table
+// KERNEL_AVX2      : Row-column passes vectorized with AVX2/FMA 
+//                    (8x8, double, and only if the CPU supports it)
+// KERNEL_BATCH     : Row-column passes as even/odd butterflies over a
+//                    batch of blocks at once, one block per vector 
+//                    lane (even block sizes, see planSetBatch())
+//
+#define KERNEL_NAIVE     0
+#define KERNEL_SEPARABLE 1
+#define KERNEL_AVX2      2
+#define KERNEL_BATCH     3
+#define KERNEL_COUNT     4
+
+// Most blocks KERNEL_BATCH transforms at once
+#define PLAN_BATCH_LANES 16
+
+// Directions of a transform (planSubmit())
+#define PLAN_FORWARD 0x1
+#define PLAN_INVERSE 0x2
+
+// Orders a plan visits the blocks of each band in
+//
+// TRAVERSE_ROW    : Row of blocks after row of blocks (as imProcess())
+// TRAVERSE_STRIP  : Strips of blocks sized to the L1 cache, each from
+//                   the top of the band down to its bottom, so that
+//                   every column is read contiguously
+// TRAVERSE_MORTON : Z-order over the blocks of the band
+//
+#define TRAVERSE_ROW    0
+#define TRAVERSE_STRIP  1
+#define TRAVERSE_MORTON 2
+
+// Rectangle of pixels, e.g. a region of an image that was edited
+typedef struct {
+    int x;
+    int y;
+    int width;
+    int height;
+} dctRect;
+
+struct dctPlan;
+struct planCache;
+
+// Coefficient cache statistics structure definition
+// --------------------------
+//
+// blocks : Blocks transformed forward while deduplicating
+// flat   : Blocks of a single value, transformed to their DC term
+// hits   : Blocks whose coefficients were found in a cache
+//
+typedef struct {
+    uint64_t blocks;
+    uint64_t flat;
+    uint64_t hits;
+} dctCacheStats;
+
+// Transform of one gathered block ('in' to 'out', both laid out 
+// as [x*blockSize + y] like the image's m[x][y])
+typedef void (*dctKernel)(const struct dctPlan* plan, 
+                          const double* in, double* out);
+
+// Plan structure definition
+// --------------------------
+//
+// width        : Amount of pixels in the x-direction
+// height       : Amount of (real) pixels in the y-direction
+// paddedHeight : Height rounded up to a whole amount of block rows
+// blockSize    : Width and height of each (square) block
+// precision    : PLAN_DOUBLE or PLAN_FLOAT
+// totalThreads : Amount of bands, and workers in 'pool'
+// kernel       : KERNEL_* used by the plan
+// forward      : Forward kernel for 'kernel'
+// inverse      : Inverse kernel for 'kernel'
+// basis        : Basis C[u][x] (scaling included), blockSize^2
+// basisT       : Transpose of 'basis', C[x][u]
+// basisF       : 'basis' as floats (PLAN_FLOAT)
+// basisTF      : 'basisT' as floats (PLAN_FLOAT)
+// th           : Band assigned to each thread
+// scratch      : Cache line aligned scratch blocks of every worker
+// scratchSize  : Amount of doubles of scratch per worker
+// kernelTime   : Seconds per execution of each kernel (PLAN_MEASURE)
+// traversal    : TRAVERSE_* order of the blocks of each band
+// prefetch     : Whether the next block's source is prefetched
+// stripBlocks  : Width of the strips of TRAVERSE_STRIP, in blocks
+// order        : Index of every block in the order they're visited,
+//                with the blocks of each band kept together
+// dirty        : Flag per block marking it for planUpdate()
+// dirtyList    : Index of every block marked in 'dirty'
+// batchLanes   : Blocks per batch of KERNEL_BATCH (4, 8 or 16)
+// batchScratch : Structure-of-arrays scratch of every worker for
+//                batches of PLAN_BATCH_LANES blocks (KERNEL_BATCH)
+// dedup        : Whether flat and repeated blocks are shortcut
+// cache        : Coefficient cache of every worker (PLAN_DEDUP)
+// pool         : Workers executing the plan
+// ownsPool     : Whether 'pool' is destroyed along with the plan
+//
+typedef struct dctPlan {
+    int width;
+    int height;
+    int paddedHeight;
+    int blockSize;
+    int precision;
+    int totalThreads;
+    int kernel;
+    dctKernel forward;
+    dctKernel inverse;
+    double* basis;
+    double* basisT;
+    float* basisF;
+    float* basisTF;
+    threadInfo* th;
+    double* scratch;
+    int scratchSize;
+    double kernelTime[KERNEL_COUNT];
+    int traversal;
+    int prefetch;
+    int stripBlocks;
+    int* order;
+    unsigned char* dirty;
+    int* dirtyList;
+    int batchLanes;
+    double* batchScratch;
+    int dedup;
+    struct planCache** cache;
+    threadPool* pool;
+    int ownsPool;
+} dctPlan;
+
+dctPlan* planCreate(int width, int height, int blockSize, int precision,
+                    int totalThreads, int flags);
+int planSetKernel(dctPlan* plan, int kernel);
+int planSetTraversal(dctPlan* plan, int traversal, int prefetch);
+int planSetDedup(dctPlan* plan, int enabled);
+int planSetBatch(dctPlan* plan, int lanes);
+void planCacheStats(dctPlan* plan, dctCacheStats* stats, int reset);
+void planCacheClear(dctPlan* plan);
+const char* planTraversalName(int traversal);
+int planKernelSupported(int kernel, int blockSize, int precision);
+const char* planKernelName(int kernel);
+int planKernelFromName(const char* name);
+image* planAllocateImage(dctPlan* plan, int flags);
+void planFirstTouch(dctPlan* plan, image* srcIMG, image* dctIMG, image* idctIMG);
+int planExecute(dctPlan* plan, image* srcIMG, image* dctIMG, image* idctIMG);
+int planForward(dctPlan* plan, image* srcIMG, image* dctIMG);
+int planInverse(dctPlan* plan, image* dctIMG, image* outIMG);
+int planExecuteImages(dctPlan* plan, int count, image** srcIMG,
+                      image** dctIMG, image** idctIMG);
+int planUpdate(dctPlan* plan, image* srcIMG, image* dctIMG, image* idctIMG,
+               const dctRect* rects, int rectCount);
+
+// Handle of a transform submitted with planSubmit() (opaque)
+typedef struct dctJob dctJob;
+
+// Function run once a submitted transform has finished
+typedef void (*dctJobCallback)(dctJob* job, void* arg);
+
+dctJob* planSubmit(dctPlan* plan, image* srcIMG, image* dctIMG, image* idctIMG,
+                   int direction, dctJobCallback callback, void* callbackArg);
+dctJob* planSubmitPriority(dctPlan* plan, image* srcIMG, image* dctIMG, image* idctIMG,
+                           int direction, int priority, double deadline,
+                           dctJobCallback callback, void* callbackArg);
+int planSharePool(dctPlan* plan, dctPlan* owner);
+long planJobProgress(dctJob* job, long* total);
+void planJobCancel(dctJob* job);
+int planJobPoll(dctJob* job);
+void planJobWait(dctJob* job);
+void planJobRelease(dctJob* job);
+
+// Time-budgeted transform result structure definition
+// --------------------------
+//
+// blocks   : Blocks of the image
+// complete : Blocks transformed before the budget ran out, where the
+//            others only have their mean in the preview
+// elapsed  : Seconds the transform took
+//
+typedef struct {
+    long blocks;
+    long complete;
+    double elapsed;
+} dctBudgetResult;
+
+int planExecuteBudget(dctPlan* plan, image* srcIMG, image* dctIMG, image* idctIMG,
+                      int direction, double budget, image* dcIMG, 
+                      dctBudgetResult* result);
+
+// Scales planInverseScaled() reconstructs at (1/scale of each side)
+#define SCALE_FULL    1
+#define SCALE_HALF    2
+#define SCALE_QUARTER 4
+#define SCALE_EIGHTH  8
+
+int planInverseScaled(dctPlan* plan, image* dctIMG, image* outIMG, 
+                      int scale, const dctRect* roi);
+
+// Lossless edits planCoefTransform() applies to whole blocks of
+// coefficients (as jpegtran does)
+// --------------------------
+//
+// EDIT_FLIP_H     : Mirror left to right
+// EDIT_FLIP_V     : Mirror top to bottom
+// EDIT_ROTATE_90  : Rotate a quarter turn clockwise
+// EDIT_ROTATE_180 : Rotate a half turn
+// EDIT_ROTATE_270 : Rotate a quarter turn counter-clockwise
+// EDIT_TRANSPOSE  : Mirror across the top-left to bottom-right diagonal
+// EDIT_TRANSVERSE : Mirror across the top-right to bottom-left diagonal
+//
+#define EDIT_FLIP_H     0
+#define EDIT_FLIP_V     1
+#define EDIT_ROTATE_90  2
+#define EDIT_ROTATE_180 3
+#define EDIT_ROTATE_270 4
+#define EDIT_TRANSPOSE  5
+#define EDIT_TRANSVERSE 6
+#define EDIT_COUNT      7
+
+int planCoefTransform(dctPlan* plan, image* dctIMG, image* outIMG, int edit);
+int planCoefCrop(dctPlan* plan, image* dctIMG, image* outIMG, const dctRect* rect);
+int planCoefDownscale(dctPlan* plan, image* dctIMG, image* outIMG);
+int planEditSwapsSides(int edit);
+const char* planEditName(int edit);
+
+int planDenoise(dctPlan* plan, image* srcIMG, image* outIMG, int stride,
+                double threshold);
+
+// Tuning file that plans are tuned from when not given one (in the
+// working directory)
+#define TUNE_FILE_DEFAULT "tcdct.tune"
+
+// Tuned configuration structure definition
+// --------------------------
+//
+// totalThreads : Amount of threads
+// kernel       : KERNEL_* block kernel
+// traversal    : TRAVERSE_* order of the blocks of each band
+// stripBlocks  : Width of the strips of TRAVERSE_STRIP, in blocks
+// prefetch     : Whether the next block is prefetched
+// batchLanes   : Blocks per batch of KERNEL_BATCH
+// mpixels      : Megapixels per second the configuration reached
+//
+typedef struct {
+    int totalThreads;
+    int kernel;
+    int traversal;
+    int stripBlocks;
+    int prefetch;
+    int batchLanes;
+    double mpixels;
+} dctTuning;
+
+int planTune(int width, int height, int blockSize, int precision, int maxThreads,
+             const char* fileName, dctTuning* tuning, FILE* logFile);
+int planTuneLookup(const char* fileName, int width, int height, int blockSize,
+                   int precision, dctTuning* tuning);
+dctPlan* planCreateTuned(int width, int height, int blockSize, int precision,
+                         int flags, const char* fileName);
+void planApplyTuning(dctPlan* plan, const dctTuning* tuning);
+const char* planSizeClass(int width, int height);
+
+// Element types of an integer plane
+#define INT_PLANE_16 16
+#define INT_PLANE_32 32
+
+// Integer plane structure definition
+// --------------------------
+//
+// width  : Pixels per row
+// height : Pixels per column
+// stride : Elements from the start of one column to the next (the
+//          height rounded up to whole cache lines)
+// bits   : INT_PLANE_16 (int16_t elements) or INT_PLANE_32 (int32_t)
+// data   : Elements, column-major like an image, at [x*stride + y]
+//
+typedef struct {
+    int width;
+    int height;
+    int stride;
+    int bits;
+    void* data;
+} intPlane;
+
+intPlane* intPlaneAllocate(int width, int height, int bits);
+void intPlaneFree(intPlane* plane);
+void intPlaneFromImage(intPlane* plane, image* im);
+void intPlaneToImage(intPlane* plane, image* im);
+int planForwardInt(dctPlan* plan, intPlane* srcPlane, intPlane* dctPlane);
+int planInverseInt(dctPlan* plan, intPlane* dctPlane, intPlane* outPlane);
+void planDestroy(dctPlan* plan);
+
+/*
+    Copy the (B x B) block at (i, j) out of an image
+*/
+static inline void planGather(image* im, double* blk, int i, int j, int B) {
+    for (int x = 0; x < B; x++) {
+        pixel* column = &im->m[i + x][j];
+        for (int y = 0; y < B; y++)
+            blk[x*B + y] = column[y].i;
+    }
+}
+
+/*
+    Copy a (B x B) block into an image at (i, j)
+*/
+static inline void planScatter(image* im, const double* blk, int i, int j, int B) {
+    for (int x = 0; x < B; x++) {
+        pixel* column = &im->m[i + x][j];
+        for (int y = 0; y < B; y++)
+            column[y].i = blk[x*B + y];
+    }
+}
+
+
+
+
+///////////////////////////////////////////
+//              SEQUENCES                //
+///////////////////////////////////////////
+
+// Block counters of one band (one cache line aligned entry per band)
+//
+// computed     : Blocks transformed over the whole sequence
+// skipped      : Blocks reused over the whole sequence
+// frameSkipped : Blocks reused in the most recent frame
+//
+typedef struct {
+    uint64_t computed;
+    uint64_t skipped;
+    uint64_t frameSkipped;
+} __attribute__((aligned(CACHE_LINE))) seqBand;
+
+// Sequence structure definition
+// --------------------------
+//
+// plan      : Plan every frame is transformed with
+// threshold : Largest pixel difference of a block still counted as
+//             unchanged (0.0 only skips blocks that are identical)
+// frames    : Amount of frames processed so far
+// prevIMG   : Source pixels of the blocks whose coefficients are cached
+// dctIMG    : Coefficients of the most recent frame
+// idctIMG   : Reconstruction of the most recent frame
+// frameIMG  : Frame being processed (only during seqProcess())
+// bands     : Counters of each band of the plan
+//
+typedef struct {
+    dctPlan* plan;
+    double threshold;
+    int frames;
+    image* prevIMG;
+    image* dctIMG;
+    image* idctIMG;
+    image* frameIMG;
+    seqBand* bands;
+} dctSequence;
+
+dctSequence* seqCreate(dctPlan* plan, double threshold);
+int seqProcess(dctSequence* seq, image* frameIMG);
+void seqCounts(dctSequence* seq, uint64_t* computed, uint64_t* skipped);
+void seqReset(dctSequence* seq);
+void seqDestroy(dctSequence* seq);
+
+
+
+///////////////////////////////////////////
+//          COEFFICIENT FILES            //
+///////////////////////////////////////////
+
+// Compression of the strips of a coefficient file
+//
+// COEF_RAW     : Coefficients stored as is (strips can be mapped 
+//                without any decoding, see coefStripData())
+// COEF_DEFLATE : Bytes of the coefficients shuffled into planes and
+//                deflated with zlib (only if built with HAVE_ZLIB)
+//
+#define COEF_RAW     0
+#define COEF_DEFLATE 1
+
+#define COEF_MAGIC   "TCDCTCF1"
+#define COEF_VERSION 1
+
+// Coefficient file header (at offset 0, followed by the strip index)
+// --------------------------
+//
+// magic       : COEF_MAGIC
+// version     : COEF_VERSION
+// width       : Amount of coefficients in the x-direction
+// height      : Amount of coefficients in the y-direction
+// blockSize   : Size of the blocks, and rows per strip
+// compression : COEF_* of every strip
+// stripCount  : Amount of strips (height/blockSize)
+//
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t blockSize;
+    uint32_t compression;
+    uint32_t stripCount;
+    uint8_t reserved[32];
+} coefHeader;
+
+// Strip index entry (one per strip, right after the header)
+//
+// offset  : Offset of the strip from the start of the file
+// size    : Bytes the strip takes up in the file
+// rawSize : Bytes of the strip's coefficients once decoded
+//
+typedef struct {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t rawSize;
+} coefStrip;
+
+// Coefficient file structure definition (an opened, mapped file)
+// --------------------------
+//
+// header : Header of the file
+// index  : Strip index of the file
+// data   : Mapping of the whole file
+// size   : Bytes in the file
+//
+typedef struct {
+    const coefHeader* header;
+    const coefStrip* index;
+    const uint8_t* data;
+    size_t size;
+} coefFile;
+
+int coefWrite(image* dctIMG, int blockSize, int compression, 
+              threadPool* pool, const char* fileName);
+coefFile* coefOpen(const char* fileName);
+const double* coefStripData(coefFile* cf, int strip);
+int coefReadStrip(coefFile* cf, int strip, double* out);
+int coefRead(coefFile* cf, image* dctIMG, threadPool* pool);
+void coefClose(coefFile* cf);
+
+
+
+///////////////////////////////////////////
+//              GENERATION               //
+///////////////////////////////////////////
+
+// Content imGenerate() can fill an image with
+//
+// GEN_NOISE    : Uniform random values (as imRandomize() gave)
+// GEN_GRADIENT : A smooth ramp in a random direction
+// GEN_NATURAL  : Fractal value noise with a natural-image-like
+//                (roughly 1/f) spectrum
+// GEN_TEXT     : Lines of dark glyphs on a light page, like a 
+//                terminal or document screenshot
+//
+#define GEN_NOISE    0
+#define GEN_GRADIENT 1
+#define GEN_NATURAL  2
+#define GEN_TEXT     3
+
+// Seed imRandomize() and generateImage() generate with
+#define GEN_DEFAULT_SEED 0x7463646374ull
+
+void imGenerate(image* im, int height, uint64_t seed, int mode, threadPool* pool);
+int imGenerateMode(const char* name);
+
+
+
+///////////////////////////////////////////
+//         DISTRIBUTED TILING            //
+///////////////////////////////////////////
+
+// Most workers a coordinator can hand tiles out to
+#define NET_MAX_WORKERS 64
+
+#define NET_MAGIC "TCDN"
+
+// Types of messages between a coordinator and its workers
+//
+// NET_TILE   : Coordinator -> worker, pixels of a tile to transform
+// NET_RESULT : Worker -> coordinator, coefficients of a tile followed
+//              by its reconstruction (if the tile asked for one)
+// NET_QUIT   : Coordinator -> worker, no more tiles are coming
+//
+#define NET_TILE   1
+#define NET_RESULT 2
+#define NET_QUIT   3
+
+// Message header structure definition (sent ahead of every payload,
+// in the byte order of the hosts, which must match)
+// --------------------------
+//
+// magic     : NET_MAGIC
+// type      : NET_* type of the message
+// x, y      : Position of the tile in the image
+// width     : Width of the tile
+// height    : Height of the tile
+// blockSize : Size of the blocks to transform the tile in
+// direction : PLAN_FORWARD and/or PLAN_INVERSE
+// payload   : Bytes following the header (doubles, ordered 
+//             [x*height + y] like the image's m[x][y])
+//
+typedef struct {
+    char magic[4];
+    uint32_t type;
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+    uint32_t blockSize;
+    uint32_t direction;
+    uint64_t payload;
+} netMessage;
+
+int netListen(const char* address);
+int netConnect(const char* address);
+int netAccept(int listenFD, int* fds, int workerCount);
+int netServe(int fd, int totalThreads);
+int netDistribute(const int* fds, int workerCount, image* srcIMG, image* dctIMG,
+                  image* idctIMG, int blockSize, int tileSize, int direction);
+void netShutdown(const int* fds, int workerCount);
+
+#endif